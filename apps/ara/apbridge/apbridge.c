@@ -76,15 +76,13 @@ static int usb_to_unipro(struct apbridge_dev_s *dev, unsigned cportid,
 
 int recv_from_unipro(unsigned int cportid, void *buf, size_t len)
 {
-    /*
-     * FIXME: Remove when UniPro driver provides the actual buffer length.
-     */
-    len = gb_packet_size(buf);
-
     gb_dump(buf, len);
 
-    if (len < sizeof(struct gb_operation_hdr))
+    /* buf is handed to USB as is, so it must be given back on error */
+    if (len < sizeof(struct gb_operation_hdr)) {
+        unipro_rxbuf_free(cportid, buf);
         return -EPROTO;
+    }
 
     return unipro_to_usb(g_usbdev, cportid, buf, len);
 }
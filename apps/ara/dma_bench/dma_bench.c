@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @brief CPU versus DMA memory copy benchmark
+ *
+ * Copies buffers of increasing sizes with memcpy() and with dma_memcpy(),
+ * the threshold of the latter forced to 0 so that every copy goes through
+ * the DMA controller, and reports the throughput of both. While the DMA
+ * copies run, a low priority thread counts loops to estimate how much of
+ * the CPU was left for other work.
+ *
+ * With -c, it instead checks that back to back asynchronous copies are
+ * chained by the DMA driver.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nuttx/dma_memcpy.h>
+#include <nuttx/hires_tmr.h>
+
+#define DMA_BENCH_MAX_SIZES     12
+
+struct dma_bench_result {
+    uint32_t elapsed;           /* in us */
+    uint32_t idle_loops;        /* done by the low priority thread */
+    int errors;
+};
+
+struct dma_bench_chain {
+    sem_t done;
+    unsigned int count;
+    volatile unsigned int completed;
+    volatile int errors;
+};
+
+static volatile bool dma_bench_idle_run;
+static volatile uint32_t dma_bench_idle_loops;
+
+static void *dma_bench_idle(void *arg)
+{
+    while (dma_bench_idle_run) {
+        dma_bench_idle_loops++;
+    }
+
+    return NULL;
+}
+
+static int dma_bench_idle_start(pthread_t *thread)
+{
+    struct sched_param param;
+    pthread_attr_t attr;
+    int ret;
+
+    dma_bench_idle_loops = 0;
+    dma_bench_idle_run = true;
+
+    pthread_attr_init(&attr);
+    param.sched_priority = SCHED_PRIORITY_MIN + 1;
+    pthread_attr_setschedparam(&attr, &param);
+    ret = pthread_create(thread, &attr, dma_bench_idle, NULL);
+    pthread_attr_destroy(&attr);
+
+    return ret;
+}
+
+static uint32_t dma_bench_idle_stop(pthread_t thread)
+{
+    dma_bench_idle_run = false;
+    pthread_join(thread, NULL);
+
+    return dma_bench_idle_loops;
+}
+
+/* Calibrate: how many loops the idle thread does when the CPU is free */
+
+static uint32_t dma_bench_idle_calibrate(uint32_t usec)
+{
+    pthread_t thread;
+
+    if (dma_bench_idle_start(&thread))
+        return 0;
+
+    usleep(usec);
+
+    return dma_bench_idle_stop(thread);
+}
+
+static void dma_bench_fill(uint8_t *buf, size_t len, unsigned int seed)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = (uint8_t) (i + seed);
+    }
+}
+
+static void dma_bench_run(bool dma, bool set, uint8_t *dst,
+                          const uint8_t *src, size_t len,
+                          unsigned int count, struct dma_bench_result *res)
+{
+    pthread_t thread;
+    bool idle = false;
+    uint32_t start;
+    unsigned int i;
+
+    res->errors = 0;
+    res->idle_loops = 0;
+
+    if (dma)
+        idle = !dma_bench_idle_start(&thread);
+
+    start = hrt_getusec();
+    for (i = 0; i < count; i++) {
+        if (set && dma) {
+            res->errors += !!dma_memset(dst, i, len);
+        } else if (set) {
+            memset(dst, i, len);
+        } else if (dma) {
+            res->errors += !!dma_memcpy(dst, src, len);
+        } else {
+            memcpy(dst, src, len);
+        }
+    }
+    res->elapsed = hrt_getusec() - start;
+
+    if (idle)
+        res->idle_loops = dma_bench_idle_stop(thread);
+
+    if (set ? dst[len - 1] != (uint8_t) (count - 1) : memcmp(dst, src, len))
+        res->errors++;
+}
+
+static void dma_bench_chain_callback(int status, void *arg)
+{
+    struct dma_bench_chain *chain = arg;
+
+    if (status)
+        chain->errors++;
+
+    if (++chain->completed == chain->count)
+        sem_post(&chain->done);
+}
+
+/*
+ * Copy len bytes as CONFIG_DMA_MEMCPY_NOPS asynchronous copies, queued with
+ * the scheduler locked so that they are all waiting before the first one
+ * completes. They must all be copied and reported, in fewer wakeups of the
+ * DMA completion context than copies.
+ */
+static int dma_bench_chain(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    struct device_dma_chan_stats before, after;
+    struct dma_bench_chain chain;
+    size_t chunk = len / CONFIG_DMA_MEMCPY_NOPS;
+    uint32_t completions, wakeups;
+    unsigned int i;
+    int errors = 0;
+
+    if (!chunk || dma_memcpy_get_chan_stats(&before)) {
+        fprintf(stderr, "chain: cannot run with %zu bytes\n", len);
+        return 1;
+    }
+
+    sem_init(&chain.done, 0, 0);
+    sem_setprotocol(&chain.done, SEM_PRIO_NONE);
+    chain.count = CONFIG_DMA_MEMCPY_NOPS;
+    chain.completed = 0;
+    chain.errors = 0;
+
+    memset(dst, 0, len);
+
+    sched_lock();
+    for (i = 0; i < chain.count; i++) {
+        errors += !!dma_memcpy_async(dst + i * chunk, src + i * chunk, chunk,
+                                     dma_bench_chain_callback, &chain);
+    }
+    sched_unlock();
+
+    while (sem_wait(&chain.done) < 0 && errno == EINTR)
+        ;
+    sem_destroy(&chain.done);
+
+    dma_memcpy_get_chan_stats(&after);
+    completions = after.completions - before.completions;
+    wakeups = after.wakeups - before.wakeups;
+
+    errors += chain.errors;
+    if (memcmp(dst, src, chain.count * chunk))
+        errors++;
+    if (completions != chain.count || wakeups >= completions)
+        errors++;
+
+    printf("chain: %u copies of %zu bytes, %u completions in %u wakeups, "
+           "%s\n", chain.count, chunk, completions, wakeups,
+           errors ? "FAILED" : "ok");
+
+    return errors;
+}
+
+static uint32_t dma_bench_rate(size_t len, unsigned int count,
+                               uint32_t elapsed)
+{
+    if (!elapsed)
+        return 0;
+
+    return (uint64_t) len * count * 1000000 / elapsed / 1024;
+}
+
+static int parse_list(char *str, unsigned int *values, int max)
+{
+    char *token, *saveptr;
+    int count = 0;
+
+    for (token = strtok_r(str, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr)) {
+        if (count == max || sscanf(token, "%u", &values[count]) != 1 ||
+            !values[count])
+            return -EINVAL;
+        count++;
+    }
+
+    return count;
+}
+
+#ifdef CONFIG_BUILD_KERNEL
+int main(int argc, FAR char *argv[])
+#else
+int dmabench_main(int argc, char *argv[])
+#endif
+{
+    unsigned int sizes[DMA_BENCH_MAX_SIZES] = {
+        64, 256, 1024, 4096, 16384,
+    };
+    int size_count = 5;
+    unsigned int count = 100;
+    struct dma_bench_result cpu, dma;
+    struct dma_memcpy_stats stats;
+    struct device_dma_chan_stats chan_stats;
+    size_t threshold;
+    size_t max_size = 0;
+    uint32_t idle_ref;
+    uint8_t *src, *dst;
+    bool set = false;
+    bool chain = false;
+    int opt, s, ret;
+
+    optind = -1;
+    while ((opt = getopt(argc, argv, "n:s:mc")) != -1) {
+        switch (opt) {
+        case 'n':
+            if (sscanf(optarg, "%u", &count) != 1 || !count)
+                goto help;
+            break;
+        case 's':
+            size_count = parse_list(optarg, sizes, DMA_BENCH_MAX_SIZES);
+            if (size_count <= 0)
+                goto help;
+            break;
+        case 'm':
+            set = true;
+            break;
+        case 'c':
+            chain = true;
+            break;
+        default:
+            goto help;
+        }
+    }
+
+    ret = dma_memcpy_init(NULL);
+    if (ret) {
+        fprintf(stderr, "cannot use DMA: %d\n", ret);
+        return EXIT_FAILURE;
+    }
+
+    for (s = 0; s < size_count; s++) {
+        if (sizes[s] > max_size)
+            max_size = sizes[s];
+    }
+
+    src = malloc(max_size);
+    dst = malloc(max_size);
+    if (!src || !dst) {
+        fprintf(stderr, "cannot allocate 2 buffers of %zu bytes\n", max_size);
+        free(src);
+        free(dst);
+        return EXIT_FAILURE;
+    }
+
+    idle_ref = dma_bench_idle_calibrate(100000);
+
+    threshold = dma_memcpy_get_threshold();
+    dma_memcpy_set_threshold(0);
+
+    if (chain) {
+        dma_bench_fill(src, max_size, 0);
+        ret = dma_bench_chain(dst, src, max_size);
+        dma_memcpy_set_threshold(threshold);
+        free(src);
+        free(dst);
+        return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    printf("%s, %u copies per size, DMA threshold %zu\n",
+           set ? "memset" : "memcpy", count, threshold);
+    printf("   SIZE   CPU KB/s   DMA KB/s   CPU us   DMA us  CPU FREE  ERR\n");
+
+    for (s = 0; s < size_count; s++) {
+        uint32_t free_pct = 0;
+
+        dma_bench_fill(src, sizes[s], s);
+        dma_bench_run(false, set, dst, src, sizes[s], count, &cpu);
+        memset(dst, 0, sizes[s]);
+        dma_bench_run(true, set, dst, src, sizes[s], count, &dma);
+
+        /* Share of the CPU the idle thread got during the DMA copies */
+        if (idle_ref && dma.elapsed) {
+            free_pct = (uint64_t) dma.idle_loops * 10000000 /
+                       ((uint64_t) idle_ref * dma.elapsed);
+            if (free_pct > 100)
+                free_pct = 100;
+        }
+
+        printf("%7u %10u %10u %8u %8u %8u%% %4d\n", sizes[s],
+               dma_bench_rate(sizes[s], count, cpu.elapsed),
+               dma_bench_rate(sizes[s], count, dma.elapsed),
+               cpu.elapsed / count, dma.elapsed / count, free_pct,
+               cpu.errors + dma.errors);
+    }
+
+    dma_memcpy_set_threshold(threshold);
+
+    dma_memcpy_get_stats(&stats);
+    printf("total: %u DMA copies (%u bytes), %u CPU copies (%u bytes), "
+           "%u without free op, %u errors\n",
+           stats.dma_copies, stats.dma_bytes, stats.cpu_copies,
+           stats.cpu_bytes, stats.busy, stats.errors);
+
+    if (!dma_memcpy_get_chan_stats(&chan_stats)) {
+        printf("DMA channel: %u completions in %u wakeups (max batch %u), "
+               "max latency %u us\n", chan_stats.completions,
+               chan_stats.wakeups, chan_stats.max_batch,
+               chan_stats.max_latency);
+        printf("latency:");
+        for (s = 0; s < DEVICE_DMA_LATENCY_BUCKETS; s++) {
+            if (chan_stats.latency[s])
+                printf(" <%uus:%u", 1U << s, chan_stats.latency[s]);
+        }
+        printf("\n");
+    }
+
+    free(src);
+    free(dst);
+
+    return EXIT_SUCCESS;
+
+help:
+    fprintf(stderr, "usage: dmabench [-n count] [-s size,...] [-m] [-c]\n");
+    fprintf(stderr, "  -n: copies per size (default 100)\n");
+    fprintf(stderr, "  -s: sizes in bytes, up to %d (default 64,256,1024,4096,16384)\n",
+            DMA_BENCH_MAX_SIZES);
+    fprintf(stderr, "  -m: benchmark memset instead of memcpy\n");
+    fprintf(stderr, "  -c: check that asynchronous copies of the largest size are chained\n");
+    return EXIT_FAILURE;
+}
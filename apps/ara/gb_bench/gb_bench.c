@@ -0,0 +1,582 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @brief Greybus throughput and latency benchmark
+ *
+ * Runs loopback protocol operations between two CPorts of the same node
+ * connected by the simulated UniPro loop, so that every message goes through
+ * greybus-core twice (request and response) without any hardware involved.
+ * Latencies are recorded in a log-linear histogram to report percentiles.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arch/byteorder.h>
+
+#include <nuttx/greybus/greybus.h>
+#include <nuttx/greybus/loopback.h>
+#include <nuttx/hires_tmr.h>
+#include <nuttx/util.h>
+
+#define GB_BENCH_MAX_PARAMS     8
+
+/*
+ * Histogram buckets: values below 2^SUB_BITS get their own bucket, above
+ * that each power of two is split in 2^SUB_BITS buckets, which bounds the
+ * error on a percentile to 1/16 of its value.
+ */
+#define HIST_SUB_BITS           4
+#define HIST_SUB_COUNT          (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS            ((32 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+struct gb_bench_histogram {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t buckets[HIST_BUCKETS];
+};
+
+/*
+ * Private operation type: same as ping, but the server handles it from the
+ * RX path when CONFIG_GREYBUS_ATOMIC_HANDLERS is set.
+ */
+#define GB_BENCH_TYPE_ATOMIC_PING   0x7f
+
+struct gb_bench_type {
+    const char *name;
+    uint8_t type;
+    bool has_payload;
+};
+
+static const struct gb_bench_type gb_bench_types[] = {
+    {
+        .name = "ping",
+        .type = GB_LOOPBACK_TYPE_PING,
+    },
+    {
+        .name = "xfer",
+        .type = GB_LOOPBACK_TYPE_TRANSFER,
+        .has_payload = true,
+    },
+    {
+        .name = "sink",
+        .type = GB_LOOPBACK_TYPE_SINK,
+        .has_payload = true,
+    },
+    {
+        .name = "aping",
+        .type = GB_BENCH_TYPE_ATOMIC_PING,
+    },
+};
+
+struct gb_bench_run {
+    const struct gb_bench_type *type;
+    size_t size;
+    unsigned int concurrency;
+    unsigned int count;
+
+    /* limits the number of requests in flight to 'concurrency' */
+    sem_t window;
+
+    unsigned int errors;
+    uint32_t elapsed;
+    struct gb_bench_histogram hist;
+};
+
+static struct gb_bench_run gb_bench_run;
+static int gb_bench_client_cport = -1;
+static int gb_bench_init_status;
+static pthread_once_t gb_bench_init_once = PTHREAD_ONCE_INIT;
+
+static unsigned int hist_index(uint32_t value)
+{
+    unsigned int msb;
+
+    if (value < HIST_SUB_COUNT)
+        return value;
+
+    msb = 31 - __builtin_clz(value);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB_COUNT +
+           ((value >> (msb - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1));
+}
+
+/* Highest value that falls in the bucket */
+static uint32_t hist_bucket_max(unsigned int index)
+{
+    unsigned int msb;
+    uint32_t base;
+
+    if (index < HIST_SUB_COUNT)
+        return index;
+
+    msb = index / HIST_SUB_COUNT + HIST_SUB_BITS - 1;
+    base = (1u << msb) |
+           ((index % HIST_SUB_COUNT) << (msb - HIST_SUB_BITS));
+    return base + (1u << (msb - HIST_SUB_BITS)) - 1;
+}
+
+static void hist_add(struct gb_bench_histogram *hist, uint32_t value)
+{
+    if (!hist->count || value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+
+    hist->count++;
+    hist->total += value;
+    hist->buckets[hist_index(value)]++;
+}
+
+/**
+ * @brief Get a percentile out of the histogram
+ * @param hist histogram
+ * @param ratio percentile in parts per 10000 (p99.9 is 9990)
+ * @return upper bound of the bucket the percentile falls in
+ */
+static uint32_t hist_percentile(const struct gb_bench_histogram *hist,
+                                unsigned int ratio)
+{
+    uint64_t target;
+    uint32_t seen = 0;
+    unsigned int i;
+
+    if (!hist->count)
+        return 0;
+
+    target = ((uint64_t) hist->count * ratio + 9999) / 10000;
+    if (!target)
+        target = 1;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= target)
+            return MIN(hist_bucket_max(i), hist->max);
+    }
+
+    return hist->max;
+}
+
+/*
+ * Server side: answers the loopback requests the same way the loopback
+ * driver does. Transfers echo the request data without copying it.
+ */
+
+static uint8_t gb_bench_ping_sink_req_cb(struct gb_operation *operation)
+{
+    return GB_OP_SUCCESS;
+}
+
+static uint8_t gb_bench_transfer_req_cb(struct gb_operation *operation)
+{
+    struct gb_loopback_transfer_response *response;
+    struct gb_loopback_transfer_request *request =
+        gb_operation_get_request_payload(operation);
+    size_t len;
+
+    if (gb_operation_get_request_payload_size(operation) < sizeof(*request))
+        return GB_OP_INVALID;
+
+    len = le32_to_cpu(request->len);
+    if (len > gb_operation_get_request_payload_size(operation) -
+              sizeof(*request))
+        return GB_OP_INVALID;
+
+    response = gb_operation_alloc_response(operation, sizeof(*response));
+    if (!response)
+        return GB_OP_NO_MEMORY;
+
+    response->len = request->len;
+    if (len && gb_operation_append_response_data(operation, request->data,
+                                                 len))
+        return GB_OP_INVALID;
+
+    return GB_OP_SUCCESS;
+}
+
+static struct gb_operation_handler gb_bench_server_handlers[] = {
+    GB_HANDLER(GB_LOOPBACK_TYPE_PING, gb_bench_ping_sink_req_cb),
+    GB_HANDLER(GB_LOOPBACK_TYPE_TRANSFER, gb_bench_transfer_req_cb),
+    GB_HANDLER(GB_LOOPBACK_TYPE_SINK, gb_bench_ping_sink_req_cb),
+    GB_ATOMIC_HANDLER(GB_BENCH_TYPE_ATOMIC_PING, gb_bench_ping_sink_req_cb),
+};
+
+static struct gb_driver gb_bench_server_driver = {
+    .op_handlers = gb_bench_server_handlers,
+    .op_handlers_count = ARRAY_SIZE(gb_bench_server_handlers),
+};
+
+/*
+ * Client side only receives responses, but greybus-core drops anything
+ * received on a cport whose driver has no handler table.
+ */
+static struct gb_operation_handler gb_bench_client_handlers[] = {
+    GB_HANDLER(GB_LOOPBACK_TYPE_PING, gb_bench_ping_sink_req_cb),
+};
+
+static struct gb_driver gb_bench_client_driver = {
+    .op_handlers = gb_bench_client_handlers,
+    .op_handlers_count = ARRAY_SIZE(gb_bench_client_handlers),
+};
+
+static void gb_bench_init(void)
+{
+    int server = gb_bench_client_cport ^ 1;
+    int retval;
+
+    retval = gb_unipro_init();
+    if (retval)
+        goto error;
+
+    retval = gb_register_driver(gb_bench_client_cport,
+                                &gb_bench_client_driver);
+    if (retval)
+        goto error;
+
+    retval = gb_register_driver(server, &gb_bench_server_driver);
+    if (retval)
+        goto error;
+
+    retval = gb_listen(gb_bench_client_cport);
+    if (retval)
+        goto error;
+
+    retval = gb_listen(server);
+    if (retval)
+        goto error;
+
+    return;
+
+error:
+    fprintf(stderr, "gbbench initialization failed: %d\n", retval);
+    gb_bench_init_status = retval;
+}
+
+static void gb_bench_resp_cb(struct gb_operation *operation)
+{
+    struct gb_bench_run *run = &gb_bench_run;
+    struct gb_loopback_transfer_response *response;
+    struct gb_loopback_transfer_request *request;
+    uint32_t latency;
+
+    latency = hrt_getusec() - (uint32_t) (uintptr_t) operation->priv_data;
+
+    if (gb_operation_get_request_result(operation) != GB_OP_SUCCESS) {
+        run->errors++;
+    } else if (run->type->type == GB_LOOPBACK_TYPE_TRANSFER) {
+        request = gb_operation_get_request_payload(operation);
+        response = gb_operation_get_request_payload(operation->response);
+
+        if (request->len != response->len ||
+            memcmp(request->data, response->data, run->size))
+            run->errors++;
+        else
+            hist_add(&run->hist, latency);
+    } else {
+        hist_add(&run->hist, latency);
+    }
+
+    sem_post(&run->window);
+}
+
+static int gb_bench_send(struct gb_bench_run *run, unsigned int seq)
+{
+    struct gb_loopback_transfer_request *request;
+    struct gb_operation *operation;
+    size_t size = 0;
+    int retval;
+
+    if (run->type->has_payload)
+        size = sizeof(*request) + run->size;
+
+    operation = gb_operation_create(gb_bench_client_cport, run->type->type,
+                                    size);
+    if (!operation)
+        return -ENOMEM;
+
+    if (size) {
+        request = gb_operation_get_request_payload(operation);
+        request->len = cpu_to_le32(run->size);
+        if (run->type->type == GB_LOOPBACK_TYPE_TRANSFER)
+            memset(request->data, seq, run->size);
+    }
+
+    operation->priv_data = (void *) (uintptr_t) hrt_getusec();
+    retval = gb_operation_send_request(operation, gb_bench_resp_cb, true);
+
+    gb_operation_destroy(operation);
+    return retval;
+}
+
+static void gb_bench_execute(struct gb_bench_run *run)
+{
+    uint32_t start;
+    unsigned int i;
+
+    run->errors = 0;
+    memset(&run->hist, 0, sizeof(run->hist));
+    sem_init(&run->window, 0, run->concurrency);
+    sem_setprotocol(&run->window, SEM_PRIO_NONE);
+
+    start = hrt_getusec();
+
+    for (i = 0; i < run->count; i++) {
+        sem_wait(&run->window);
+
+        if (gb_bench_send(run, i)) {
+            run->errors++;
+            sem_post(&run->window);
+        }
+    }
+
+    /* wait for all the requests still in flight */
+    for (i = 0; i < run->concurrency; i++)
+        sem_wait(&run->window);
+
+    run->elapsed = hrt_getusec() - start;
+    sem_destroy(&run->window);
+}
+
+/* Payload bytes moved by one operation, both directions */
+static size_t gb_bench_op_bytes(const struct gb_bench_run *run)
+{
+    switch (run->type->type) {
+    case GB_LOOPBACK_TYPE_TRANSFER:
+        return 2 * run->size;
+    case GB_LOOPBACK_TYPE_SINK:
+        return run->size;
+    default:
+        return 0;
+    }
+}
+
+static void gb_bench_print(const struct gb_bench_run *run, bool csv)
+{
+    const struct gb_bench_histogram *hist = &run->hist;
+    uint32_t elapsed = run->elapsed ? run->elapsed : 1;
+    uint32_t msgs_per_sec;
+    uint32_t bytes_per_sec;
+    uint32_t avg;
+
+    msgs_per_sec = (uint64_t) hist->count * 1000000 / elapsed;
+    bytes_per_sec = (uint64_t) hist->count * gb_bench_op_bytes(run) *
+                    1000000 / elapsed;
+    avg = hist->count ? hist->total / hist->count : 0;
+
+    printf(csv ? "%s,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n" :
+                 "%5s %6u %5u %7u %6u %9u %11u %6u %6u %6u %6u %6u %7u %6u\n",
+           run->type->name, (unsigned int) run->size, run->concurrency,
+           run->count,
+           run->errors, msgs_per_sec, bytes_per_sec,
+           hist->min, avg,
+           hist_percentile(hist, 5000), hist_percentile(hist, 9000),
+           hist_percentile(hist, 9900), hist_percentile(hist, 9990),
+           hist->max);
+}
+
+static int parse_list(char *str, unsigned int *values, int max)
+{
+    char *token, *saveptr;
+    int count = 0;
+
+    for (token = strtok_r(str, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr)) {
+        if (count == max || sscanf(token, "%u", &values[count]) != 1)
+            return -EINVAL;
+        count++;
+    }
+
+    return count;
+}
+
+static int parse_types(char *str, const struct gb_bench_type **types,
+                       int max)
+{
+    char *token, *saveptr;
+    int count = 0;
+    int i;
+
+    for (token = strtok_r(str, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr)) {
+        if (count == max)
+            return -EINVAL;
+
+        for (i = 0; i < ARRAY_SIZE(gb_bench_types); i++) {
+            if (!strcmp(token, gb_bench_types[i].name))
+                break;
+        }
+
+        if (i == ARRAY_SIZE(gb_bench_types))
+            return -EINVAL;
+
+        types[count++] = &gb_bench_types[i];
+    }
+
+    return count;
+}
+
+#ifdef CONFIG_BUILD_KERNEL
+int main(int argc, FAR char *argv[])
+#else
+int gbbench_main(int argc, char *argv[])
+#endif
+{
+    const struct gb_bench_type *types[ARRAY_SIZE(gb_bench_types)] = {
+        &gb_bench_types[0], &gb_bench_types[1], &gb_bench_types[2],
+        &gb_bench_types[3],
+    };
+    unsigned int sizes[GB_BENCH_MAX_PARAMS] = { 0, 64, 512, 2000 };
+    unsigned int jobs[GB_BENCH_MAX_PARAMS] = { 1, 4, 16 };
+    int type_count = ARRAY_SIZE(types);
+    int size_count = 4;
+    int job_count = 3;
+    struct gb_bench_run *run = &gb_bench_run;
+    unsigned int count = 1000;
+    int cport = -1;
+    bool csv = false;
+    int opt, t, s, j;
+
+    optind = -1;
+    while ((opt = getopt(argc, argv, "c:n:t:s:j:f:")) != -1) {
+        switch (opt) {
+        case 'c':
+            if (sscanf(optarg, "%d", &cport) != 1 || cport < 0)
+                goto help;
+            break;
+        case 'n':
+            if (sscanf(optarg, "%u", &count) != 1 || !count)
+                goto help;
+            break;
+        case 't':
+            type_count = parse_types(optarg, types, ARRAY_SIZE(types));
+            if (type_count <= 0)
+                goto help;
+            break;
+        case 's':
+            size_count = parse_list(optarg, sizes, GB_BENCH_MAX_PARAMS);
+            if (size_count <= 0)
+                goto help;
+            break;
+        case 'j':
+            job_count = parse_list(optarg, jobs, GB_BENCH_MAX_PARAMS);
+            if (job_count <= 0)
+                goto help;
+            break;
+        case 'f':
+            if (strcmp(optarg, "csv"))
+                goto help;
+            csv = true;
+            break;
+        default:
+            goto help;
+        }
+    }
+
+    for (s = 0; s < size_count; s++) {
+        if (sizes[s] > GB_MAX_PAYLOAD_SIZE -
+                       sizeof(struct gb_loopback_transfer_response)) {
+            fprintf(stderr, "size %u exceeds the Greybus MTU\n", sizes[s]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (j = 0; j < job_count; j++) {
+        if (!jobs[j])
+            goto help;
+    }
+
+    /* The CPort pair is fixed once the drivers are registered */
+    if (gb_bench_client_cport < 0) {
+        gb_bench_client_cport = cport < 0 ? 0 : cport & ~1;
+    } else if (cport >= 0 && (cport & ~1) != gb_bench_client_cport) {
+        fprintf(stderr, "already running on CPorts %d and %d\n",
+                gb_bench_client_cport, gb_bench_client_cport + 1);
+        return EXIT_FAILURE;
+    }
+
+    pthread_once(&gb_bench_init_once, gb_bench_init);
+    if (gb_bench_init_status)
+        return EXIT_FAILURE;
+
+    if (csv) {
+        printf("; generated by gbbench\n");
+        printf("; type, size, concurrency, count, errors, messages per second, bytes per second, latency in us (min, avg, p50, p90, p99, p99.9, max)\n");
+    } else {
+        printf(" TYPE   SIZE  JOBS   COUNT    ERR     MSG/S     BYTES/S    MIN    AVG    P50    P90    P99   P99.9    MAX\n");
+    }
+
+    for (t = 0; t < type_count; t++) {
+        for (s = 0; s < size_count; s++) {
+            /* the size doesn't apply to pings, run them once */
+            if (!types[t]->has_payload && s > 0)
+                break;
+
+            for (j = 0; j < job_count; j++) {
+                run->type = types[t];
+                run->size = types[t]->has_payload ? sizes[s] : 0;
+                run->concurrency = jobs[j];
+                run->count = count;
+
+                gb_bench_execute(run);
+                gb_bench_print(run, csv);
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+
+help:
+    printf(
+        "Greybus benchmark\n\n"
+        "Usage:\n"
+        "\tgbbench [-c CPORT] [-n COUNT] [-t ping,xfer,sink,aping] "
+                  "[-s SIZE,...] "
+                  "[-j JOBS,...] [-f csv]\n\n"
+        "\tOptions:\n"
+        "\t\t-c:\tCPort pair, the even CPort is the client (default 0)\n"
+        "\t\t-n:\toperations per run (default 1000)\n"
+        "\t\t-t:\toperation types (default all)\n"
+        "\t\t-s:\tpayload sizes in bytes (default 0,64,512,2000)\n"
+        "\t\t-j:\tnumber of operations in flight (default 1,4,16)\n"
+        "\t\t-f:\tmachine readable output\n\n"
+        "\tOne run is done per type, size and concurrency. Bytes per second\n"
+        "\tcount the payload in both directions. Latencies are in\n"
+        "\tmicroseconds, percentiles are accurate to 1/16th.\n"
+        "\taping is a ping handled from the RX path when the atomic\n"
+        "\thandlers are enabled, to compare with the threaded ping.\n");
+
+    return EXIT_FAILURE;
+}
@@ -30,16 +30,38 @@
 
 #include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <nuttx/greybus/tape.h>
 
 static void show_usage(const char *appname)
 {
-    printf("%s [-r filepath] [-p filepath]\n", appname);
+    printf("%s [-r filepath] [-s] [-p filepath [-t] [-l loops]]\n", appname);
     printf("\t-r: tape greybus communication into 'filepath'\n");
     printf("\t-s: stop current taping\n");
     printf("\t-p: replay greybus tape from 'filepath'\n");
+    printf("\t-t: replay with the recorded timing instead of as fast as "
+           "possible\n");
+    printf("\t-l: replay the tape 'loops' times and report the throughput\n");
+}
+
+static void print_replay_stats(const struct gb_tape_replay_stats *stats)
+{
+    unsigned long long rate = 0;
+
+    if (stats->elapsed)
+        rate = (unsigned long long) stats->messages * 1000000 / stats->elapsed;
+
+    printf("gb_tape: %u messages (%llu bytes) in %u us: %llu msg/s\n",
+           stats->messages, (unsigned long long) stats->bytes,
+           (unsigned int) stats->elapsed, rate);
+
+    if (stats->errors)
+        printf("gb_tape: %u messages refused\n", stats->errors);
+    if (stats->dropped)
+        printf("gb_tape: %u messages were lost during the recording\n",
+               stats->dropped);
 }
 
 #ifdef CONFIG_BUILD_KERNEL
@@ -48,6 +70,10 @@ int main(int argc, FAR char *argv[])
 int gb_tape_main(int argc, char *argv[])
 #endif
 {
+    enum gb_tape_replay_mode mode = GB_TAPE_REPLAY_FAST;
+    struct gb_tape_replay_stats stats;
+    const char *replay_path = NULL;
+    unsigned int loops = 1;
     int c;
     int retval;
 
@@ -60,7 +86,7 @@ int gb_tape_main(int argc, char *argv[])
 
     gb_tape_arm_semihosting_register();
 
-    while ((c = getopt(argc, argv, "r:p:s")) != -1) {
+    while ((c = getopt(argc, argv, "r:p:stl:")) != -1) {
         switch (c) {
         case 'r':
             retval = gb_tape_communication(optarg);
@@ -79,10 +105,18 @@ int gb_tape_main(int argc, char *argv[])
             break;
 
         case 'p':
-            retval = gb_tape_replay(optarg);
-            if (retval) {
-                fprintf(stderr, "gb_tape: tape replay error: %s\n",
-                        strerror(retval));
+            replay_path = optarg;
+            break;
+
+        case 't':
+            mode = GB_TAPE_REPLAY_REALTIME;
+            break;
+
+        case 'l':
+            loops = strtoul(optarg, NULL, 10);
+            if (!loops) {
+                fprintf(stderr, "invalid loop count\n");
+                return -1;
             }
             break;
 
@@ -94,5 +128,14 @@ int gb_tape_main(int argc, char *argv[])
         }
     }
 
+    if (replay_path) {
+        retval = gb_tape_replay_ext(replay_path, mode, loops, &stats);
+        if (retval) {
+            fprintf(stderr, "gb_tape: tape replay error: %s\n",
+                    strerror(-retval));
+        }
+        print_replay_stats(&stats);
+    }
+
     return 0;
 }
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @brief Scheduler context switch benchmark
+ *
+ * Starts a number of threads at the same priority, below the one of the
+ * benchmark, so that they are all ready-to-run once the benchmark waits
+ * for them. Each thread then calls sched_yield() in a loop. Every yield
+ * moves the running thread behind the others of its priority in the
+ * ready-to-run list and switches to the next one, so the time per yield
+ * shows how the cost of a context switch grows with the number of ready
+ * threads.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nuttx/hires_tmr.h>
+
+#define SCHED_BENCH_MAX_COUNTS  8
+#define SCHED_BENCH_STACK_SIZE  2048
+
+static void *sched_bench_thread(void *arg)
+{
+    unsigned int loops = (uintptr_t) arg;
+
+    while (loops--) {
+        sched_yield();
+    }
+
+    return NULL;
+}
+
+/* Returns the time per yield in ns, or 0 if the threads couldn't be run */
+
+static uint32_t sched_bench_run(unsigned int nthreads, unsigned int loops)
+{
+    struct sched_param param;
+    pthread_attr_t attr;
+    pthread_t *threads;
+    unsigned int created;
+    uint32_t start, elapsed;
+    int ret = 0;
+
+    threads = malloc(nthreads * sizeof(*threads));
+    if (!threads)
+        return 0;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, SCHED_BENCH_STACK_SIZE);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    sched_getparam(0, &param);
+    param.sched_priority--;
+    pthread_attr_setschedparam(&attr, &param);
+
+    /* The threads are below our priority: none runs until we wait */
+    for (created = 0; created < nthreads; created++) {
+        ret = pthread_create(&threads[created], &attr, sched_bench_thread,
+                             (void *) (uintptr_t) loops);
+        if (ret) {
+            fprintf(stderr, "cannot create thread %u: %d\n", created, ret);
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    start = hrt_getusec();
+    while (created) {
+        pthread_join(threads[--created], NULL);
+    }
+    elapsed = hrt_getusec() - start;
+
+    free(threads);
+
+    if (ret)
+        return 0;
+
+    return (uint64_t) elapsed * 1000 / ((uint64_t) nthreads * loops);
+}
+
+static int parse_list(char *str, unsigned int *values, int max)
+{
+    char *token, *saveptr;
+    int count = 0;
+
+    for (token = strtok_r(str, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr)) {
+        if (count == max || sscanf(token, "%u", &values[count]) != 1 ||
+            !values[count])
+            return -EINVAL;
+        count++;
+    }
+
+    return count;
+}
+
+#ifdef CONFIG_BUILD_KERNEL
+int main(int argc, FAR char *argv[])
+#else
+int schedbench_main(int argc, char *argv[])
+#endif
+{
+    unsigned int counts[SCHED_BENCH_MAX_COUNTS] = {
+        10, 50, 200,
+    };
+    int nb_counts = 3;
+    unsigned int loops = 1000;
+    uint32_t ns;
+    int opt, c;
+
+    optind = -1;
+    while ((opt = getopt(argc, argv, "n:t:")) != -1) {
+        switch (opt) {
+        case 'n':
+            if (sscanf(optarg, "%u", &loops) != 1 || !loops)
+                goto help;
+            break;
+        case 't':
+            nb_counts = parse_list(optarg, counts, SCHED_BENCH_MAX_COUNTS);
+            if (nb_counts <= 0)
+                goto help;
+            break;
+        default:
+            goto help;
+        }
+    }
+
+#ifdef CONFIG_SCHED_RTR_BITMAP
+    printf("ready-to-run list with priority bitmap, %u yields per thread\n",
+           loops);
+#else
+    printf("ready-to-run list, %u yields per thread\n", loops);
+#endif
+    printf("THREADS  NS/SWITCH\n");
+
+    for (c = 0; c < nb_counts; c++) {
+        ns = sched_bench_run(counts[c], loops);
+        if (!ns) {
+            printf("%7u     failed\n", counts[c]);
+            continue;
+        }
+
+        printf("%7u %10u\n", counts[c], ns);
+    }
+
+    return EXIT_SUCCESS;
+
+help:
+    fprintf(stderr, "usage: schedbench [-n count] [-t threads,...]\n");
+    fprintf(stderr, "  -n: yields per thread (default 1000)\n");
+    fprintf(stderr, "  -t: numbers of threads, up to %d (default 10,50,200)\n",
+            SCHED_BENCH_MAX_COUNTS);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @brief Semaphore benchmark
+ *
+ * Measures an uncontended sem_wait()/sem_post() pair on a semaphore of
+ * which other threads already hold counts, the way a heap or inode lock
+ * looks when several tasks use it. With priority inheritance, each pair
+ * looks up and updates the holder of the calling task, and the time per
+ * pair shows how that scales with the number of holders. The same run is
+ * made on a SEM_PRIO_NONE semaphore, which skips the holder tracking.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nuttx/hires_tmr.h>
+
+#define SEM_BENCH_MAX_HOLDERS   8
+#define SEM_BENCH_ITERATIONS    10000
+
+struct sem_bench_holders {
+    sem_t sem;
+    sem_t ready;
+    sem_t done;
+};
+
+static void *sem_bench_holder(void *data)
+{
+    struct sem_bench_holders *h = data;
+
+    sem_wait(&h->sem);
+    sem_post(&h->ready);
+    sem_wait(&h->done);
+    sem_post(&h->sem);
+
+    return NULL;
+}
+
+static int sem_bench_run(unsigned int holders, int protocol,
+                         unsigned int iterations, uint32_t *ns)
+{
+    struct sem_bench_holders h;
+    pthread_t threads[SEM_BENCH_MAX_HOLDERS];
+    unsigned int nthreads;
+    uint32_t start;
+    unsigned int i;
+    int retval = 0;
+
+    sem_init(&h.sem, 0, holders + 1);
+    sem_init(&h.ready, 0, 0);
+    sem_init(&h.done, 0, 0);
+    sem_setprotocol(&h.ready, SEM_PRIO_NONE);
+    sem_setprotocol(&h.done, SEM_PRIO_NONE);
+
+    if (sem_setprotocol(&h.sem, protocol)) {
+        retval = -errno;
+        goto out;
+    }
+
+    for (nthreads = 0; nthreads < holders; nthreads++) {
+        retval = -pthread_create(&threads[nthreads], NULL, sem_bench_holder,
+                                 &h);
+        if (retval)
+            goto out_threads;
+    }
+
+    for (i = 0; i < holders; i++) {
+        sem_wait(&h.ready);
+    }
+
+    start = hrt_getusec();
+    for (i = 0; i < iterations; i++) {
+        sem_wait(&h.sem);
+        sem_post(&h.sem);
+    }
+    *ns = (uint64_t) (hrt_getusec() - start) * 1000 / iterations;
+
+out_threads:
+    for (i = 0; i < nthreads; i++) {
+        sem_post(&h.done);
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+out:
+    sem_destroy(&h.done);
+    sem_destroy(&h.ready);
+    sem_destroy(&h.sem);
+    return retval;
+}
+
+static int parse_list(char *str, unsigned int *values, int max)
+{
+    char *token, *saveptr;
+    int count = 0;
+
+    for (token = strtok_r(str, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr)) {
+        if (count == max || sscanf(token, "%u", &values[count]) != 1 ||
+            values[count] > SEM_BENCH_MAX_HOLDERS)
+            return -EINVAL;
+        count++;
+    }
+
+    return count;
+}
+
+#ifdef CONFIG_BUILD_KERNEL
+int main(int argc, FAR char *argv[])
+#else
+int sembench_main(int argc, char *argv[])
+#endif
+{
+    unsigned int holders[SEM_BENCH_MAX_HOLDERS + 1] = {
+        0, 1, 4, 8,
+    };
+    unsigned int iterations = SEM_BENCH_ITERATIONS;
+    uint32_t inherit_ns, none_ns;
+    int nb_holders = 4;
+    int opt, c;
+
+    optind = -1;
+    while ((opt = getopt(argc, argv, "h:i:")) != -1) {
+        switch (opt) {
+        case 'h':
+            nb_holders = parse_list(optarg, holders,
+                                    SEM_BENCH_MAX_HOLDERS + 1);
+            if (nb_holders <= 0)
+                goto help;
+            break;
+        case 'i':
+            iterations = strtoul(optarg, NULL, 0);
+            if (!iterations)
+                goto help;
+            break;
+        default:
+            goto help;
+        }
+    }
+
+#ifdef CONFIG_PRIORITY_INHERITANCE
+    printf("priority inheritance, %d pre-allocated holders\n",
+           CONFIG_SEM_PREALLOCHOLDERS);
+#else
+    printf("no priority inheritance\n");
+#endif
+    printf("HOLDERS  INHERIT(ns)  NONE(ns)\n");
+
+    for (c = 0; c < nb_holders; c++) {
+        if (sem_bench_run(holders[c], SEM_PRIO_INHERIT, iterations,
+                          &inherit_ns))
+            inherit_ns = 0;
+        if (sem_bench_run(holders[c], SEM_PRIO_NONE, iterations, &none_ns)) {
+            printf("%7u       failed\n", holders[c]);
+            continue;
+        }
+
+        printf("%7u  %11u  %8u\n", holders[c], inherit_ns, none_ns);
+    }
+
+    return EXIT_SUCCESS;
+
+help:
+    fprintf(stderr, "usage: sembench [-h holders,...] [-i iterations]\n");
+    fprintf(stderr,
+            "  -h: numbers of other holders, up to %d (default 0,1,4,8)\n",
+            SEM_BENCH_MAX_HOLDERS);
+    fprintf(stderr, "  -i: wait/post pairs per run (default %d)\n",
+            SEM_BENCH_ITERATIONS);
+    return EXIT_FAILURE;
+}
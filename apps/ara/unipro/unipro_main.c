@@ -98,6 +98,26 @@ static int attr_read(int argc, char **argv) {
     return rc;
 }
 
+static int dma_stats(void) {
+    struct unipro_tx_channel_stats stats;
+    unsigned int i;
+
+    printf("chan          ops          bytes   busy (us)   KiB/s busy\n");
+    for (i = 0; unipro_tx_get_channel_stats(i, &stats) == 0; i++) {
+        printf("%4u %12u %14llu %11llu %12llu\n", i, stats.ops,
+               stats.bytes, stats.busy_time,
+               stats.busy_time ?
+                    stats.bytes * 1000000 / 1024 / stats.busy_time : 0);
+    }
+
+    if (!i) {
+        printf("No UniPro TX DMA channel\n");
+        return -1;
+    }
+
+    return 0;
+}
+
 static void print_usage(char **argv) {
     printf("Usage: %s -r attr | -w attr [-s <selector] [-p]\n", argv[0]);
     printf("\tOptions:\n");
@@ -146,6 +166,8 @@ int unipro_main(int argc, char **argv) {
     } else if (!strcmp(op, "info")) {
         unipro_info();
         return 0;
+    } else if (!strcmp(op, "dma")) {
+        return dma_stats();
     } else if (!strcmp(op, "tx")) {
         attr_read_argv[0] = (char*) xstr(TSB_DEBUGTXBYTECOUNT);
         attr_read_argv[1] = (char*) "0";
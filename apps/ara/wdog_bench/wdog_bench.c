@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @brief Watchdog timer benchmark
+ *
+ * Starts thousands of watchdogs with long random delays, so that none
+ * expires during the run, then re-arms each of them the way Greybus does
+ * on every operation and finally cancels them. The time per call of each
+ * phase shows how wd_start() and wd_cancel() scale with the number of
+ * active watchdogs.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nuttx/hires_tmr.h>
+#include <nuttx/wdog.h>
+
+#define WDOG_BENCH_MAX_COUNTS   8
+#define WDOG_BENCH_MIN_DELAY    10000
+#define WDOG_BENCH_DELAY_RANGE  10000
+
+struct wdog_bench_result {
+    uint32_t start_ns;
+    uint32_t rearm_ns;
+    uint32_t cancel_ns;
+};
+
+static void wdog_bench_expired(int argc, uint32_t arg, ...)
+{
+}
+
+static uint32_t wdog_bench_start_all(struct wdog_s *wdogs, unsigned int count)
+{
+    uint32_t start;
+    unsigned int i;
+
+    start = hrt_getusec();
+    for (i = 0; i < count; i++) {
+        wd_start(&wdogs[i],
+                 WDOG_BENCH_MIN_DELAY + rand() % WDOG_BENCH_DELAY_RANGE,
+                 wdog_bench_expired, 1, i);
+    }
+
+    return (uint64_t) (hrt_getusec() - start) * 1000 / count;
+}
+
+static int wdog_bench_run(unsigned int count, struct wdog_bench_result *res)
+{
+    struct wdog_s *wdogs;
+    uint32_t start;
+    unsigned int i;
+
+    wdogs = malloc(count * sizeof(*wdogs));
+    if (!wdogs)
+        return -ENOMEM;
+
+    for (i = 0; i < count; i++) {
+        wd_static(&wdogs[i]);
+    }
+
+    res->start_ns = wdog_bench_start_all(wdogs, count);
+
+    /* wd_start() on an active watchdog cancels it first */
+    res->rearm_ns = wdog_bench_start_all(wdogs, count);
+
+    start = hrt_getusec();
+    for (i = 0; i < count; i++) {
+        wd_cancel(&wdogs[i]);
+    }
+    res->cancel_ns = (uint64_t) (hrt_getusec() - start) * 1000 / count;
+
+    free(wdogs);
+    return 0;
+}
+
+static int parse_list(char *str, unsigned int *values, int max)
+{
+    char *token, *saveptr;
+    int count = 0;
+
+    for (token = strtok_r(str, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr)) {
+        if (count == max || sscanf(token, "%u", &values[count]) != 1 ||
+            !values[count])
+            return -EINVAL;
+        count++;
+    }
+
+    return count;
+}
+
+#ifdef CONFIG_BUILD_KERNEL
+int main(int argc, FAR char *argv[])
+#else
+int wdogbench_main(int argc, char *argv[])
+#endif
+{
+    unsigned int counts[WDOG_BENCH_MAX_COUNTS] = {
+        1000, 2000, 4000,
+    };
+    struct wdog_bench_result res;
+    int nb_counts = 3;
+    int opt, c;
+
+    optind = -1;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+        case 't':
+            nb_counts = parse_list(optarg, counts, WDOG_BENCH_MAX_COUNTS);
+            if (nb_counts <= 0)
+                goto help;
+            break;
+        default:
+            goto help;
+        }
+    }
+
+#ifdef CONFIG_WDOG_TIMER_WHEEL
+    printf("watchdog timer wheel, %d slots\n", CONFIG_WDOG_WHEEL_SIZE);
+#else
+    printf("watchdog delta list\n");
+#endif
+    printf("WATCHDOGS  START(ns)  REARM(ns)  CANCEL(ns)\n");
+
+    for (c = 0; c < nb_counts; c++) {
+        if (wdog_bench_run(counts[c], &res)) {
+            printf("%9u     failed\n", counts[c]);
+            continue;
+        }
+
+        printf("%9u %10u %10u %11u\n", counts[c], res.start_ns,
+               res.rearm_ns, res.cancel_ns);
+    }
+
+    return EXIT_SUCCESS;
+
+help:
+    fprintf(stderr, "usage: wdogbench [-t watchdogs,...]\n");
+    fprintf(stderr,
+            "  -t: numbers of watchdogs, up to %d (default 1000,2000,4000)\n",
+            WDOG_BENCH_MAX_COUNTS);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,160 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2015 Google Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+# 3. Neither the name of the copyright holder nor the names of its
+# contributors may be used to endorse or promote products derived from this
+# software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+# THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+# OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+# OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# @brief   Decode Greybus operation traces read from /dev/gbtrace
+#
+# usage: ./gb-trace.py [-h] [-v] [-c CPORT] TRACEFILE
+#
+# Get the trace from the bridge with, e.g.:
+#   nsh> cat /dev/gbtrace > /mnt/trace.bin
+#
+# Events of the same operation (same CPort, ID and type) are grouped and the
+# time spent between two consecutive steps is reported per transition, with
+# percentiles. Use '-v' to also print the timeline of every operation.
+#
+
+from __future__ import print_function
+
+import argparse
+import struct
+import sys
+
+ENTRY = struct.Struct('<IHHHBB')
+
+EVENTS = {
+    1: 'rx',
+    2: 'rx_queued',
+    3: 'dequeued',
+    4: 'handler_start',
+    5: 'handler_end',
+    6: 'tx',
+    7: 'tx_done',
+    0xff: 'dropped',
+}
+
+GB_TYPE_RESPONSE_FLAG = 0x80
+
+
+def read_entries(f):
+    while True:
+        data = f.read(ENTRY.size)
+        if len(data) < ENTRY.size:
+            return
+        yield ENTRY.unpack(data)
+
+
+def percentile(values, ratio):
+    index = int(round(ratio * (len(values) - 1)))
+    return values[index]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Greybus trace decoder')
+    parser.add_argument('trace', help='binary trace read from /dev/gbtrace')
+    parser.add_argument('-c', '--cport', type=int,
+                        help='only consider this CPort')
+    parser.add_argument('-v', '--verbose', action='store_true',
+                        help='print the timeline of every operation')
+    args = parser.parse_args()
+
+    ops = {}
+    done = []
+    dropped = 0
+
+    with open(args.trace, 'rb') as f:
+        for ts, cport, opid, size, optype, event in read_entries(f):
+            if event == 0xff:
+                dropped += (opid << 16) | size
+                # an operation may have lost some of its events
+                done.extend(ops.values())
+                ops = {}
+                continue
+
+            if args.cport is not None and cport != args.cport:
+                continue
+
+            key = (cport, opid, optype & ~GB_TYPE_RESPONSE_FLAG)
+            op = ops.get(key)
+
+            # a new reception starts a new operation (IDs get reused)
+            if op is not None and event == 1 and op['events'][-1][1] != 6 \
+               and op['events'][-1][1] != 7:
+                done.append(op)
+                op = None
+
+            if op is None:
+                op = {'key': key, 'events': []}
+                ops[key] = op
+
+            op['events'].append((ts, event, optype, size))
+
+            # an operation ends once its response is sent or handled, and
+            # unidirectional ones with their handler
+            is_response = optype & GB_TYPE_RESPONSE_FLAG
+            if (is_response and event == 7) or \
+               (is_response and event == 5) or (opid == 0 and event == 5):
+                done.append(ops.pop(key))
+
+    done.extend(ops.values())
+
+    transitions = {}
+    for op in done:
+        events = op['events']
+        if args.verbose:
+            cport, opid, optype = op['key']
+            print('cport %u id %u type 0x%02x:' % (cport, opid, optype))
+            for ts, event, t, size in events:
+                print('  %10u %+8d %-14s type 0x%02x size %u' %
+                      (ts, (ts - events[0][0]) & 0xffffffff,
+                       EVENTS.get(event, event), t, size))
+
+        for prev, cur in zip(events, events[1:]):
+            name = '%s -> %s' % (EVENTS.get(prev[1], prev[1]),
+                                 EVENTS.get(cur[1], cur[1]))
+            if prev[2] & GB_TYPE_RESPONSE_FLAG != cur[2] & GB_TYPE_RESPONSE_FLAG:
+                name += ' (response)'
+            transitions.setdefault(name, []).append(
+                (cur[0] - prev[0]) & 0xffffffff)
+
+    if dropped:
+        print('warning: %u events were dropped' % dropped, file=sys.stderr)
+
+    print('%-40s %8s %8s %8s %8s %8s %8s' %
+          ('transition (us)', 'count', 'min', 'p50', 'p90', 'p99', 'max'))
+    for name in sorted(transitions):
+        values = sorted(transitions[name])
+        print('%-40s %8u %8u %8u %8u %8u %8u' %
+              (name, len(values), values[0], percentile(values, 0.5),
+               percentile(values, 0.9), percentile(values, 0.99),
+               values[-1]))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
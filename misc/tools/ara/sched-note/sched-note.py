@@ -0,0 +1,210 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2015 Google Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+# 3. Neither the name of the copyright holder nor the names of its
+# contributors may be used to endorse or promote products derived from this
+# software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+# THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+# OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+# OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# @brief   Convert scheduler notes read from /dev/schednote to a Chrome trace
+#
+# usage: ./sched-note.py [-h] [-p PS] [-o OUTPUT] NOTEFILE
+#
+# Get the notes from the bridge with, e.g.:
+#   nsh> cat /dev/schednote > /mnt/notes.bin
+#
+# The JSON output can be opened with chrome://tracing or ui.perfetto.dev. Each
+# task gets a track showing when it runs, its semaphore waits and priority
+# inheritance changes, and interrupt handlers get a track of their own. Task
+# names come from the notes of the tasks started while recording; use '-p' to
+# give the output of the nsh 'ps' command for the others.
+#
+
+from __future__ import print_function
+
+import argparse
+import json
+import struct
+import sys
+
+NOTE = struct.Struct('<IHBBI')
+
+NOTE_START = 1
+NOTE_NAME = 2
+NOTE_STOP = 3
+NOTE_SWITCH = 4
+NOTE_IRQ_ENTER = 5
+NOTE_IRQ_LEAVE = 6
+NOTE_SEM_BLOCK = 7
+NOTE_SEM_UNBLOCK = 8
+NOTE_PRIORITY = 9
+NOTE_DROPPED = 0xff
+
+PID = 1             # single process holding every track
+IRQ_TID = 0x10000   # track of the interrupt handlers, above any task ID
+
+
+def read_notes(f):
+    while True:
+        data = f.read(NOTE.size)
+        if len(data) < NOTE.size:
+            return
+        yield NOTE.unpack(data)
+
+
+def read_ps(f):
+    names = {}
+    for line in f:
+        fields = line.split()
+        if len(fields) >= 2 and fields[0].isdigit():
+            names[int(fields[0])] = fields[-1]
+    return names
+
+
+class Converter(object):
+    def __init__(self, names):
+        self.names = dict(names)
+        self.events = []
+        self.running = None     # (pid, start) of the running task
+        self.irqs = {}          # irq -> entry time
+        self.last = None
+        self.base = 0
+        self.dropped = 0
+
+    def timestamp(self, ts):
+        # unwrap the 32-bit microsecond timer
+        if self.last is not None and ts < self.last:
+            self.base += 1 << 32
+        self.last = ts
+        return self.base + ts
+
+    def add(self, ph, ts, tid, name, **kw):
+        event = {'ph': ph, 'ts': ts, 'pid': PID, 'tid': tid, 'name': name}
+        event.update(kw)
+        self.events.append(event)
+
+    def run(self, pid, ts):
+        if self.running is not None:
+            prev, start = self.running
+            self.add('X', start, prev, 'running', dur=ts - start)
+        self.running = (pid, ts) if pid is not None else None
+
+    def note(self, ts, pid, priority, ntype, arg):
+        if ntype == NOTE_DROPPED:
+            self.dropped += arg
+            # what was in progress can't be trusted anymore
+            self.running = None
+            self.irqs = {}
+            return
+
+        ts = self.timestamp(ts)
+
+        if ntype == NOTE_START:
+            self.names[pid] = ''
+            self.add('i', ts, pid, 'start', s='t', args={'priority': priority})
+        elif ntype == NOTE_NAME:
+            chunk = struct.pack('<I', arg).rstrip(b'\0').decode('ascii',
+                                                                 'replace')
+            name = self.names.get(pid, '')
+            self.names[pid] = name[:priority * 4] + chunk
+        elif ntype == NOTE_STOP:
+            if self.running is not None and self.running[0] == pid:
+                self.run(None, ts)
+            self.add('i', ts, pid, 'stop', s='t')
+        elif ntype == NOTE_SWITCH:
+            if self.running is None or self.running[0] != arg:
+                # first switch seen, or after dropped notes
+                self.running = None
+            self.run(pid, ts)
+        elif ntype == NOTE_IRQ_ENTER:
+            self.irqs[arg] = ts
+        elif ntype == NOTE_IRQ_LEAVE:
+            start = self.irqs.pop(arg, None)
+            if start is not None:
+                self.add('X', start, IRQ_TID, 'irq %u' % arg,
+                         dur=ts - start, args={'task': pid})
+        elif ntype == NOTE_SEM_BLOCK:
+            self.add('i', ts, pid, 'sem_block', s='t',
+                     args={'sem': '0x%08x' % arg})
+        elif ntype == NOTE_SEM_UNBLOCK:
+            self.add('i', ts, pid, 'sem_unblock', s='t',
+                     args={'sem': '0x%08x' % arg})
+        elif ntype == NOTE_PRIORITY:
+            self.add('C', ts, pid, 'priority %u' % pid,
+                     args={'priority': priority})
+            self.add('i', ts, pid, 'priority_inheritance', s='t',
+                     args={'from': arg, 'to': priority})
+
+    def finish(self):
+        if self.running is not None and self.last is not None:
+            self.run(None, self.base + self.last)
+
+        tids = set(e['tid'] for e in self.events)
+        for tid in sorted(tids):
+            if tid == IRQ_TID:
+                name = 'interrupts'
+            else:
+                name = '%s (%u)' % (self.names.get(tid) or 'pid', tid)
+            self.events.append({'ph': 'M', 'pid': PID, 'tid': tid,
+                                'name': 'thread_name',
+                                'args': {'name': name}})
+        self.events.append({'ph': 'M', 'pid': PID, 'name': 'process_name',
+                            'args': {'name': 'bridge'}})
+        return {'traceEvents': self.events, 'displayTimeUnit': 'ns'}
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Scheduler notes to Chrome trace converter')
+    parser.add_argument('notes', help='binary notes read from /dev/schednote')
+    parser.add_argument('-p', '--ps',
+                        help='output of the nsh ps command, for task names')
+    parser.add_argument('-o', '--output', help='JSON file (default: stdout)')
+    args = parser.parse_args()
+
+    names = {}
+    if args.ps:
+        with open(args.ps) as f:
+            names = read_ps(f)
+
+    conv = Converter(names)
+    with open(args.notes, 'rb') as f:
+        for note in read_notes(f):
+            conv.note(*note)
+
+    if conv.dropped:
+        print('warning: %u notes were dropped' % conv.dropped,
+              file=sys.stderr)
+
+    trace = conv.finish()
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
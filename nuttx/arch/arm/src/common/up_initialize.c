@@ -70,6 +70,7 @@
 
 #include <nuttx/arch.h>
 #include <nuttx/fs/fs.h>
+#include <nuttx/sched_note.h>
 #include <nuttx/syslog/ramlog.h>
 
 #include <arch/board/board.h>
@@ -233,6 +234,10 @@ void up_initialize(void)
   devzero_register();   /* Standard /dev/zero */
 #endif
 
+#if defined(CONFIG_SCHED_NOTE_BUFFER)
+  sched_note_register(); /* Scheduler notes */
+#endif
+
 #endif /* CONFIG_NFILE_DESCRIPTORS */
 
   /* Initialize the serial device driver */
@@ -525,12 +525,20 @@ static inline void gdmac_release_event(unsigned int event_id)
     }
 }
 
+/*
+ * The debug registers are shared by all the channels, and ops are started
+ * both from threads and from the interrupt handler, so each instruction is
+ * written and issued with interrupts disabled.
+ */
 static inline void dma_execute_instruction(uint8_t* insn)
 {
     struct tsb_dma_gdmac_dbg_regs *dbg_regs =
             (struct tsb_dma_gdmac_dbg_regs*) GDMAC_DBG_REGS_ADDRESS;
+    irqstate_t flags;
     uint32_t value;
 
+    flags = irqsave();
+
     value = (insn[0] << 16) | (insn[1] << 24);
     putreg32(value, &dbg_regs->dbg_inst_0);
 
@@ -539,6 +547,8 @@ static inline void dma_execute_instruction(uint8_t* insn)
 
     /* Get going */
     putreg32(0, &dbg_regs->dbg_cmd);
+
+    irqrestore(flags);
 }
 
 static bool inline dma_start_thread(uint8_t thread_id, uint8_t* program_addr)
@@ -1578,6 +1588,7 @@ int gdmac_irq_abort_handler(int irq, void *context)
     uint32_t fsrc = getreg32(&control_regs->fsrc);
     uint32_t chan, index;
     uint32_t value;
+    irqstate_t flags;
 
     if (fsrc == 0) {
         lldbg("Unexpected FSRC value %x\n", fsrc);
@@ -1586,12 +1597,17 @@ int gdmac_irq_abort_handler(int irq, void *context)
 
     chan = gsmac_bit_to_pos(fsrc) & 0x07;
 
+    /* Same as dma_execute_instruction(), DMAKILL has no operand */
+    flags = irqsave();
+
     value = (DMAKILL << 16) | chan << 7 | 0x01;
     putreg32(value, &dbg_regs->dbg_inst_0);
 
     /* Get going */
     putreg32(0, &dbg_regs->dbg_cmd);
 
+    irqrestore(flags);
+
     for (index = 0; index < GDMAC_NUMBER_OF_EVENTS; index++) {
         struct gdmac_chan *gdmac_chan;
 
@@ -1599,7 +1615,7 @@ int gdmac_irq_abort_handler(int irq, void *context)
         if ((gdmac_chan != NULL) &&
             (gdmac_chan->tsb_chan.chan_id == chan)) {
             tsb_dma_callback(gdmac_chan->gdmac_dev, &gdmac_chan->tsb_chan,
-                    DEVICE_DMA_ERROR_DMA_FAILED);
+                    DEVICE_DMA_CALLBACK_EVENT_ERROR);
 
             break;
         }
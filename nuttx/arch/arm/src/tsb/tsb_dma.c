@@ -37,6 +37,7 @@
 #include <nuttx/arch.h>
 #include <nuttx/device.h>
 #include <nuttx/device_dma.h>
+#include <nuttx/hires_tmr.h>
 #include <nuttx/list.h>
 
 #include "debug.h"
@@ -62,6 +63,7 @@ struct tsb_dma_op {
     enum tsb_dma_op_state state;
     enum device_dma_error error;
     unsigned int events;
+    uint32_t complete_time;
     struct device_dma_op op;
 };
 
@@ -73,6 +75,7 @@ struct tsb_dma_info {
 
     struct list_head completed_queue;
     sem_t op_completed_sem;
+    bool wakeup_pending;
     pthread_t irq_thread;
     bool driver_closed;
 
@@ -82,6 +85,7 @@ struct tsb_dma_info {
 static int tsb_dma_restart_chan(struct device *dev,
         struct tsb_dma_chan *dma_chan)
 {
+    struct tsb_dma_info *dma_info = device_get_private(dev);
     struct list_head *next_op = NULL;
     irqstate_t flags;
     int retval = OK;
@@ -98,24 +102,33 @@ static int tsb_dma_restart_chan(struct device *dev,
         if (dma_op->state == TSB_DMA_OP_STATE_QUEUED) {
             dma_op->state = TSB_DMA_OP_STATE_STARTING;
 
-            irqrestore(flags);
-
+            /*
+             * Interrupts stay disabled while the op is started: the
+             * interrupt handler also starts chained ops, and both go
+             * through the debug registers of the controller.
+             */
             retval = gdmac_start_op(dev, dma_chan, &dma_op->op, &dma_op->error);
-
-            flags = irqsave();
-
             if (retval == OK) {
-                /* there is a chance the op already completed when we get to
-                 * here. If that is the case we don't need to set the op state
-                 * to running because it might already set to completed state.
-                 */
-                if (dma_op->state == TSB_DMA_OP_STATE_STARTING) {
-                    dma_op->state = TSB_DMA_OP_STATE_RUNNING;
-                }
+                dma_op->state = TSB_DMA_OP_STATE_RUNNING;
             } else {
+                /*
+                 * Complete the op with an error through the completion
+                 * thread, so that its client is told and can queue it
+                 * again once it is off the channel queue.
+                 */
                 lldbg("failed to start op.\n");
                 dma_op->error = DEVICE_DMA_ERROR_DMA_FAILED;
-                dma_op->state = TSB_DMA_OP_STATE_ERROR;
+                dma_op->events = DEVICE_DMA_CALLBACK_EVENT_ERROR;
+                dma_op->complete_time = hrt_getusec();
+                dma_op->state = TSB_DMA_OP_STATE_COMPLETING;
+
+                list_del(&dma_op->list_node);
+                list_add(&dma_info->completed_queue, &dma_op->list_node);
+
+                if (!dma_info->wakeup_pending) {
+                    dma_info->wakeup_pending = true;
+                    sem_post(&dma_info->op_completed_sem);
+                }
             }
         }
         break;
@@ -128,47 +141,109 @@ static int tsb_dma_restart_chan(struct device *dev,
     return retval;
 }
 
+static void tsb_dma_update_latency(struct tsb_dma_chan *dma_chan,
+        uint32_t latency)
+{
+    struct device_dma_chan_stats *stats = &dma_chan->stats;
+    unsigned int bucket = 0;
+
+    while (bucket < DEVICE_DMA_LATENCY_BUCKETS - 1 &&
+           latency >= (1U << bucket)) {
+        bucket++;
+    }
+
+    stats->latency[bucket]++;
+    if (latency > stats->max_latency) {
+        stats->max_latency = latency;
+    }
+}
+
+static void tsb_dma_deliver_op(struct device *dev, struct tsb_dma_op *dma_op)
+{
+    struct tsb_dma_info *dma_info = device_get_private(dev);
+    struct tsb_dma_chan *dma_chan = dma_info->chans[dma_op->chan_id];
+    uint32_t callback_events = dma_op->op.callback_events;
+
+    if (dma_op->events & DEVICE_DMA_CALLBACK_EVENT_ERROR) {
+        dma_op->state = TSB_DMA_OP_STATE_ERROR;
+        dma_chan->stats.errors++;
+    } else {
+        dma_op->state = TSB_DMA_OP_STATE_COMPLETED;
+    }
+
+    dma_chan->stats.completions++;
+    dma_chan->batch++;
+    tsb_dma_update_latency(dma_chan, hrt_getusec() - dma_op->complete_time);
+
+    if (dma_op->op.callback == NULL) {
+        lldbg("Invalid callback\n");
+        return;
+    }
+
+    if ((callback_events & DEVICE_DMA_CALLBACK_EVENT_COMPLETE) &&
+        (dma_op->state == TSB_DMA_OP_STATE_COMPLETED)) {
+        dma_op->op.callback(dev, dma_chan, &dma_op->op,
+                DEVICE_DMA_CALLBACK_EVENT_COMPLETE, dma_op->op.callback_arg);
+    }
+
+    if ((callback_events & DEVICE_DMA_CALLBACK_EVENT_ERROR) &&
+        (dma_op->state == TSB_DMA_OP_STATE_ERROR)) {
+        dma_op->op.callback(dev, dma_chan, &dma_op->op,
+                DEVICE_DMA_CALLBACK_EVENT_ERROR, dma_op->op.callback_arg);
+    }
+}
+
 static void *tsb_dma_process_completed_op(void *arg)
 {
     struct device *dev = arg;
     struct tsb_dma_info *dma_info = device_get_private(dev);
 
     while (dma_info->driver_closed == 0) {
-        struct list_head *node, *next_node;
+        struct list_head *node;
+        irqstate_t flags;
+        unsigned int chan;
 
         sem_wait(&dma_info->op_completed_sem);
 
-        list_foreach_safe(&dma_info->completed_queue, node, next_node) {
-            struct tsb_dma_op* dma_op;
-            int chan_id;
+        flags = irqsave();
+        dma_info->wakeup_pending = false;
+        irqrestore(flags);
 
+        /*
+         * Deliver every op that has completed, including the ones that
+         * complete while the callbacks run, before going back to sleep.
+         */
+        while (1) {
+            struct tsb_dma_op *dma_op;
+
+            flags = irqsave();
+            if (list_is_empty(&dma_info->completed_queue)) {
+                irqrestore(flags);
+                break;
+            }
+
+            node = dma_info->completed_queue.next;
             list_del(node);
+            irqrestore(flags);
+
             dma_op = list_entry(node, struct tsb_dma_op, list_node);
-            chan_id = dma_op->chan_id;
 
-            if (dma_op->op.callback == NULL) {
-                lldbg("Invalid callback\n");
-            } else {
-                uint32_t callback_events = dma_op->op.callback_events;
-
-                if ((callback_events & DEVICE_DMA_CALLBACK_EVENT_COMPLETE) &&
-                    (dma_op->state = TSB_DMA_OP_STATE_COMPLETED)) {
-                    dma_op->op.callback(dev, &dma_info->chans[chan_id],
-                            (void *) &dma_op->op,
-                            DEVICE_DMA_CALLBACK_EVENT_COMPLETE,
-                            dma_op->op.callback_arg);
-                }
+            tsb_dma_deliver_op(dev, dma_op);
+            tsb_dma_restart_chan(dev, dma_info->chans[dma_op->chan_id]);
+        }
 
-                if ((callback_events & DEVICE_DMA_CALLBACK_EVENT_ERROR) &&
-                    (dma_op->state = TSB_DMA_OP_STATE_ERROR)) {
-                    dma_op->op.callback(dev, &dma_info->chans[chan_id],
-                            (void *) &dma_op->op,
-                            DEVICE_DMA_CALLBACK_EVENT_ERROR,
-                            dma_op->op.callback_arg);
-                }
+        for (chan = 0; chan < dma_info->max_chan; chan++) {
+            struct tsb_dma_chan *dma_chan = dma_info->chans[chan];
+
+            if (dma_chan == NULL || dma_chan->batch == 0) {
+                continue;
             }
 
-            tsb_dma_restart_chan(dev, dma_info->chans[chan_id]);
+            dma_chan->stats.wakeups++;
+            if (dma_chan->batch > dma_chan->stats.max_batch) {
+                dma_chan->stats.max_batch = dma_chan->batch;
+            }
+            dma_chan->batch = 0;
         }
     }
 
@@ -195,6 +270,7 @@ static int tsb_dma_open(struct device *dev)
     }
 
     info->driver_closed = false;
+    info->wakeup_pending = false;
 
     pthread_mutex_init(&info->lock, NULL);
     sem_init(&info->op_completed_sem, 0, 0);
@@ -565,14 +641,23 @@ static int tsb_dma_enqueue(struct device *dev, void *chan,
         return -EINVAL;
     }
 
-    retval = OK;
+    retval = -EBUSY;
 
     flags = irqsave();
 
-    /* Add the op to the queue on the channel */
-    if (dma_op->state == TSB_DMA_OP_STATE_IDLE) {
+    /*
+     * Add the op to the queue on the channel. A completed op can be queued
+     * again, so that clients can keep a set of ops instead of allocating
+     * one per transfer. Ops only reach the COMPLETED and ERROR states once
+     * delivered, after they have left both the channel and completed
+     * queues.
+     */
+    if (dma_op->state == TSB_DMA_OP_STATE_IDLE ||
+        dma_op->state == TSB_DMA_OP_STATE_COMPLETED ||
+        dma_op->state == TSB_DMA_OP_STATE_ERROR) {
         list_add(&dma_chan->queue, &dma_op->list_node);
         dma_op->state = TSB_DMA_OP_STATE_QUEUED;
+        dma_op->error = DEVICE_DMA_ERROR_NONE;
         retval = OK;
     }
 
@@ -629,33 +714,110 @@ static int tsb_dma_dequeue(struct device *dev, void *chan,
     return retval;
 }
 
+static int tsb_dma_chan_get_stats(struct device *dev, void *chan,
+        struct device_dma_chan_stats *stats)
+{
+    struct tsb_dma_chan *dma_chan = chan;
+    irqstate_t flags;
+
+    if ((dev == NULL) || (chan == NULL) || (stats == NULL)) {
+        return -EINVAL;
+    }
+
+    flags = irqsave();
+    memcpy(stats, &dma_chan->stats, sizeof(*stats));
+    irqrestore(flags);
+
+    return OK;
+}
+
+/* Op waiting to be started behind the head of the channel queue, if any */
+static struct tsb_dma_op *tsb_dma_next_queued_op(
+        struct tsb_dma_chan *dma_chan)
+{
+    struct tsb_dma_op *next_op;
+
+    if (list_is_empty(&dma_chan->queue)) {
+        return NULL;
+    }
+
+    next_op = list_entry(dma_chan->queue.next, struct tsb_dma_op, list_node);
+    if (next_op->state != TSB_DMA_OP_STATE_QUEUED) {
+        return NULL;
+    }
+
+    return next_op;
+}
+
+/*
+ * Start the op queued after a chained op from the interrupt handler, so that
+ * the completion thread doesn't have to run between the two transfers.
+ */
+static bool tsb_dma_chain_next_op(struct device *dev,
+        struct tsb_dma_chan *dma_chan, struct tsb_dma_op *next_op)
+{
+    next_op->state = TSB_DMA_OP_STATE_STARTING;
+    if (gdmac_start_op(dev, dma_chan, &next_op->op, &next_op->error) != OK) {
+        /* Leave it to the completion thread to try again */
+        next_op->state = TSB_DMA_OP_STATE_QUEUED;
+        return false;
+    }
+
+    next_op->state = TSB_DMA_OP_STATE_RUNNING;
+
+    return true;
+}
+
 int tsb_dma_callback(struct device *dev, struct tsb_dma_chan *dma_chan,
         int event)
 {
     struct tsb_dma_info *info = device_get_private(dev);
-    struct list_head *next_op;
+    struct tsb_dma_op *dma_op;
+    struct tsb_dma_op *next_op;
+    bool signal = true;
 
     /* This routine runs in the interrupt context, so there is no other
      * thread would manipulate the the op other than the user callback
      * routine which wouldn't happen until the op is removed from the
      * completed queue.
      */
-    list_foreach(&dma_chan->queue, next_op)
-    {
-        struct tsb_dma_op
-        *dma_op = list_entry(next_op, struct tsb_dma_op, list_node);
+    if (list_is_empty(&dma_chan->queue)) {
+        return OK;
+    }
 
-        /* Make sure the op is in either starting or running state. */
-        if ((dma_op->state == TSB_DMA_OP_STATE_STARTING)
-                || (dma_op->state == TSB_DMA_OP_STATE_RUNNING)) {
-            dma_op->state = TSB_DMA_OP_STATE_COMPLETING;
+    dma_op = list_entry(dma_chan->queue.next, struct tsb_dma_op, list_node);
 
-            list_del(next_op);
-            list_add(&info->completed_queue, next_op);
+    /* Make sure the op is in either starting or running state. */
+    if ((dma_op->state != TSB_DMA_OP_STATE_STARTING) &&
+        (dma_op->state != TSB_DMA_OP_STATE_RUNNING)) {
+        return OK;
+    }
 
-            sem_post(&info->op_completed_sem);
-        }
-        break;
+    dma_op->state = TSB_DMA_OP_STATE_COMPLETING;
+    dma_op->complete_time = hrt_getusec();
+
+    if (event == DEVICE_DMA_CALLBACK_EVENT_COMPLETE) {
+        dma_op->events = DEVICE_DMA_CALLBACK_EVENT_COMPLETE;
+    } else {
+        dma_op->events = DEVICE_DMA_CALLBACK_EVENT_ERROR;
+        dma_op->error = DEVICE_DMA_ERROR_DMA_FAILED;
+    }
+
+    list_del(&dma_op->list_node);
+    list_add(&info->completed_queue, &dma_op->list_node);
+
+    /*
+     * Only wake the completion thread at the end of a chain, it delivers
+     * all the ops on the completed queue at once.
+     */
+    next_op = tsb_dma_next_queued_op(dma_chan);
+    if (device_dma_op_chains(&dma_op->op, dma_op->events, next_op != NULL)) {
+        signal = !tsb_dma_chain_next_op(dev, dma_chan, next_op);
+    }
+
+    if (signal && !info->wakeup_pending) {
+        info->wakeup_pending = true;
+        sem_post(&info->op_completed_sem);
     }
 
     return OK;
@@ -671,7 +833,8 @@ static struct device_dma_type_ops tsb_dma_type_ops = {
         .op_is_complete = tsb_dma_op_is_complete,
         .op_get_error = tsb_dma_op_get_error,
         .enqueue = tsb_dma_enqueue,
-        .dequeue = tsb_dma_dequeue
+        .dequeue = tsb_dma_dequeue,
+        .chan_get_stats = tsb_dma_chan_get_stats
 };
 
 static struct device_driver_ops tsb_dma_driver_ops = {
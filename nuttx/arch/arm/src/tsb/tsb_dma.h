@@ -46,6 +46,8 @@ struct tsb_dma_chan {
     pthread_mutex_t chan_mutex;
     struct list_head queue;
     struct device_dma_params chan_params;
+    struct device_dma_chan_stats stats;
+    unsigned int batch; /* ops delivered since the last wakeup */
 };
 
 extern int gdmac_max_number_of_channels(void);
@@ -139,6 +139,11 @@ static inline void timer_snapshot(uint32_t *tick_count, uint32_t *clock_value)
 
 int up_timerisr(int irq, uint32_t *regs)
 {
+#if CONFIG_USEC_MEASURE_PERF_SAMPLES > 0
+    /* Sample the interrupted code for profiling */
+    sched_perf_sample(regs[REG_PC]);
+#endif
+
     /* Process timer interrupt */
     sched_process_timer();
 
@@ -30,6 +30,7 @@
 #define __TSB_UNIPRO_H__
 
 #include <stdbool.h>
+#include <semaphore.h>
 
 #include <arch/atomic.h>
 #include <nuttx/unipro/unipro.h>
@@ -46,6 +47,13 @@
 
 #define TRANSFER_MODE          (2)
 
+#define APBRIDGE_CPORT_MAX 44 // number of CPorts available on the APBridges
+#define GPBRIDGE_CPORT_MAX 16 // number of CPorts available on the GPBridges
+
+/* Most CPorts any bridge has, what per-CPort bitmaps are sized for */
+#define UNIPRO_CPORT_MAX          APBRIDGE_CPORT_MAX
+#define UNIPRO_CPORT_BITMAP_WORDS ((UNIPRO_CPORT_MAX + 31) / 32)
+
 struct cport {
     struct unipro_driver *driver;
     uint8_t *tx_buf;                // TX region for this CPort
@@ -61,16 +69,39 @@ struct cport {
     size_t max_inflight_buf_count;
     bool switch_buf_on_free;
 
+    /* Free RX buffers, linked through their first word */
+    void *rxbuf_pool;
+    uint16_t rxbuf_pool_count;
+    uint16_t rxbuf_pool_depth;
+    uint32_t rx_paused_at;
+    struct unipro_rx_stats rx_stats;
+
     struct list_head tx_fifo;
+
+    /* TX descriptor pool, see unipro_tx_cport_init() */
+    void *tx_descs;
+    struct list_head tx_desc_pool;
+    unsigned int tx_desc_waiters;
+    sem_t tx_desc_sem;
+
+    /* TX scheduling */
+    uint8_t tx_priority;
+    uint32_t tx_weight;
+    int32_t tx_deficit;
+    bool tx_stalled;
+    struct unipro_tx_stats tx_stats;
 };
 
 struct cport *cport_handle(unsigned int cportid);
 uint16_t unipro_get_tx_free_buffer_space(struct cport *cport);
 int unipro_tx_init(void);
+int unipro_tx_cport_init(struct cport *cport);
 int _unipro_reset_cport(unsigned int cportid);
 void unipro_reset_notify(unsigned int cportid);
 void unipro_switch_rxbuf(unsigned int cportid, void *buffer);
 int unipro_unpause_rx(unsigned int cportid);
+void unipro_rxbuf_pause(struct cport *cport);
+void unipro_rxbuf_pool_refill(struct cport *cport);
 
 #endif /* __TSB_UNIPRO_H__ */
 
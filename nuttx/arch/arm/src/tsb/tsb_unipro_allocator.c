@@ -30,12 +30,29 @@
 
 #include <stddef.h>
 #include <errno.h>
+#include <string.h>
 
 #include "tsb_unipro.h"
 
 #include <nuttx/bufram.h>
 #include <nuttx/unipro/unipro.h>
 #include <nuttx/arch.h>
+#include <nuttx/util.h>
+#include <nuttx/hires_tmr.h>
+#include <nuttx/wqueue.h>
+
+#define RXBUF_PAGE_COUNT    bufram_size_to_page_count(CPORT_BUF_SIZE)
+
+#ifdef CONFIG_TSB_UNIPRO_RXBUF_POOL_DEPTH
+/*
+ * CPorts whose pool needs a refill, or whose RX is paused, are marked in
+ * 'pending' and served by a single work item.
+ */
+static struct {
+    struct work_s work;
+    uint32_t pending[UNIPRO_CPORT_BITMAP_WORDS];
+} rxbuf_pool;
+#endif
 
 int unipro_set_max_inflight_rxbuf_count(unsigned int cportid,
                                         size_t max_inflight_buf)
@@ -48,23 +65,246 @@ int unipro_set_max_inflight_rxbuf_count(unsigned int cportid,
     return 0;
 }
 
+/**
+ * @note This function must be called with interrupts disabled
+ */
+static void unipro_rxbuf_resume(struct cport *cport)
+{
+    uint32_t paused = hrt_getusec() - cport->rx_paused_at;
+
+    cport->switch_buf_on_free = false;
+    cport->rx_stats.pause_time += paused;
+    if (paused > cport->rx_stats.pause_time_max)
+        cport->rx_stats.pause_time_max = paused;
+}
+
+static bool unipro_rxbuf_can_inflight(struct cport *cport)
+{
+    return cport->max_inflight_buf_count == INFINITE_MAX_INFLIGHT_BUFCOUNT ||
+           atomic_get(&cport->inflight_buf_count) <
+               cport->max_inflight_buf_count;
+}
+
+#ifdef CONFIG_TSB_UNIPRO_RXBUF_POOL_DEPTH
+static void unipro_rxbuf_pool_push(struct cport *cport, void *buf)
+{
+    *(void **) buf = cport->rxbuf_pool;
+    cport->rxbuf_pool = buf;
+    cport->rxbuf_pool_count++;
+}
+
+static void *unipro_rxbuf_pool_pop(struct cport *cport)
+{
+    void *buf = cport->rxbuf_pool;
+
+    if (buf) {
+        cport->rxbuf_pool = *(void **) buf;
+        cport->rxbuf_pool_count--;
+    }
+
+    return buf;
+}
+
+/**
+ * Bring the pool of a CPort back to its depth, or empty it if no driver is
+ * registered, and restart RX if it was paused for lack of a buffer.
+ */
+static void unipro_rxbuf_pool_fill(struct cport *cport)
+{
+    unsigned int depth = cport->driver ? cport->rxbuf_pool_depth : 0;
+    irqstate_t flags;
+    void *buf;
+
+    while (cport->rxbuf_pool_count < depth) {
+        buf = bufram_page_alloc(RXBUF_PAGE_COUNT);
+        if (!buf)
+            break;
+
+        flags = irqsave();
+        unipro_rxbuf_pool_push(cport, buf);
+        irqrestore(flags);
+    }
+
+    while (cport->rxbuf_pool_count > depth) {
+        flags = irqsave();
+        buf = unipro_rxbuf_pool_pop(cport);
+        irqrestore(flags);
+
+        bufram_page_free(buf, RXBUF_PAGE_COUNT);
+    }
+
+    flags = irqsave();
+
+    if (!cport->switch_buf_on_free || !unipro_rxbuf_can_inflight(cport)) {
+        irqrestore(flags);
+        return;
+    }
+
+    buf = unipro_rxbuf_pool_pop(cport);
+    if (!buf) {
+        buf = bufram_page_alloc(RXBUF_PAGE_COUNT);
+        if (!buf) {
+            /* retried when the next buffer of the CPort is freed */
+            irqrestore(flags);
+            return;
+        }
+    }
+
+    atomic_inc(&cport->inflight_buf_count);
+    unipro_rxbuf_resume(cport);
+    irqrestore(flags);
+
+    unipro_switch_rxbuf(cport->cportid, buf);
+    unipro_unpause_rx(cport->cportid);
+}
+
+static void unipro_rxbuf_pool_worker(void *arg)
+{
+    struct cport *cport;
+    irqstate_t flags;
+    uint32_t pending;
+    int word;
+    int bit;
+
+    for (word = 0; word < ARRAY_SIZE(rxbuf_pool.pending); word++) {
+        flags = irqsave();
+        pending = rxbuf_pool.pending[word];
+        rxbuf_pool.pending[word] = 0;
+        irqrestore(flags);
+
+        while (pending) {
+            bit = __builtin_ctz(pending);
+            pending &= ~(1 << bit);
+
+            cport = cport_handle(word * 32 + bit);
+            if (cport)
+                unipro_rxbuf_pool_fill(cport);
+        }
+    }
+}
+#endif
+
+/**
+ * @brief Schedule the refill of the RX buffer pool of a CPort
+ *
+ * Can be called from interrupt context.
+ */
+void unipro_rxbuf_pool_refill(struct cport *cport)
+{
+#ifdef CONFIG_TSB_UNIPRO_RXBUF_POOL_DEPTH
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    rxbuf_pool.pending[cport->cportid / 32] |= 1 << (cport->cportid % 32);
+    if (work_available(&rxbuf_pool.work))
+        work_queue(LPWORK, &rxbuf_pool.work, unipro_rxbuf_pool_worker, NULL, 0);
+
+    irqrestore(flags);
+#endif
+}
+
+/**
+ * @brief Stop receiving on a CPort until a buffer is available
+ *
+ * Called from the RX interrupt when no buffer could be given to the CPort.
+ * RX restarts when the CPort frees a buffer, or when the pool gets one.
+ */
+void unipro_rxbuf_pause(struct cport *cport)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    cport->switch_buf_on_free = true;
+    cport->rx_paused_at = hrt_getusec();
+    cport->rx_stats.pauses++;
+    irqrestore(flags);
+
+    unipro_rxbuf_pool_refill(cport);
+}
+
+/**
+ * @brief Set the number of free RX buffers kept for a CPort
+ *
+ * The pool is refilled when it drops to half of its depth.
+ *
+ * @param cportid CPort to configure
+ * @param depth number of buffers, 0 to disable the pool
+ * @return 0 on success, -EINVAL on invalid CPort, -ENOSYS without a pool
+ */
+int unipro_rxbuf_set_pool_depth(unsigned int cportid, unsigned int depth)
+{
+#ifdef CONFIG_TSB_UNIPRO_RXBUF_POOL_DEPTH
+    struct cport *cport = cport_handle(cportid);
+
+    if (!cport || depth > UINT16_MAX)
+        return -EINVAL;
+
+    cport->rxbuf_pool_depth = depth;
+    unipro_rxbuf_pool_refill(cport);
+
+    return 0;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/**
+ * @brief Get the RX statistics of a CPort
+ *
+ * @param cportid CPort to query
+ * @param stats filled with the statistics
+ * @return 0 on success, -EINVAL on invalid parameter
+ */
+int unipro_rx_get_stats(unsigned int cportid, struct unipro_rx_stats *stats)
+{
+    struct cport *cport = cport_handle(cportid);
+    irqstate_t flags;
+
+    if (!cport || !stats)
+        return -EINVAL;
+
+    flags = irqsave();
+    memcpy(stats, &cport->rx_stats, sizeof(*stats));
+    if (cport->switch_buf_on_free) {
+        stats->pause_time += hrt_getusec() - cport->rx_paused_at;
+    }
+    irqrestore(flags);
+
+    return 0;
+}
+
 void *unipro_rxbuf_alloc(unsigned int cportid)
 {
     struct cport *cport = cport_handle(cportid);
-    void *buf;
+    void *buf = NULL;
+#ifdef CONFIG_TSB_UNIPRO_RXBUF_POOL_DEPTH
+    irqstate_t flags;
+#endif
 
     if (!cport)
         return NULL;
 
-    if (cport->max_inflight_buf_count != INFINITE_MAX_INFLIGHT_BUFCOUNT &&
-        atomic_get(&cport->inflight_buf_count) >=
-            cport->max_inflight_buf_count) {
+    if (!unipro_rxbuf_can_inflight(cport))
         return NULL;
+
+#ifdef CONFIG_TSB_UNIPRO_RXBUF_POOL_DEPTH
+    flags = irqsave();
+    buf = unipro_rxbuf_pool_pop(cport);
+    if (cport->driver && cport->rxbuf_pool_depth) {
+        if (!buf)
+            cport->rx_stats.pool_misses++;
+        if (cport->rxbuf_pool_count <= cport->rxbuf_pool_depth / 2)
+            unipro_rxbuf_pool_refill(cport);
     }
+    irqrestore(flags);
+#endif
 
-    buf = bufram_page_alloc(bufram_size_to_page_count(CPORT_BUF_SIZE));
-    if (!buf)
-        return NULL;
+    if (!buf) {
+        buf = bufram_page_alloc(RXBUF_PAGE_COUNT);
+        if (!buf)
+            return NULL;
+    }
 
     atomic_inc(&cport->inflight_buf_count);
     return buf;
@@ -82,7 +322,7 @@ void unipro_rxbuf_free(unsigned int cportid, void *ptr)
     flags = irqsave();
 
     if (cport->switch_buf_on_free) {
-        cport->switch_buf_on_free = false;
+        unipro_rxbuf_resume(cport);
         irqrestore(flags);
 
         unipro_switch_rxbuf(cportid, ptr);
@@ -90,8 +330,17 @@ void unipro_rxbuf_free(unsigned int cportid, void *ptr)
         return;
     }
 
+    atomic_dec(&cport->inflight_buf_count);
+
+#ifdef CONFIG_TSB_UNIPRO_RXBUF_POOL_DEPTH
+    if (cport->driver && cport->rxbuf_pool_count < cport->rxbuf_pool_depth) {
+        unipro_rxbuf_pool_push(cport, ptr);
+        irqrestore(flags);
+        return;
+    }
+#endif
+
     irqrestore(flags);
 
-    atomic_dec(&cport->inflight_buf_count);
-    bufram_page_free(ptr, bufram_size_to_page_count(CPORT_BUF_SIZE));
+    bufram_page_free(ptr, RXBUF_PAGE_COUNT);
 }
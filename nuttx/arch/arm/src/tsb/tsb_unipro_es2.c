@@ -74,9 +74,6 @@
 static struct cport *cporttable;
 static unipro_event_handler_t evt_handler;
 
-#define APBRIDGE_CPORT_MAX 44 // number of CPorts available on the APBridges
-#define GPBRIDGE_CPORT_MAX 16 // number of CPorts available on the GPBridges
-
 /*
  * During unipro_unit(), we'll compute and cache the number of CPorts that this
  * bridge has, for use by the functions in this source file.
@@ -397,13 +394,16 @@ static int irq_rx_eom(int irq, void *context) {
                 cport->driver->name, transferred_size,
                 data);
 
+    cport->rx_stats.messages++;
+    cport->rx_stats.bytes += transferred_size;
+
     if (cport->driver->rx_handler) {
         newbuf = unipro_rxbuf_alloc(cport->cportid);
         if (newbuf) {
             unipro_switch_rxbuf(cport->cportid, newbuf);
             unipro_unpause_rx(cport->cportid);
         } else {
-            cport->switch_buf_on_free = true;
+            unipro_rxbuf_pause(cport);
         }
 
         cport->driver->rx_handler(cport->cportid, data,
@@ -760,6 +760,9 @@ static int unipro_init_cport(unsigned int cportid)
     cport->max_inflight_buf_count = CONFIG_TSB_UNIPRO_MAX_INFLIGHT_BUFCOUNT;
 #endif
     cport->switch_buf_on_free = false;
+#ifdef CONFIG_TSB_UNIPRO_RXBUF_POOL_DEPTH
+    cport->rxbuf_pool_depth = CONFIG_TSB_UNIPRO_RXBUF_POOL_DEPTH;
+#endif
 
     cport->rx_buf = unipro_rxbuf_alloc(cportid);
     if (!cport->rx_buf) {
@@ -804,6 +807,12 @@ void unipro_init(void)
     if (cport_count == 0)
         cport_count = unipro_cport_count();
 
+    if (cport_count > UNIPRO_CPORT_MAX) {
+        lldbg("%u CPorts, only %u supported\n", cport_count,
+              UNIPRO_CPORT_MAX);
+        return;
+    }
+
     cporttable = zalloc(sizeof(struct cport) * cport_count);
     if (!cporttable) {
         return;
@@ -822,6 +831,8 @@ void unipro_init(void)
         cport->cportid = i;
         cport->connected = 0;
         list_init(&cport->tx_fifo);
+        cport->tx_priority = UNIPRO_TX_DEFAULT_PRIORITY;
+        cport->tx_weight = UNIPRO_TX_DEFAULT_WEIGHT;
     }
 
     unipro_write(LUP_INT_EN, 0x1);
@@ -986,6 +997,8 @@ int unipro_reset_cport(unsigned int cportid, cport_reset_completion_cb_t cb,
 int unipro_driver_register(struct unipro_driver *driver, unsigned int cportid)
 {
     struct cport *cport = cport_handle(cportid);
+    int retval;
+
     if (!cport) {
         return -ENODEV;
     }
@@ -996,7 +1009,13 @@ int unipro_driver_register(struct unipro_driver *driver, unsigned int cportid)
         return -EEXIST;
     }
 
+    retval = unipro_tx_cport_init(cport);
+    if (retval) {
+        return retval;
+    }
+
     cport->driver = driver;
+    unipro_rxbuf_pool_refill(cport);
 
     lldbg("Registered driver %s on %sconnected CP%u\n",
           cport->driver->name, cport->connected ? "" : "un",
@@ -1012,6 +1031,7 @@ int unipro_driver_unregister(unsigned int cportid)
     }
 
     cport->driver = NULL;
+    unipro_rxbuf_pool_refill(cport);
 
     return 0;
 }
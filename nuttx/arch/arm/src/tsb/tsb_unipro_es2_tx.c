@@ -219,6 +219,27 @@ void unipro_reset_notify(unsigned int cportid)
     sem_post(&worker.tx_fifo_lock);
 }
 
+/*
+ * The programmed I/O worker sends the CPorts in turn, without scheduling
+ * policy or statistics: see tsb_unipro_es2_tx_dma.c.
+ */
+int unipro_tx_set_priority(unsigned int cportid, unsigned int priority,
+                           unsigned int weight)
+{
+    return -ENOSYS;
+}
+
+int unipro_tx_get_stats(unsigned int cportid, struct unipro_tx_stats *stats)
+{
+    return -ENOSYS;
+}
+
+int unipro_tx_get_channel_stats(unsigned int channel,
+                                struct unipro_tx_channel_stats *stats)
+{
+    return -ENOSYS;
+}
+
 /**
  * @brief           send data over UniPro asynchronously (not blocking)
  * @return          0 on success, <0 otherwise
@@ -316,6 +337,86 @@ int unipro_send(unsigned int cportid, const void *buf, size_t len)
     return 0;
 }
 
+/**
+ * @brief Send a message made of several buffers
+ * @param cportid cport to send down
+ * @param iov message segments, in order
+ * @param iovcnt number of segments, at most UNIPRO_IOV_MAX
+ * @return 0 on success, <0 on error
+ */
+int unipro_send_iov(unsigned int cportid, const struct unipro_iovec *iov,
+                    size_t iovcnt)
+{
+    int ret, sent;
+    bool som = true;
+    struct cport *cport;
+    size_t len = 0;
+    int i;
+
+    if (!iovcnt || iovcnt > UNIPRO_IOV_MAX) {
+        return -EINVAL;
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        len += iov[i].len;
+    }
+
+    if (len > CPORT_BUF_SIZE) {
+        return -EINVAL;
+    }
+
+    cport = cport_handle(cportid);
+    if (!cport) {
+        return -EINVAL;
+    }
+
+    if (cport->pending_reset) {
+        return -EPIPE;
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        for (sent = 0; sent < iov[i].len;) {
+            ret = unipro_send_sync(cportid, (const char*) iov[i].base + sent,
+                                   iov[i].len - sent, som);
+            if (ret < 0) {
+                return ret;
+            } else if (ret == 0) {
+                continue;
+            }
+            sent += ret;
+            som = false;
+        }
+    }
+
+    unipro_set_eom_flag(cport);
+
+    return 0;
+}
+
+/**
+ * @brief Send several messages on a CPort
+ * @param cportid cport to send down
+ * @param bufs data buffers
+ * @param lens size of each data buffer
+ * @param count number of messages
+ * @return 0 on success, <0 on error
+ */
+int unipro_send_batch(unsigned int cportid, const void **bufs,
+                      const size_t *lens, size_t count)
+{
+    int retval;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        retval = unipro_send(cportid, bufs[i], lens[i]);
+        if (retval) {
+            return retval;
+        }
+    }
+
+    return 0;
+}
+
 /**
  * @brief           Send data down to a CPort
  * @return          number of bytes effectively sent (>= 0), or error code (< 0)
@@ -377,6 +478,7 @@ int unipro_tx_init(void)
     int retval;
 
     sem_init(&worker.tx_fifo_lock, 0, 0);
+    sem_setprotocol(&worker.tx_fifo_lock, SEM_PRIO_NONE);
 
     retval = pthread_create(&worker.thread, NULL, unipro_tx_worker, NULL);
     if (retval) {
@@ -386,3 +488,9 @@ int unipro_tx_init(void)
 
     return 0;
 }
+
+int unipro_tx_cport_init(struct cport *cport)
+{
+    /* TX buffers are still allocated per message without DMA */
+    return 0;
+}
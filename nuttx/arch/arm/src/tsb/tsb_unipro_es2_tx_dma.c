@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <pthread.h>
 #include <string.h>
+#include <time.h>
 
 #include <nuttx/util.h>
 #include <nuttx/irq.h>
@@ -38,6 +39,8 @@
 #include <nuttx/list.h>
 #include <nuttx/unipro/unipro.h>
 #include <nuttx/device_dma.h>
+#include <nuttx/dma_memcpy.h>
+#include <nuttx/hires_tmr.h>
 
 #include "debug.h"
 #include "up_arch.h"
@@ -49,16 +52,41 @@
 
 #define UNIPRO_DMA_CHANNEL_COUNT CONFIG_ARCH_UNIPROTX_DMA_NUM_CHANNELS
 
+/*
+ * Ops queued on a DMA channel at once. Keeping it at one lets a message
+ * that becomes ready later take the first channel that frees up, instead of
+ * waiting behind the ops already queued.
+ */
+#define UNIPRO_DMA_CHANNEL_DEPTH    1
+
+#define UNIPRO_TX_DESCS_PER_CPORT   CONFIG_ARCH_UNIPROTX_DESCS_PER_CPORT
+#define UNIPRO_TX_DESC_TIMEOUT      CONFIG_ARCH_UNIPROTX_DESC_TIMEOUT
+
+struct unipro_dma_channel {
+    void *chan;
+    unsigned int inflight;          /* ops queued on the channel */
+    uint32_t busy_since;
+    struct unipro_tx_channel_stats stats;
+
+    /* ops allocated at init, reused from one chunk to the next */
+    struct device_dma_op *ops[UNIPRO_DMA_CHANNEL_DEPTH];
+    unsigned int free_ops;
+};
+
 struct unipro_xfer_descriptor {
     struct cport *cport;
     const void *data;
     size_t len;
 
+    struct unipro_iovec iov[UNIPRO_IOV_MAX];
+    size_t iovcnt;
+
     void *priv;
     unipro_send_completion_t callback;
 
     size_t data_offset;
-    void *channel;
+    struct unipro_dma_channel *channel;
+    uint32_t queued_at;
 
     struct list_head list;
 };
@@ -68,28 +96,263 @@ struct unipro_xfer_descriptor_sync {
     int retval;
 };
 
+struct unipro_xfer_descriptor_batch {
+    sem_t lock;
+    int retval;
+    size_t pending;
+};
+
 static struct {
     pthread_t thread;
     sem_t tx_fifo_lock;
 } worker;
 
+/*
+ * TX scheduler state. A CPort is marked active in the bitmap of its priority
+ * level when a message is queued or a reset is requested, and unmarked by
+ * the worker once its tx_fifo is found empty, so that the worker only looks
+ * at the CPorts that have something to do.
+ */
+static struct {
+    uint32_t active[UNIPRO_TX_PRIORITY_COUNT][UNIPRO_CPORT_BITMAP_WORDS];
+    unsigned int cursor[UNIPRO_TX_PRIORITY_COUNT]; /* next CPort to serve */
+} tx_sched;
+
 static struct {
     struct device *dev;
-    void *channel[UNIPRO_DMA_CHANNEL_COUNT];
-    struct list_head free_channel_list;
-    sem_t dma_channel_lock;
+    struct unipro_dma_channel channel[UNIPRO_DMA_CHANNEL_COUNT];
     int max_channel;
+    unsigned int sg_max;
 } unipro_dma;
 
-static void *pick_dma_channel(struct cport *cport)
+/**
+ * @return the least loaded DMA channel, or NULL if they are all full
+ */
+static struct unipro_dma_channel *pick_dma_channel(void)
+{
+    struct unipro_dma_channel *best = NULL;
+    irqstate_t flags;
+    int i;
+
+    flags = irqsave();
+
+    for (i = 0; i < unipro_dma.max_channel; i++) {
+        struct unipro_dma_channel *channel = &unipro_dma.channel[i];
+
+        if (channel->inflight >= UNIPRO_DMA_CHANNEL_DEPTH)
+            continue;
+
+        if (!best || channel->inflight < best->inflight)
+            best = channel;
+    }
+
+    irqrestore(flags);
+
+    return best;
+}
+
+static void unipro_dma_channel_get(struct unipro_dma_channel *channel)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    if (!channel->inflight++)
+        channel->busy_since = hrt_getusec();
+    irqrestore(flags);
+}
+
+static void unipro_dma_channel_put(struct unipro_dma_channel *channel,
+                                   size_t len)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    channel->stats.ops++;
+    channel->stats.bytes += len;
+    if (!--channel->inflight)
+        channel->stats.busy_time += hrt_getusec() - channel->busy_since;
+    irqrestore(flags);
+}
+
+static struct device_dma_op *
+unipro_dma_op_get(struct unipro_dma_channel *channel)
+{
+    struct device_dma_op *op = NULL;
+    irqstate_t flags;
+
+    flags = irqsave();
+    if (channel->free_ops)
+        op = channel->ops[--channel->free_ops];
+    irqrestore(flags);
+
+    return op;
+}
+
+static void unipro_dma_op_put(struct unipro_dma_channel *channel,
+                              struct device_dma_op *op)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    DEBUGASSERT(channel->free_ops < UNIPRO_DMA_CHANNEL_DEPTH);
+    channel->ops[channel->free_ops++] = op;
+    irqrestore(flags);
+}
+
+/**
+ * @brief Get the statistics of a UniPro TX DMA channel
+ *
+ * @param channel channel index
+ * @param stats filled with the statistics
+ * @return 0 on success, -EINVAL if there is no such channel
+ */
+int unipro_tx_get_channel_stats(unsigned int channel,
+                                struct unipro_tx_channel_stats *stats)
+{
+    irqstate_t flags;
+
+    if (channel >= unipro_dma.max_channel || !stats)
+        return -EINVAL;
+
+    flags = irqsave();
+    memcpy(stats, &unipro_dma.channel[channel].stats, sizeof(*stats));
+    if (unipro_dma.channel[channel].inflight) {
+        stats->busy_time +=
+            hrt_getusec() - unipro_dma.channel[channel].busy_since;
+    }
+    irqrestore(flags);
+
+    return 0;
+}
+
+/**
+ * @brief Allocate the TX descriptors of a CPort
+ *
+ * Called when a driver registers on the CPort, or on the first send on a
+ * CPort that has no driver. The descriptors are kept afterwards, so that a
+ * CPort only allocates them once.
+ *
+ * @note Must be called from thread context
+ *
+ * @param cport CPort to set up
+ * @return 0 on success, -ENOMEM if the descriptors can't be allocated
+ */
+int unipro_tx_cport_init(struct cport *cport)
+{
+    struct unipro_xfer_descriptor *descs;
+    irqstate_t flags;
+    int i;
+
+    if (cport->tx_descs)
+        return 0;
+
+    descs = zalloc(sizeof(*descs) * UNIPRO_TX_DESCS_PER_CPORT);
+    if (!descs)
+        return -ENOMEM;
+
+    flags = irqsave();
+
+    /* Another thread may have set the CPort up meanwhile */
+    if (cport->tx_descs) {
+        irqrestore(flags);
+        free(descs);
+        return 0;
+    }
+
+    list_init(&cport->tx_desc_pool);
+    sem_init(&cport->tx_desc_sem, 0, 0);
+    sem_setprotocol(&cport->tx_desc_sem, SEM_PRIO_NONE);
+    cport->tx_desc_waiters = 0;
+
+    for (i = 0; i < UNIPRO_TX_DESCS_PER_CPORT; i++) {
+        descs[i].cport = cport;
+        list_add(&cport->tx_desc_pool, &descs[i].list);
+    }
+
+    cport->tx_descs = descs;
+
+    irqrestore(flags);
+
+    return 0;
+}
+
+/**
+ * @brief Take a free descriptor of a CPort
+ *
+ * @param cport CPort to send on
+ * @param wait wait up to UNIPRO_TX_DESC_TIMEOUT for a descriptor to get free
+ * @return a descriptor, or NULL if none got free in time
+ */
+static struct unipro_xfer_descriptor *unipro_xfer_desc_get(struct cport *cport,
+                                                           bool wait)
 {
-    void *chan = unipro_dma.channel[cport->cportid % unipro_dma.max_channel];
+    struct unipro_xfer_descriptor *desc = NULL;
+    struct timespec abstime;
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    if (list_is_empty(&cport->tx_desc_pool)) {
+        cport->tx_stats.backpressure++;
 
-    return chan;
+        if (!wait || !UNIPRO_TX_DESC_TIMEOUT)
+            goto out;
+
+        clock_gettime(CLOCK_REALTIME, &abstime);
+        abstime.tv_sec += UNIPRO_TX_DESC_TIMEOUT / 1000;
+        abstime.tv_nsec += (UNIPRO_TX_DESC_TIMEOUT % 1000) * 1000000;
+        if (abstime.tv_nsec >= 1000000000) {
+            abstime.tv_sec++;
+            abstime.tv_nsec -= 1000000000;
+        }
+    }
+
+    while (list_is_empty(&cport->tx_desc_pool)) {
+        /* the messages may be queued without the worker knowing yet */
+        sem_post(&worker.tx_fifo_lock);
+
+        cport->tx_desc_waiters++;
+        if (sem_timedwait(&cport->tx_desc_sem, &abstime) &&
+            errno != EINTR) {
+            cport->tx_desc_waiters--;
+            goto out;
+        }
+        cport->tx_desc_waiters--;
+    }
+
+    desc = containerof(cport->tx_desc_pool.next,
+                       struct unipro_xfer_descriptor, list);
+    list_del(&desc->list);
+
+out:
+    irqrestore(flags);
+
+    return desc;
+}
+
+/**
+ * @note The descriptor must have been removed from the CPort tx_fifo
+ */
+static void unipro_xfer_desc_put(struct unipro_xfer_descriptor *desc)
+{
+    struct cport *cport = desc->cport;
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    list_add(&cport->tx_desc_pool, &desc->list);
+    cport->tx_stats.queue_depth--;
+    if (cport->tx_desc_waiters)
+        sem_post(&cport->tx_desc_sem);
+
+    irqrestore(flags);
 }
 
 static void unipro_dequeue_tx_desc(struct unipro_xfer_descriptor *desc, int status)
 {
+    unipro_send_completion_t callback;
+    const void *data;
+    void *priv;
     irqstate_t flags;
 
     DEBUGASSERT(desc);
@@ -98,11 +361,15 @@ static void unipro_dequeue_tx_desc(struct unipro_xfer_descriptor *desc, int stat
     list_del(&desc->list);
     irqrestore(flags);
 
-    if (desc->callback) {
-        desc->callback(status, desc->data, desc->priv);
-    }
+    /* Free the descriptor first, so that the callback can send again */
+    callback = desc->callback;
+    data = desc->data;
+    priv = desc->priv;
+    unipro_xfer_desc_put(desc);
 
-    free(desc);
+    if (callback) {
+        callback(status, data, priv);
+    }
 }
 
 static void unipro_flush_cport(struct cport *cport)
@@ -130,46 +397,243 @@ reset:
     cport->reset_completion_cb = cport->reset_completion_cb_priv = NULL;
 }
 
-static struct unipro_xfer_descriptor *pick_tx_descriptor(unsigned int cportid)
+/**
+ * @note This function should be called from an atomic context
+ */
+static void tx_sched_activate(struct cport *cport)
+{
+    tx_sched.active[cport->tx_priority][cport->cportid / 32] |=
+        1 << (cport->cportid % 32);
+}
+
+static bool tx_sched_is_active(struct cport *cport)
+{
+    return tx_sched.active[cport->tx_priority][cport->cportid / 32] &
+           (1 << (cport->cportid % 32));
+}
+
+/**
+ * @return the first active CPort of a priority level, starting from
+ *         'cportid', or -1 if there is none
+ */
+static int tx_sched_next_active(unsigned int priority, unsigned int cportid)
+{
+    unsigned int word = cportid / 32;
+    uint32_t bits;
+
+    if (cportid >= UNIPRO_CPORT_MAX)
+        return -1;
+
+    bits = tx_sched.active[priority][word] & (~0U << (cportid % 32));
+    while (!bits) {
+        if (++word == UNIPRO_CPORT_BITMAP_WORDS)
+            return -1;
+        bits = tx_sched.active[priority][word];
+    }
+
+    return word * 32 + __builtin_ctz(bits);
+}
+
+/**
+ * @return the descriptor at the head of the CPort tx_fifo if it can be
+ *         transferred right away, NULL otherwise
+ */
+static struct unipro_xfer_descriptor *tx_sched_head(unsigned int priority,
+                                                    unsigned int cportid)
 {
     struct unipro_xfer_descriptor *desc;
-    unsigned int cport_count = unipro_cport_count();
-    int i;
+    struct cport *cport;
+    irqstate_t flags;
 
-    for (i = 0; i < cport_count; i++, cportid++) {
-        struct cport *cport;
+    cport = cport_handle(cportid);
+    if (cport && cport->pending_reset) {
+        unipro_flush_cport(cport);
+    }
 
-        cportid = cportid % cport_count;
-        cport = cport_handle(cportid);
-        if (!cport)
-            continue;
+    flags = irqsave();
+    if (!cport || list_is_empty(&cport->tx_fifo)) {
+        tx_sched.active[priority][cportid / 32] &= ~(1 << (cportid % 32));
+        if (cport)
+            cport->tx_deficit = 0;
+        irqrestore(flags);
+        return NULL;
+    }
+    irqrestore(flags);
 
-        if (list_is_empty(&cport->tx_fifo)) {
-            if (cport->pending_reset) {
-                unipro_flush_cport(cport);
-            }
+    desc = containerof(cport->tx_fifo.next, struct unipro_xfer_descriptor,
+            list);
+    if (desc->channel)
+        return NULL;
 
-            continue;
+    /* no room in the CPort TX buffer: the peer hasn't given credits back */
+    if (!unipro_get_tx_free_buffer_space(desc->cport)) {
+        if (!cport->tx_stalled) {
+            cport->tx_stalled = true;
+            cport->tx_stats.stalls++;
         }
+        return NULL;
+    }
+
+    cport->tx_stalled = false;
 
-        if (cport->pending_reset) {
-            unipro_flush_cport(cport);
+    return desc;
+}
+
+/**
+ * Deficit round-robin between the CPorts of a priority level
+ *
+ * A CPort is served as long as it has credit, and is charged for the bytes
+ * it transfers. When no ready CPort has credit left, they all get credited
+ * with their weight as many times as needed for one of them to be served.
+ */
+static struct unipro_xfer_descriptor *tx_sched_pick(unsigned int priority)
+{
+    struct unipro_xfer_descriptor *ready[UNIPRO_CPORT_MAX];
+    struct unipro_xfer_descriptor *desc;
+    unsigned int start = tx_sched.cursor[priority];
+    unsigned int count = 0;
+    int32_t rounds = INT32_MAX;
+    int32_t needed;
+    int cportid;
+    int pass;
+    int i;
+
+    /* visit the active CPorts in ring order, starting at the cursor */
+    for (pass = 0; pass < 2; pass++) {
+        for (cportid = tx_sched_next_active(priority, pass ? 0 : start);
+             cportid >= 0 && (!pass || cportid < start);
+             cportid = tx_sched_next_active(priority, cportid + 1)) {
+            desc = tx_sched_head(priority, cportid);
+            if (!desc)
+                continue;
+
+            if (desc->cport->tx_deficit > 0)
+                return desc;
+
+            needed = (desc->cport->tx_weight - desc->cport->tx_deficit) /
+                     desc->cport->tx_weight;
+            rounds = MIN(rounds, needed);
+            ready[count++] = desc;
         }
+    }
 
-        desc = containerof(cport->tx_fifo.next, struct unipro_xfer_descriptor,
-                list);
-        if (desc->channel)
-            continue;
+    if (!count)
+        return NULL;
 
-        if (!unipro_get_tx_free_buffer_space(desc->cport))
-            continue;
+    for (i = 0; i < count; i++)
+        ready[i]->cport->tx_deficit += rounds * ready[i]->cport->tx_weight;
+
+    for (i = 0; i < count; i++) {
+        if (ready[i]->cport->tx_deficit > 0)
+            return ready[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * Charge a CPort for a transfer, and keep the cursor of its priority level
+ * on it while it still has credit.
+ */
+static void tx_sched_charge(struct cport *cport, size_t len)
+{
+    unsigned int next = cport->cportid;
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    cport->tx_deficit -= len;
+    if (cport->tx_deficit <= 0)
+        next = (next + 1) % UNIPRO_CPORT_MAX;
+
+    tx_sched.cursor[cport->tx_priority] = next;
+
+    irqrestore(flags);
+}
+
+static struct unipro_xfer_descriptor *pick_tx_descriptor(void)
+{
+    struct unipro_xfer_descriptor *desc;
+    int i;
 
-        return desc;
+    for (i = 0; i < UNIPRO_TX_PRIORITY_COUNT; i++) {
+        desc = tx_sched_pick(i);
+        if (desc)
+            return desc;
     }
 
     return NULL;
 }
 
+/**
+ * @brief Set the TX priority level and weight of a CPort
+ *
+ * Levels are served in strict priority order, 0 first. The CPorts of a
+ * level share the bandwidth in proportion to their weight.
+ *
+ * @param cportid CPort to configure
+ * @param priority priority level, lower than UNIPRO_TX_PRIORITY_COUNT
+ * @param weight bytes the CPort can send per round
+ * @return 0 on success, -EINVAL on invalid parameter
+ */
+int unipro_tx_set_priority(unsigned int cportid, unsigned int priority,
+                           unsigned int weight)
+{
+    struct cport *cport;
+    irqstate_t flags;
+    bool active;
+
+    cport = cport_handle(cportid);
+    if (!cport || priority >= UNIPRO_TX_PRIORITY_COUNT || !weight ||
+        weight > INT16_MAX) {
+        return -EINVAL;
+    }
+
+    flags = irqsave();
+
+    active = tx_sched_is_active(cport);
+    if (active) {
+        tx_sched.active[cport->tx_priority][cportid / 32] &=
+            ~(1 << (cportid % 32));
+    }
+
+    cport->tx_priority = priority;
+    cport->tx_weight = weight;
+    cport->tx_deficit = 0;
+
+    if (active) {
+        tx_sched_activate(cport);
+    }
+
+    irqrestore(flags);
+
+    return 0;
+}
+
+/**
+ * @brief Get the TX statistics of a CPort
+ *
+ * @param cportid CPort to query
+ * @param stats filled with the statistics
+ * @return 0 on success, -EINVAL on invalid parameter
+ */
+int unipro_tx_get_stats(unsigned int cportid, struct unipro_tx_stats *stats)
+{
+    struct cport *cport;
+    irqstate_t flags;
+
+    cport = cport_handle(cportid);
+    if (!cport || !stats) {
+        return -EINVAL;
+    }
+
+    flags = irqsave();
+    memcpy(stats, &cport->tx_stats, sizeof(*stats));
+    irqrestore(flags);
+
+    return 0;
+}
+
 static inline void unipro_dma_tx_set_eom_flag(struct cport *cport)
 {
     putreg8(1, CPORT_EOM_BIT(cport));
@@ -183,41 +647,102 @@ static void unipro_xfer_dequeue_descriptor(struct unipro_xfer_descriptor *desc)
     list_del(&desc->list);
     irqrestore(flags);
 
-    free(desc);
+    unipro_xfer_desc_put(desc);
+}
+
+static int unipro_dma_xfer(struct unipro_xfer_descriptor *desc,
+                           struct unipro_dma_channel *channel);
+
+static void unipro_tx_account_sent(struct unipro_xfer_descriptor *desc)
+{
+    struct unipro_tx_stats *stats = &desc->cport->tx_stats;
+    uint32_t latency = hrt_getusec() - desc->queued_at;
+    irqstate_t flags;
+
+    flags = irqsave();
+    stats->messages++;
+    stats->latency_total += latency;
+    stats->latency_max = MAX(stats->latency_max, latency);
+    irqrestore(flags);
 }
 
 static int unipro_dma_tx_callback(struct device *dev, void *chan,
         struct device_dma_op *op, unsigned int event, void *arg)
 {
     struct unipro_xfer_descriptor *desc = arg;
+    struct unipro_dma_channel *channel = desc->channel;
+    size_t len = 0;
+    int i;
 
-    if (event & DEVICE_DMA_CALLBACK_EVENT_COMPLETE) {
-        if (desc->data_offset >= desc->len) {
-            unipro_dma_tx_set_eom_flag(desc->cport);
+    if (!(event & DEVICE_DMA_CALLBACK_EVENT_COMPLETE))
+        return OK;
 
-            list_del(&desc->list);
-            device_dma_op_free(unipro_dma.dev, op);
+    for (i = 0; i < op->sg_count; i++)
+        len += op->sg[i].len;
 
-            if (desc->callback != NULL) {
-                desc->callback(0, desc->data, desc->priv);
-            }
-            unipro_xfer_dequeue_descriptor(desc);
-        } else {
-            desc->channel = NULL;
+    unipro_dma_op_put(channel, op);
 
-            sem_post(&worker.tx_fifo_lock);
+    if (desc->data_offset >= desc->len) {
+        unipro_send_completion_t callback = desc->callback;
+        const void *data = desc->data;
+        void *priv = desc->priv;
+
+        unipro_dma_tx_set_eom_flag(desc->cport);
+        unipro_tx_account_sent(desc);
+
+        /* Free the descriptor first, so that the callback can send again */
+        unipro_xfer_dequeue_descriptor(desc);
+        if (callback != NULL) {
+            callback(0, data, priv);
         }
+    } else if (!desc->cport->pending_reset &&
+               unipro_get_tx_free_buffer_space(desc->cport) &&
+               !unipro_dma_xfer(desc, channel)) {
+        /*
+         * The next chunk is chained on the same channel since the CPort can
+         * take it already, rather than going back through the worker.
+         */
+        unipro_dma_channel_put(channel, len);
+        return OK;
+    } else {
+        desc->channel = NULL;
     }
 
+    unipro_dma_channel_put(channel, len);
+    sem_post(&worker.tx_fifo_lock);
+
     return OK;
 }
 
-static int unipro_dma_xfer(struct unipro_xfer_descriptor *desc, void *channel)
+static void unipro_tx_account(struct unipro_xfer_descriptor *desc, size_t len)
+{
+    struct unipro_tx_stats *stats = &desc->cport->tx_stats;
+    uint32_t delay;
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    stats->bytes += len;
+    if (!desc->data_offset) {
+        delay = hrt_getusec() - desc->queued_at;
+        stats->delay_total += delay;
+        stats->delay_max = MAX(stats->delay_max, delay);
+    }
+
+    irqrestore(flags);
+}
+
+static int unipro_dma_xfer(struct unipro_xfer_descriptor *desc,
+                           struct unipro_dma_channel *channel)
 {
     int retval;
     size_t xfer_len;
+    size_t seg_len;
+    size_t skip;
+    size_t copied;
+    unsigned int sg_count;
     void *cport_buf;
-    void *xfer_buf;
+    int i;
     struct device_dma_op *dma_op = NULL;
 
     xfer_len = unipro_get_tx_free_buffer_space(desc->cport);
@@ -226,62 +751,103 @@ static int unipro_dma_xfer(struct unipro_xfer_descriptor *desc, void *channel)
 
     xfer_len = MIN(desc->len - desc->data_offset, xfer_len);
 
-    desc->channel = channel;
-    retval = device_dma_op_alloc(unipro_dma.dev, 1, 0, &dma_op);
-    if (retval != OK) {
-        lowsyslog("unipro: failed allocate a DMA op, retval = %d.\n", retval);
-        return retval;
+    /* count the segments covered by this chunk of the message */
+    skip = desc->data_offset;
+    copied = 0;
+    sg_count = 0;
+    for (i = 0; i < desc->iovcnt && copied < xfer_len; i++) {
+        if (skip >= desc->iov[i].len) {
+            skip -= desc->iov[i].len;
+            continue;
+        }
+
+        copied += MIN(desc->iov[i].len - skip, xfer_len - copied);
+        skip = 0;
+        sg_count++;
     }
 
+    DEBUGASSERT(sg_count <= unipro_dma.sg_max);
+
+    dma_op = unipro_dma_op_get(channel);
+    if (!dma_op)
+        return -EBUSY;
+
     dma_op->callback = (void *) unipro_dma_tx_callback;
     dma_op->callback_arg = desc;
     dma_op->callback_events = DEVICE_DMA_CALLBACK_EVENT_COMPLETE;
-    dma_op->sg_count = 1;
-    dma_op->sg[0].len = xfer_len;
+    dma_op->sg_count = sg_count;
 
-    DBG_UNIPRO("xfer: chan=%u, len=%zu\n", channel->id, xfer_len);
+    DBG_UNIPRO("xfer: chan=%u, len=%zu\n",
+               channel - unipro_dma.channel, xfer_len);
 
     cport_buf = desc->cport->tx_buf;
-    xfer_buf = (void*) desc->data;
 
     /* resuming a paused xfer */
     if (desc->data_offset != 0) {
         cport_buf = (char*) cport_buf + sizeof(uint32_t); /* skip the first DWORD */
-
-        /* move buffer offset to the beginning of the remaning bytes to xfer */
-        xfer_buf = (char*) xfer_buf + desc->data_offset;
     }
 
-    dma_op->sg[0].src_addr = (off_t) xfer_buf;
-    dma_op->sg[0].dst_addr = (off_t) cport_buf;
+    /*
+     * Segments are written one after the other in the CPort TX buffer,
+     * starting at the first remaining byte of the message.
+     */
+    skip = desc->data_offset;
+    copied = 0;
+    sg_count = 0;
+    for (i = 0; i < desc->iovcnt && copied < xfer_len; i++) {
+        if (skip >= desc->iov[i].len) {
+            skip -= desc->iov[i].len;
+            continue;
+        }
+
+        seg_len = MIN(desc->iov[i].len - skip, xfer_len - copied);
 
-    desc->data_offset += xfer_len;
+        dma_op->sg[sg_count].len = seg_len;
+        dma_op->sg[sg_count].src_addr =
+            (off_t) ((const char*) desc->iov[i].base + skip);
+        dma_op->sg[sg_count].dst_addr = (off_t) ((char*) cport_buf + copied);
 
-    retval = device_dma_enqueue(unipro_dma.dev, channel, dma_op);
+        copied += seg_len;
+        skip = 0;
+        sg_count++;
+    }
+
+    desc->channel = channel;
+    unipro_dma_channel_get(channel);
+
+    retval = device_dma_enqueue(unipro_dma.dev, channel->chan, dma_op);
     if (retval) {
         lowsyslog("unipro: failed to start DMA transfer: %d\n", retval);
+        desc->channel = NULL;
+        unipro_dma_channel_put(channel, 0);
+        unipro_dma_op_put(channel, dma_op);
         return retval;
     }
 
+    unipro_tx_account(desc, xfer_len);
+    desc->data_offset += xfer_len;
+    tx_sched_charge(desc->cport, xfer_len);
+
     return 0;
 }
 
 static void *unipro_tx_worker(void *data)
 {
-    struct dma_channel *channel;
+    struct unipro_dma_channel *channel;
     struct unipro_xfer_descriptor *desc;
-    unsigned int next_cport;
 
     while (1) {
-        /* Block until a buffer is pending on any CPort */
+        /*
+         * Block until a buffer is pending on any CPort, or a DMA channel
+         * got free
+         */
         sem_wait(&worker.tx_fifo_lock);
 
-        next_cport = 0;
-        while ((desc = pick_tx_descriptor(next_cport)) != NULL) {
-            next_cport = desc->cport->cportid + 1;
-            channel = pick_dma_channel(desc->cport);
-
-            unipro_dma_xfer(desc, channel);
+        /* Keep all the channels busy, with messages from different CPorts */
+        while ((channel = pick_dma_channel()) != NULL &&
+               (desc = pick_tx_descriptor()) != NULL) {
+            if (unipro_dma_xfer(desc, channel))
+                break;
         }
     }
 
@@ -290,6 +856,15 @@ static void *unipro_tx_worker(void *data)
 
 void unipro_reset_notify(unsigned int cportid)
 {
+    struct cport *cport = cport_handle(cportid);
+    irqstate_t flags;
+
+    if (cport) {
+        flags = irqsave();
+        tx_sched_activate(cport);
+        irqrestore(flags);
+    }
+
     /*
      * if the tx worker is blocked on the semaphore, post something on it
      * in order to unlock it and have the reset happen right away.
@@ -297,12 +872,30 @@ void unipro_reset_notify(unsigned int cportid)
     sem_post(&worker.tx_fifo_lock);
 }
 
-int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
-        unipro_send_completion_t callback, void *priv)
+static int _unipro_send_async(unsigned int cportid,
+        const struct unipro_iovec *iov, size_t iovcnt,
+        unipro_send_completion_t callback, void *priv, bool wakeup_worker,
+        bool wait)
 {
     struct cport *cport;
     struct unipro_xfer_descriptor *desc;
     irqstate_t flags;
+    size_t len = 0;
+    int retval;
+    int i;
+
+    if (!iovcnt || iovcnt > UNIPRO_IOV_MAX) {
+        return -EINVAL;
+    }
+
+    /* only the first segment may be shorter than a DWORD, see unipro_dma_xfer */
+    if (iovcnt > 1 && iov[0].len < sizeof(uint32_t)) {
+        return -EINVAL;
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        len += iov[i].len;
+    }
 
     cport = cport_handle(cportid);
     if (!cport) {
@@ -315,28 +908,64 @@ int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
         return -EPIPE;
     }
 
-    desc = zalloc(sizeof(*desc));
+    /*
+     * A CPort without a driver gets its descriptors on its first send. The
+     * heap can't be used from interrupt context, where this fails like the
+     * allocation of the descriptor did before the pools.
+     */
+    if (!cport->tx_descs) {
+        if (up_interrupt_context()) {
+            lldbg("CP%u: no TX descriptors, send from a thread first\n",
+                  cport->cportid);
+            return -ENOMEM;
+        }
+
+        retval = unipro_tx_cport_init(cport);
+        if (retval)
+            return retval;
+    }
+
+    desc = unipro_xfer_desc_get(cport, wait);
     if (!desc)
-        return -ENOMEM;
+        return -EAGAIN;
 
-    desc->data = buf;
+    memcpy(desc->iov, iov, iovcnt * sizeof(*iov));
+    desc->iovcnt = iovcnt;
+    desc->data = iov[0].base;
     desc->len = len;
     desc->data_offset = 0;
     desc->callback = callback;
     desc->priv = priv;
-    desc->cport = cport;
+    desc->channel = NULL;
+    desc->queued_at = hrt_getusec();
 
     list_init(&desc->list);
 
     flags = irqsave();
     list_add(&cport->tx_fifo, &desc->list);
+    tx_sched_activate(cport);
+    if (++cport->tx_stats.queue_depth > cport->tx_stats.queue_max)
+        cport->tx_stats.queue_max = cport->tx_stats.queue_depth;
     irqrestore(flags);
 
-    sem_post(&worker.tx_fifo_lock);
+    if (wakeup_worker) {
+        sem_post(&worker.tx_fifo_lock);
+    }
 
     return 0;
 }
 
+int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
+        unipro_send_completion_t callback, void *priv)
+{
+    struct unipro_iovec iov = {
+        .base = buf,
+        .len = len,
+    };
+
+    return _unipro_send_async(cportid, &iov, 1, callback, priv, true, false);
+}
+
 static int unipro_send_cb(int status, const void *buf, void *priv)
 {
     struct unipro_xfer_descriptor_sync *desc = priv;
@@ -350,14 +979,27 @@ static int unipro_send_cb(int status, const void *buf, void *priv)
     return 0;
 }
 
-int unipro_send(unsigned int cportid, const void *buf, size_t len)
+/**
+ * @brief Send a message made of several buffers without copying them
+ *
+ * Each buffer is DMA'd straight to the CPort TX buffer.
+ *
+ * @param cportid cport to send down
+ * @param iov message segments, in order
+ * @param iovcnt number of segments, at most UNIPRO_IOV_MAX
+ * @return 0 on success, <0 on error
+ */
+int unipro_send_iov(unsigned int cportid, const struct unipro_iovec *iov,
+                    size_t iovcnt)
 {
     int retval;
     struct unipro_xfer_descriptor_sync desc;
 
     sem_init(&desc.lock, 0, 0);
+    sem_setprotocol(&desc.lock, SEM_PRIO_NONE);
 
-    retval = unipro_send_async(cportid, buf, len, unipro_send_cb, &desc);
+    retval = _unipro_send_async(cportid, iov, iovcnt, unipro_send_cb, &desc,
+                                true, true);
     if (retval) {
         goto out;
     }
@@ -371,14 +1013,133 @@ out:
     return retval;
 }
 
+int unipro_send(unsigned int cportid, const void *buf, size_t len)
+{
+    struct unipro_iovec iov = {
+        .base = buf,
+        .len = len,
+    };
+
+    return unipro_send_iov(cportid, &iov, 1);
+}
+
+static int unipro_send_batch_cb(int status, const void *buf, void *priv)
+{
+    struct unipro_xfer_descriptor_batch *batch = priv;
+    irqstate_t flags;
+    bool done;
+
+    flags = irqsave();
+    if (status && !batch->retval) {
+        batch->retval = status;
+    }
+    done = --batch->pending == 0;
+    irqrestore(flags);
+
+    if (done) {
+        sem_post(&batch->lock);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Send several messages on a CPort and wait for all of them
+ *
+ * All the messages are queued before the TX worker is woken up, so that it
+ * can process them in a single pass.
+ *
+ * @param cportid cport to send down
+ * @param bufs data buffers
+ * @param lens size of each data buffer
+ * @param count number of messages
+ * @return 0 on success, <0 on error
+ */
+int unipro_send_batch(unsigned int cportid, const void **bufs,
+                      const size_t *lens, size_t count)
+{
+    struct unipro_xfer_descriptor_batch batch;
+    irqstate_t flags;
+    bool done;
+    int retval = 0;
+    int i;
+
+    if (!count) {
+        return 0;
+    }
+
+    sem_init(&batch.lock, 0, 0);
+    sem_setprotocol(&batch.lock, SEM_PRIO_NONE);
+    batch.retval = 0;
+    batch.pending = count;
+
+    for (i = 0; i < count; i++) {
+        struct unipro_iovec iov = {
+            .base = bufs[i],
+            .len = lens[i],
+        };
+
+        retval = _unipro_send_async(cportid, &iov, 1, unipro_send_batch_cb,
+                                    &batch, false, true);
+        if (retval) {
+            break;
+        }
+    }
+
+    if (i) {
+        sem_post(&worker.tx_fifo_lock);
+    }
+
+    if (i != count) {
+        flags = irqsave();
+        batch.pending -= count - i;
+        done = batch.pending == 0;
+        irqrestore(flags);
+
+        if (done) {
+            goto out;
+        }
+    }
+
+    sem_wait(&batch.lock);
+
+out:
+    sem_destroy(&batch.lock);
+
+    return retval ? retval : batch.retval;
+}
+
+static int unipro_dma_channel_alloc_ops(struct unipro_dma_channel *channel)
+{
+    int retval;
+
+    for (channel->free_ops = 0;
+         channel->free_ops < UNIPRO_DMA_CHANNEL_DEPTH;
+         channel->free_ops++) {
+        retval = device_dma_op_alloc(unipro_dma.dev, UNIPRO_IOV_MAX, 0,
+                                     &channel->ops[channel->free_ops]);
+        if (retval)
+            return retval;
+    }
+
+    return 0;
+}
+
+static void unipro_dma_channel_free_ops(struct unipro_dma_channel *channel)
+{
+    while (channel->free_ops)
+        device_dma_op_free(unipro_dma.dev, channel->ops[--channel->free_ops]);
+}
+
 int unipro_tx_init(void)
 {
+    struct device_dma_caps caps;
     int i;
     int retval;
     int avail_chan = 0;
 
     sem_init(&worker.tx_fifo_lock, 0, 0);
-    sem_init(&unipro_dma.dma_channel_lock, 0, 0);
+    sem_setprotocol(&worker.tx_fifo_lock, SEM_PRIO_NONE);
 
     unipro_dma.dev = device_open(DEVICE_TYPE_DMA_HW, 0);
     if (!unipro_dma.dev) {
@@ -387,7 +1148,16 @@ int unipro_tx_init(void)
     }
 
     unipro_dma.max_channel = 0;
-    list_init(&unipro_dma.free_channel_list);
+
+    unipro_dma.sg_max = UNIPRO_IOV_MAX;
+    if (!device_dma_get_caps(unipro_dma.dev, &caps) &&
+        caps.sg_max < UNIPRO_IOV_MAX) {
+        lldbg("DMA driver cannot gather %u segments.\n", UNIPRO_IOV_MAX);
+        device_close(unipro_dma.dev);
+        unipro_dma.dev = NULL;
+        return -EINVAL;
+    }
+
     avail_chan = device_dma_chan_free_count(unipro_dma.dev);
 
     if (avail_chan > ARRAY_SIZE(unipro_dma.channel)) {
@@ -407,15 +1177,25 @@ int unipro_tx_init(void)
                 .swap = DEVICE_DMA_SWAP_SIZE_NONE,
         };
 
+        unipro_dma.channel[i].chan = NULL;
         device_dma_chan_alloc(unipro_dma.dev, &chan_params,
-                &unipro_dma.channel[i]);
+                &unipro_dma.channel[i].chan);
 
-        if (unipro_dma.channel[i] == NULL) {
+        if (unipro_dma.channel[i].chan == NULL) {
             lowsyslog("unipro: couldn't allocate all %u requested channel(s)\n",
                     ARRAY_SIZE(unipro_dma.channel));
             break;
         }
 
+        if (unipro_dma_channel_alloc_ops(&unipro_dma.channel[i])) {
+            lowsyslog("unipro: couldn't allocate the DMA ops of channel %d\n",
+                    i);
+            unipro_dma_channel_free_ops(&unipro_dma.channel[i]);
+            device_dma_chan_free(unipro_dma.dev, unipro_dma.channel[i].chan);
+            unipro_dma.channel[i].chan = NULL;
+            break;
+        }
+
         unipro_dma.max_channel++;
     }
 
@@ -427,6 +1207,11 @@ int unipro_tx_init(void)
 
     lowsyslog("unipro: %d DMA channel(s) allocated\n", unipro_dma.max_channel);
 
+#ifdef CONFIG_DMA_MEMCPY
+    /* The DMA device can only be opened once, share it */
+    dma_memcpy_init(unipro_dma.dev);
+#endif
+
     retval = pthread_create(&worker.thread, NULL, unipro_tx_worker, NULL);
     if (retval) {
         lldbg("Failed to create worker thread: %s.\n", strerror(errno));
@@ -438,7 +1223,8 @@ int unipro_tx_init(void)
 error_worker_create:
 
     for (i = 0; i < unipro_dma.max_channel; i++) {
-        device_dma_chan_free(unipro_dma.dev, &unipro_dma.channel[i]);
+        unipro_dma_channel_free_ops(&unipro_dma.channel[i]);
+        device_dma_chan_free(unipro_dma.dev, unipro_dma.channel[i].chan);
     }
 
     unipro_dma.max_channel = 0;
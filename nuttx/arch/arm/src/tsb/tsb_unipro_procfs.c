@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * UniPro statistics in procfs:
+ *
+ *   /proc/unipro/link          link power mode and totals of all CPorts
+ *   /proc/unipro/cportN/stats  RX and TX counters of CPort N
+ */
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/kmalloc.h>
+#include <nuttx/util.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/fs/procfs.h>
+#include <nuttx/fs/dirent.h>
+#include <nuttx/unipro/unipro.h>
+
+#if !defined(CONFIG_DISABLE_MOUNTPOINT) && defined(CONFIG_FS_PROCFS)
+
+#define UNIPRO_PROCFS_BUFSIZE   768
+
+enum unipro_procfs_node {
+    UNIPRO_PROCFS_ROOT,         /* unipro */
+    UNIPRO_PROCFS_LINK,         /* unipro/link */
+    UNIPRO_PROCFS_CPORT,        /* unipro/cportN */
+    UNIPRO_PROCFS_CPORT_STATS,  /* unipro/cportN/stats */
+};
+
+struct unipro_procfs_file {
+    struct procfs_file_s base;
+    enum unipro_procfs_node node;
+    unsigned int cportid;
+    size_t len;
+    char buf[UNIPRO_PROCFS_BUFSIZE];
+};
+
+struct unipro_procfs_dir {
+    struct procfs_dir_priv_s base;
+    enum unipro_procfs_node node;
+};
+
+static int unipro_procfs_open(struct file *filep, const char *relpath,
+                              int oflags, mode_t mode);
+static int unipro_procfs_close(struct file *filep);
+static ssize_t unipro_procfs_read(struct file *filep, char *buffer,
+                                  size_t buflen);
+static int unipro_procfs_dup(const struct file *oldp, struct file *newp);
+static int unipro_procfs_opendir(const char *relpath,
+                                 struct fs_dirent_s *dir);
+static int unipro_procfs_closedir(struct fs_dirent_s *dir);
+static int unipro_procfs_readdir(struct fs_dirent_s *dir);
+static int unipro_procfs_rewinddir(struct fs_dirent_s *dir);
+static int unipro_procfs_stat(const char *relpath, struct stat *buf);
+
+const struct procfs_operations tsb_unipro_procfsoperations = {
+    unipro_procfs_open,         /* open */
+    unipro_procfs_close,        /* close */
+    unipro_procfs_read,         /* read */
+    NULL,                       /* write */
+    unipro_procfs_dup,          /* dup */
+    unipro_procfs_opendir,      /* opendir */
+    unipro_procfs_closedir,     /* closedir */
+    unipro_procfs_readdir,      /* readdir */
+    unipro_procfs_rewinddir,    /* rewinddir */
+    unipro_procfs_stat,         /* stat */
+};
+
+/**
+ * @brief Find which node of the subtree a path refers to
+ *
+ * @param relpath path relative to the procfs mount point
+ * @param cportid set to the CPort of cportN and cportN/stats
+ * @return the node, or -ENOENT if the path doesn't exist
+ */
+static int unipro_procfs_parse(const char *relpath, unsigned int *cportid)
+{
+    char *end;
+
+    if (strncmp(relpath, "unipro", 6))
+        return -ENOENT;
+
+    relpath += 6;
+    if (*relpath == '/')
+        relpath++;
+
+    if (*relpath == '\0')
+        return UNIPRO_PROCFS_ROOT;
+
+    if (!strcmp(relpath, "link"))
+        return UNIPRO_PROCFS_LINK;
+
+    if (strncmp(relpath, "cport", 5) || relpath[5] < '0' || relpath[5] > '9')
+        return -ENOENT;
+
+    *cportid = strtoul(relpath + 5, &end, 10);
+    if (*cportid >= unipro_cport_count())
+        return -ENOENT;
+
+    if (*end == '/')
+        end++;
+
+    if (*end == '\0')
+        return UNIPRO_PROCFS_CPORT;
+
+    if (!strcmp(end, "stats"))
+        return UNIPRO_PROCFS_CPORT_STATS;
+
+    return -ENOENT;
+}
+
+static uint32_t unipro_procfs_avg(uint64_t total, uint32_t count)
+{
+    return count ? total / count : 0;
+}
+
+static size_t unipro_procfs_cport_stats(unsigned int cportid, char *buf,
+                                        size_t size)
+{
+    struct unipro_rx_stats rx;
+    struct unipro_tx_stats tx;
+
+    memset(&rx, 0, sizeof(rx));
+    memset(&tx, 0, sizeof(tx));
+    unipro_rx_get_stats(cportid, &rx);
+    unipro_tx_get_stats(cportid, &tx);
+
+    return snprintf(buf, size,
+                    "rx messages:     %u\n"
+                    "rx bytes:        %llu\n"
+                    "rx pauses:       %u\n"
+                    "rx paused (us):  %llu (max %u)\n"
+                    "rx pool misses:  %u\n"
+                    "tx messages:     %u\n"
+                    "tx bytes:        %llu\n"
+                    "tx queued:       %u (max %u)\n"
+                    "tx backpressure: %u\n"
+                    "tx delay (us):   %u (max %u)\n"
+                    "tx latency (us): %u (max %u)\n"
+                    "tx e2e stalls:   %u\n",
+                    rx.messages, rx.bytes, rx.pauses, rx.pause_time,
+                    rx.pause_time_max, rx.pool_misses,
+                    tx.messages, tx.bytes, tx.queue_depth, tx.queue_max,
+                    tx.backpressure,
+                    unipro_procfs_avg(tx.delay_total, tx.messages),
+                    tx.delay_max,
+                    unipro_procfs_avg(tx.latency_total, tx.messages),
+                    tx.latency_max, tx.stalls);
+}
+
+static const char *unipro_procfs_pwrmode(uint32_t mode)
+{
+    switch (mode) {
+    case UNIPRO_FAST_MODE:
+        return "fast";
+    case UNIPRO_SLOW_MODE:
+        return "slow";
+    case UNIPRO_FASTAUTO_MODE:
+        return "fastauto";
+    case UNIPRO_SLOWAUTO_MODE:
+        return "slowauto";
+    default:
+        return "unknown";
+    }
+}
+
+static size_t unipro_procfs_link(char *buf, size_t size)
+{
+    struct unipro_tx_channel_stats chan;
+    struct unipro_rx_stats rx;
+    struct unipro_tx_stats tx;
+    uint64_t rx_bytes = 0;
+    uint64_t tx_bytes = 0;
+    uint32_t rx_messages = 0;
+    uint32_t tx_messages = 0;
+    uint32_t rx_pauses = 0;
+    uint32_t tx_stalls = 0;
+    uint32_t pwrmode = 0;
+    uint32_t gear[2] = { 0 };
+    uint32_t lanes[2] = { 0 };
+    size_t len;
+    unsigned int i;
+
+    unipro_attr_local_read(PA_PWRMODE, &pwrmode, UNIPRO_SELINDEX_NULL);
+    unipro_attr_local_read(PA_TXGEAR, &gear[0], UNIPRO_SELINDEX_NULL);
+    unipro_attr_local_read(PA_RXGEAR, &gear[1], UNIPRO_SELINDEX_NULL);
+    unipro_attr_local_read(PA_ACTIVETXDATALANES, &lanes[0],
+                           UNIPRO_SELINDEX_NULL);
+    unipro_attr_local_read(PA_ACTIVERXDATALANES, &lanes[1],
+                           UNIPRO_SELINDEX_NULL);
+
+    for (i = 0; i < unipro_cport_count(); i++) {
+        if (!unipro_rx_get_stats(i, &rx)) {
+            rx_messages += rx.messages;
+            rx_bytes += rx.bytes;
+            rx_pauses += rx.pauses;
+        }
+
+        if (!unipro_tx_get_stats(i, &tx)) {
+            tx_messages += tx.messages;
+            tx_bytes += tx.bytes;
+            tx_stalls += tx.stalls;
+        }
+    }
+
+    /* PA_PWRMODE holds the RX mode in its high nibble */
+    len = snprintf(buf, size,
+                   "tx mode:         %s, gear %u, %u lane(s)\n"
+                   "rx mode:         %s, gear %u, %u lane(s)\n"
+                   "rx messages:     %u\n"
+                   "rx bytes:        %llu\n"
+                   "rx pauses:       %u\n"
+                   "tx messages:     %u\n"
+                   "tx bytes:        %llu\n"
+                   "tx e2e stalls:   %u\n",
+                   unipro_procfs_pwrmode(pwrmode & 0xf), gear[0], lanes[0],
+                   unipro_procfs_pwrmode(pwrmode >> 4), gear[1], lanes[1],
+                   rx_messages, rx_bytes, rx_pauses,
+                   tx_messages, tx_bytes, tx_stalls);
+
+    for (i = 0; len < size && !unipro_tx_get_channel_stats(i, &chan); i++) {
+        len += snprintf(buf + len, size - len,
+                        "dma%u:            %u ops, %llu bytes, "
+                        "%llu us busy\n",
+                        i, chan.ops, chan.bytes, chan.busy_time);
+    }
+
+    return MIN(len, size - 1);
+}
+
+static int unipro_procfs_open(struct file *filep, const char *relpath,
+                              int oflags, mode_t mode)
+{
+    struct unipro_procfs_file *priv;
+    unsigned int cportid = 0;
+    int node;
+
+    if ((oflags & O_WRONLY) != 0 || (oflags & O_RDONLY) == 0) {
+        fdbg("ERROR: Only O_RDONLY supported\n");
+        return -EACCES;
+    }
+
+    node = unipro_procfs_parse(relpath, &cportid);
+    if (node < 0)
+        return node;
+
+    if (node != UNIPRO_PROCFS_LINK && node != UNIPRO_PROCFS_CPORT_STATS)
+        return -EISDIR;
+
+    priv = kmm_zalloc(sizeof(*priv));
+    if (!priv)
+        return -ENOMEM;
+
+    priv->node = node;
+    priv->cportid = cportid;
+
+    filep->f_priv = priv;
+    return OK;
+}
+
+static int unipro_procfs_close(struct file *filep)
+{
+    kmm_free(filep->f_priv);
+    filep->f_priv = NULL;
+    return OK;
+}
+
+static ssize_t unipro_procfs_read(struct file *filep, char *buffer,
+                                  size_t buflen)
+{
+    struct unipro_procfs_file *priv = filep->f_priv;
+    off_t offset;
+    ssize_t ret;
+
+    DEBUGASSERT(priv);
+
+    /* Take a snapshot on the first read, so that the counters stay
+     * consistent when the file is read in several pieces */
+    if (filep->f_pos == 0) {
+        if (priv->node == UNIPRO_PROCFS_LINK) {
+            priv->len = unipro_procfs_link(priv->buf, sizeof(priv->buf));
+        } else {
+            priv->len = unipro_procfs_cport_stats(priv->cportid, priv->buf,
+                                                  sizeof(priv->buf));
+        }
+    }
+
+    offset = filep->f_pos;
+    ret = procfs_memcpy(priv->buf, priv->len, buffer, buflen, &offset);
+    if (ret > 0)
+        filep->f_pos += ret;
+
+    return ret;
+}
+
+static int unipro_procfs_dup(const struct file *oldp, struct file *newp)
+{
+    struct unipro_procfs_file *priv;
+
+    priv = kmm_malloc(sizeof(*priv));
+    if (!priv)
+        return -ENOMEM;
+
+    memcpy(priv, oldp->f_priv, sizeof(*priv));
+    newp->f_priv = priv;
+    return OK;
+}
+
+static int unipro_procfs_opendir(const char *relpath, struct fs_dirent_s *dir)
+{
+    struct unipro_procfs_dir *priv;
+    unsigned int cportid;
+    int node;
+
+    node = unipro_procfs_parse(relpath, &cportid);
+    if (node < 0)
+        return node;
+
+    if (node != UNIPRO_PROCFS_ROOT && node != UNIPRO_PROCFS_CPORT)
+        return -ENOTDIR;
+
+    priv = kmm_zalloc(sizeof(*priv));
+    if (!priv)
+        return -ENOMEM;
+
+    priv->node = node;
+    priv->base.level = node == UNIPRO_PROCFS_ROOT ? 1 : 2;
+    priv->base.nentries = node == UNIPRO_PROCFS_ROOT ?
+                            unipro_cport_count() + 1 : 1;
+
+    dir->u.procfs = priv;
+    return OK;
+}
+
+static int unipro_procfs_closedir(struct fs_dirent_s *dir)
+{
+    kmm_free(dir->u.procfs);
+    dir->u.procfs = NULL;
+    return OK;
+}
+
+static int unipro_procfs_readdir(struct fs_dirent_s *dir)
+{
+    struct unipro_procfs_dir *priv = dir->u.procfs;
+    unsigned int index = priv->base.index;
+
+    if (index >= priv->base.nentries)
+        return -ENOENT;
+
+    if (priv->node == UNIPRO_PROCFS_CPORT) {
+        dir->fd_dir.d_type = DTYPE_FILE;
+        strncpy(dir->fd_dir.d_name, "stats", NAME_MAX + 1);
+    } else if (index == 0) {
+        dir->fd_dir.d_type = DTYPE_FILE;
+        strncpy(dir->fd_dir.d_name, "link", NAME_MAX + 1);
+    } else {
+        dir->fd_dir.d_type = DTYPE_DIRECTORY;
+        snprintf(dir->fd_dir.d_name, NAME_MAX + 1, "cport%u", index - 1);
+    }
+
+    priv->base.index = index + 1;
+    return OK;
+}
+
+static int unipro_procfs_rewinddir(struct fs_dirent_s *dir)
+{
+    struct unipro_procfs_dir *priv = dir->u.procfs;
+
+    priv->base.index = 0;
+    return OK;
+}
+
+static int unipro_procfs_stat(const char *relpath, struct stat *buf)
+{
+    unsigned int cportid;
+    int node;
+
+    node = unipro_procfs_parse(relpath, &cportid);
+    if (node < 0)
+        return node;
+
+    memset(buf, 0, sizeof(*buf));
+    if (node == UNIPRO_PROCFS_ROOT || node == UNIPRO_PROCFS_CPORT)
+        buf->st_mode = S_IFDIR | S_IROTH | S_IRGRP | S_IRUSR;
+    else
+        buf->st_mode = S_IFREG | S_IROTH | S_IRGRP | S_IRUSR;
+
+    return OK;
+}
+
+#endif /* !CONFIG_DISABLE_MOUNTPOINT && CONFIG_FS_PROCFS */
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Atomic counters of the simulation, with the semantics of the ARM ones:
+ * every operation returns the new value.
+ */
+
+#ifndef __ARCH_SIM_INCLUDE_ATOMIC_H
+#define __ARCH_SIM_INCLUDE_ATOMIC_H
+
+#include <stdint.h>
+
+typedef volatile int atomic_t;
+
+static inline uint32_t atomic_get(atomic_t *atomic)
+{
+    return *(volatile uint32_t*) atomic;
+}
+
+static inline void atomic_init(atomic_t *atomic, uint32_t val)
+{
+    *atomic = (atomic_t) val;
+}
+
+static inline uint32_t atomic_add(atomic_t *atomic, int n)
+{
+    return __sync_add_and_fetch(atomic, n);
+}
+
+static inline uint32_t atomic_inc(atomic_t *atomic)
+{
+    return atomic_add(atomic, 1);
+}
+
+static inline uint32_t atomic_dec(atomic_t *atomic)
+{
+    return atomic_add(atomic, -1);
+}
+
+#endif /* __ARCH_SIM_INCLUDE_ATOMIC_H */
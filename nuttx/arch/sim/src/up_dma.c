@@ -0,0 +1,579 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/****************************************************************************
+ * Simulated DMA controller
+ *
+ * A device_dma driver for the simulation.  Each channel is a thread that
+ * copies the scatter-gather entries of its queued operations with memcpy()
+ * and runs their completion callback, the way the TSB DMA driver does from
+ * its completion thread.  Only memory to memory transfers are supported.
+ * A source that is not incremented repeats its first transfer_size bytes,
+ * which is how memset is done with DMA.
+ *
+ * Completions are batched like on the TSB: a channel thread copies all the
+ * ops queued when it wakes up, and holds back the callbacks of chained ops
+ * until the end of their chain.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arch/irq.h>
+#include <nuttx/list.h>
+#include <nuttx/util.h>
+#include <nuttx/device.h>
+#include <nuttx/device_table.h>
+#include <nuttx/device_dma.h>
+#include <nuttx/hires_tmr.h>
+
+#include "up_internal.h"
+
+/****************************************************************************
+ * Private Definitions
+ ****************************************************************************/
+
+/* Same limit as the TSB GDMAC, so that clients are exercised with it */
+
+#define SIM_DMA_SG_MAX        2
+
+#define SIM_DMA_STACK_SIZE    2048
+
+enum sim_dma_op_state
+{
+  SIM_DMA_OP_IDLE,
+  SIM_DMA_OP_QUEUED,
+  SIM_DMA_OP_RUNNING,
+  SIM_DMA_OP_COMPLETED,
+};
+
+struct sim_dma_chan
+{
+  struct device *dev;
+  bool allocated;
+  bool started;
+  bool src_fixed;             /* source is not incremented */
+  size_t transfer_size;       /* in bytes */
+  struct list_head queue;
+  struct list_head done;      /* copied, callbacks not delivered yet */
+  bool wakeup_pending;
+  sem_t ready;
+  pthread_t thread;
+  struct device_dma_chan_stats stats;
+};
+
+struct sim_dma_op
+{
+  struct list_head list;
+  enum sim_dma_op_state state;
+  enum device_dma_error error;
+  uint32_t complete_time;
+  struct device_dma_op op;    /* must be last, followed by the sg list */
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct sim_dma_chan g_sim_dma_chans[CONFIG_SIM_DMA_CHANNELS];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void sim_dma_fill(struct sim_dma_chan *chan, struct device_dma_sg *sg)
+{
+  const uint8_t *src = (const uint8_t *)(uintptr_t)sg->src_addr;
+  uint8_t *dst = (uint8_t *)(uintptr_t)sg->dst_addr;
+  size_t i;
+
+  if (chan->transfer_size == 1)
+    {
+      memset(dst, *src, sg->len);
+      return;
+    }
+
+  for (i = 0; i < sg->len; i++)
+    {
+      dst[i] = src[i % chan->transfer_size];
+    }
+}
+
+static void sim_dma_copy(struct sim_dma_chan *chan, struct device_dma_op *op)
+{
+  int i;
+
+  for (i = 0; i < op->sg_count; i++)
+    {
+      if (chan->src_fixed)
+        {
+          sim_dma_fill(chan, &op->sg[i]);
+        }
+      else
+        {
+          memcpy((void *)(uintptr_t)op->sg[i].dst_addr,
+                 (const void *)(uintptr_t)op->sg[i].src_addr,
+                 op->sg[i].len);
+        }
+    }
+}
+
+static unsigned int sim_dma_deliver(struct sim_dma_chan *chan)
+{
+  struct device_dma_chan_stats *stats = &chan->stats;
+  struct sim_dma_op *sop;
+  struct device_dma_op *op;
+  unsigned int count = 0;
+  unsigned int bucket;
+  uint32_t latency;
+
+  while (!list_is_empty(&chan->done))
+    {
+      sop = list_entry(chan->done.next, struct sim_dma_op, list);
+      list_del(&sop->list);
+      sop->state = SIM_DMA_OP_COMPLETED;
+
+      latency = hrt_getusec() - sop->complete_time;
+      bucket = 0;
+      while (bucket < DEVICE_DMA_LATENCY_BUCKETS - 1 &&
+             latency >= (1U << bucket))
+        {
+          bucket++;
+        }
+
+      stats->latency[bucket]++;
+      if (latency > stats->max_latency)
+        {
+          stats->max_latency = latency;
+        }
+
+      stats->completions++;
+      count++;
+
+      op = &sop->op;
+      if (op->callback &&
+          (op->callback_events & DEVICE_DMA_CALLBACK_EVENT_COMPLETE))
+        {
+          op->callback(chan->dev, chan, op,
+                       DEVICE_DMA_CALLBACK_EVENT_COMPLETE,
+                       op->callback_arg);
+        }
+    }
+
+  return count;
+}
+
+static void *sim_dma_chan_thread(void *arg)
+{
+  struct sim_dma_chan *chan = arg;
+  struct sim_dma_op *sop;
+  irqstate_t flags;
+  unsigned int batch;
+  bool chained;
+
+  while (1)
+    {
+      sem_wait(&chan->ready);
+
+      flags = irqsave();
+      chan->wakeup_pending = false;
+      irqrestore(flags);
+
+      /* Copy everything queued, including ops queued by the callbacks */
+
+      batch = 0;
+      while (1)
+        {
+          flags = irqsave();
+          if (list_is_empty(&chan->queue))
+            {
+              irqrestore(flags);
+              break;
+            }
+
+          sop = list_entry(chan->queue.next, struct sim_dma_op, list);
+          list_del(&sop->list);
+          sop->state = SIM_DMA_OP_RUNNING;
+          irqrestore(flags);
+
+          sim_dma_copy(chan, &sop->op);
+
+          sop->complete_time = hrt_getusec();
+          list_add(&chan->done, &sop->list);
+
+          /* A chained op is only reported with the end of its chain */
+
+          flags = irqsave();
+          chained = device_dma_op_chains(&sop->op,
+                                         DEVICE_DMA_CALLBACK_EVENT_COMPLETE,
+                                         !list_is_empty(&chan->queue));
+          irqrestore(flags);
+
+          if (!chained)
+            {
+              batch += sim_dma_deliver(chan);
+            }
+        }
+
+      if (batch > 0)
+        {
+          chan->stats.wakeups++;
+          if (batch > chan->stats.max_batch)
+            {
+              chan->stats.max_batch = batch;
+            }
+        }
+    }
+
+  return NULL;
+}
+
+static int sim_dma_get_caps(struct device *dev, struct device_dma_caps *caps)
+{
+  memset(caps, 0, sizeof(*caps));
+
+  caps->addr_alignment = 1;
+  caps->transfer_sizes = DEVICE_DMA_TRANSFER_SIZE_8 |
+                         DEVICE_DMA_TRANSFER_SIZE_16 |
+                         DEVICE_DMA_TRANSFER_SIZE_32 |
+                         DEVICE_DMA_TRANSFER_SIZE_64;
+  caps->inc_options = DEVICE_DMA_INC_AUTO | DEVICE_DMA_INC_NOAUTO;
+  caps->sg_max = SIM_DMA_SG_MAX;
+  return 0;
+}
+
+static int sim_dma_chan_free_count(struct device *dev)
+{
+  int count = 0;
+  int i;
+
+  for (i = 0; i < CONFIG_SIM_DMA_CHANNELS; i++)
+    {
+      if (!g_sim_dma_chans[i].allocated)
+        {
+          count++;
+        }
+    }
+
+  return count;
+}
+
+static int sim_dma_chan_alloc(struct device *dev,
+                              struct device_dma_params *params, void **chanp)
+{
+  struct sim_dma_chan *chan = NULL;
+  pthread_attr_t attr;
+  irqstate_t flags;
+  int ret;
+  int i;
+
+  if (params->src_dev != DEVICE_DMA_DEV_MEM ||
+      params->dst_dev != DEVICE_DMA_DEV_MEM ||
+      params->dst_inc_options != DEVICE_DMA_INC_AUTO)
+    {
+      return -EINVAL;
+    }
+
+  flags = irqsave();
+  for (i = 0; i < CONFIG_SIM_DMA_CHANNELS; i++)
+    {
+      if (!g_sim_dma_chans[i].allocated)
+        {
+          chan = &g_sim_dma_chans[i];
+          chan->allocated = true;
+          break;
+        }
+    }
+  irqrestore(flags);
+
+  if (!chan)
+    {
+      return -ENOMEM;
+    }
+
+  /* DEVICE_DMA_TRANSFER_SIZE_n is n / 8 */
+
+  chan->src_fixed = params->src_inc_options == DEVICE_DMA_INC_NOAUTO;
+  chan->transfer_size = params->transfer_size ? params->transfer_size : 1;
+  memset(&chan->stats, 0, sizeof(chan->stats));
+
+  /* The thread is kept when the channel is freed, start it only once */
+
+  if (!chan->started)
+    {
+      chan->dev = dev;
+      list_init(&chan->queue);
+      list_init(&chan->done);
+      sem_init(&chan->ready, 0, 0);
+      sem_setprotocol(&chan->ready, SEM_PRIO_NONE);
+
+      pthread_attr_init(&attr);
+      pthread_attr_setstacksize(&attr, SIM_DMA_STACK_SIZE);
+      ret = pthread_create(&chan->thread, &attr, sim_dma_chan_thread, chan);
+      pthread_attr_destroy(&attr);
+
+      if (ret)
+        {
+          sem_destroy(&chan->ready);
+          chan->allocated = false;
+          return -ret;
+        }
+
+      chan->started = true;
+    }
+
+  *chanp = chan;
+  return 0;
+}
+
+static int sim_dma_chan_free(struct device *dev, void *chan)
+{
+  struct sim_dma_chan *sim_chan = chan;
+
+  if (!sim_chan || !list_is_empty(&sim_chan->queue))
+    {
+      return -EBUSY;
+    }
+
+  sim_chan->allocated = false;
+  return 0;
+}
+
+static int sim_dma_op_alloc(struct device *dev, unsigned int sg_count,
+                            unsigned int extra, struct device_dma_op **opp)
+{
+  struct sim_dma_op *sop;
+
+  if (sg_count == 0 || sg_count > SIM_DMA_SG_MAX)
+    {
+      return -EINVAL;
+    }
+
+  sop = zalloc(sizeof(*sop) + sg_count * sizeof(struct device_dma_sg) +
+               extra);
+  if (!sop)
+    {
+      return -ENOMEM;
+    }
+
+  list_init(&sop->list);
+  sop->state = SIM_DMA_OP_IDLE;
+  sop->op.sg_count = sg_count;
+
+  *opp = &sop->op;
+  return 0;
+}
+
+static int sim_dma_op_free(struct device *dev, struct device_dma_op *op)
+{
+  struct sim_dma_op *sop = containerof(op, struct sim_dma_op, op);
+
+  if (sop->state == SIM_DMA_OP_QUEUED || sop->state == SIM_DMA_OP_RUNNING)
+    {
+      return -EBUSY;
+    }
+
+  free(sop);
+  return 0;
+}
+
+static int sim_dma_op_is_complete(struct device *dev,
+                                  struct device_dma_op *op)
+{
+  struct sim_dma_op *sop = containerof(op, struct sim_dma_op, op);
+
+  return sop->state == SIM_DMA_OP_COMPLETED;
+}
+
+static int sim_dma_op_get_error(struct device *dev, struct device_dma_op *op,
+                                enum device_dma_error *error)
+{
+  struct sim_dma_op *sop = containerof(op, struct sim_dma_op, op);
+
+  *error = sop->error;
+  return 0;
+}
+
+static int sim_dma_enqueue(struct device *dev, void *chan,
+                           struct device_dma_op *op)
+{
+  struct sim_dma_chan *sim_chan = chan;
+  struct sim_dma_op *sop;
+  irqstate_t flags;
+
+  if (!sim_chan || !op || op->sg_count > SIM_DMA_SG_MAX)
+    {
+      return -EINVAL;
+    }
+
+  sop = containerof(op, struct sim_dma_op, op);
+
+  /* Completed ops can be queued again, like on the TSB DMA */
+
+  flags = irqsave();
+  if (sop->state == SIM_DMA_OP_QUEUED || sop->state == SIM_DMA_OP_RUNNING)
+    {
+      irqrestore(flags);
+      return -EBUSY;
+    }
+
+  list_add(&sim_chan->queue, &sop->list);
+  sop->state = SIM_DMA_OP_QUEUED;
+  sop->error = DEVICE_DMA_ERROR_NONE;
+
+  /* The thread drains the whole queue, one wakeup is enough */
+
+  if (!sim_chan->wakeup_pending)
+    {
+      sim_chan->wakeup_pending = true;
+      sem_post(&sim_chan->ready);
+    }
+
+  irqrestore(flags);
+  return 0;
+}
+
+static int sim_dma_dequeue(struct device *dev, void *chan,
+                           struct device_dma_op *op)
+{
+  struct sim_dma_op *sop = containerof(op, struct sim_dma_op, op);
+  irqstate_t flags;
+
+  flags = irqsave();
+  if (sop->state != SIM_DMA_OP_QUEUED)
+    {
+      irqrestore(flags);
+      return -EBUSY;
+    }
+
+  list_del(&sop->list);
+  sop->state = SIM_DMA_OP_IDLE;
+  irqrestore(flags);
+
+  if (op->callback &&
+      (op->callback_events & DEVICE_DMA_CALLBACK_EVENT_DEQUEUED))
+    {
+      op->callback(dev, chan, op, DEVICE_DMA_CALLBACK_EVENT_DEQUEUED,
+                   op->callback_arg);
+    }
+
+  return 0;
+}
+
+static int sim_dma_chan_get_stats(struct device *dev, void *chan,
+                                  struct device_dma_chan_stats *stats)
+{
+  struct sim_dma_chan *sim_chan = chan;
+  irqstate_t flags;
+
+  if (!sim_chan || !stats)
+    {
+      return -EINVAL;
+    }
+
+  flags = irqsave();
+  memcpy(stats, &sim_chan->stats, sizeof(*stats));
+  irqrestore(flags);
+  return 0;
+}
+
+static struct device_dma_type_ops g_sim_dma_type_ops =
+{
+  .get_caps        = sim_dma_get_caps,
+  .chan_free_count = sim_dma_chan_free_count,
+  .chan_alloc      = sim_dma_chan_alloc,
+  .chan_free       = sim_dma_chan_free,
+  .op_alloc        = sim_dma_op_alloc,
+  .op_free         = sim_dma_op_free,
+  .op_is_complete  = sim_dma_op_is_complete,
+  .op_get_error    = sim_dma_op_get_error,
+  .enqueue         = sim_dma_enqueue,
+  .dequeue         = sim_dma_dequeue,
+  .chan_get_stats  = sim_dma_chan_get_stats,
+};
+
+static struct device_driver_ops g_sim_dma_driver_ops =
+{
+  .type_ops = &g_sim_dma_type_ops,
+};
+
+static struct device_driver g_sim_dma_driver =
+{
+  .type = DEVICE_TYPE_DMA_HW,
+  .name = "sim_dma",
+  .desc = "Simulated DMA controller",
+  .ops  = &g_sim_dma_driver_ops,
+};
+
+static struct device g_sim_dma_devices[] =
+{
+  {
+    .type = DEVICE_TYPE_DMA_HW,
+    .name = "sim_dma",
+    .desc = "Simulated DMA controller",
+    .id   = 0,
+  },
+};
+
+static struct device_table g_sim_dma_table =
+{
+  .device       = g_sim_dma_devices,
+  .device_count = ARRAY_SIZE(g_sim_dma_devices),
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: up_dma_initialize
+ *
+ * Description:
+ *   Register the simulated DMA controller.  The channel threads are only
+ *   created when the channels are allocated, once the OS is running.
+ *
+ ****************************************************************************/
+
+void up_dma_initialize(void)
+{
+  device_table_register(&g_sim_dma_table);
+  device_register_driver(&g_sim_dma_driver);
+}
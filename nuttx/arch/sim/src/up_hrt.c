@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <time.h>
+
+#include <nuttx/hires_tmr.h>
+
+#include "up_internal.h"
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Host time of the first call, the timer counts from there */
+
+static unsigned long long g_hrt_base;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static unsigned long long up_hrt_elapsed(void)
+{
+  unsigned long long now = up_hostusec();
+
+  if (g_hrt_base == 0)
+    {
+      g_hrt_base = now;
+    }
+
+  return now - g_hrt_base;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: hrt_gettimespec
+ ****************************************************************************/
+
+void hrt_gettimespec(struct timespec *ts)
+{
+  unsigned long long usec = up_hrt_elapsed();
+
+  ts->tv_sec  = (time_t)(usec / 1000000);
+  ts->tv_nsec = (long)(usec % 1000000) * 1000;
+}
+
+/****************************************************************************
+ * Name: hrt_getusec
+ *
+ * Description:
+ *   Microseconds since the timer started, wraps around like the hardware
+ *   implementations do.
+ *
+ ****************************************************************************/
+
+uint32_t hrt_getusec(void)
+{
+  return (uint32_t)up_hrt_elapsed();
+}
+
+/****************************************************************************
+ * Name: hrt_clear_rollover
+ ****************************************************************************/
+
+void hrt_clear_rollover(void)
+{
+}
@@ -43,6 +43,7 @@
 
 #include <nuttx/arch.h>
 #include <nuttx/fs/fs.h>
+#include <nuttx/sched_note.h>
 #include <nuttx/fs/ioctl.h>
 #include <nuttx/mtd/mtd.h>
 #include <nuttx/syslog/ramlog.h>
@@ -134,6 +135,10 @@ void up_initialize(void)
   devzero_register();   /* Standard /dev/zero */
 #endif
 
+#if defined(CONFIG_SCHED_NOTE_BUFFER)
+  sched_note_register(); /* Scheduler notes */
+#endif
+
 #endif /* CONFIG_NFILE_DESCRIPTORS */
 
   /* Register a console (or not) */
@@ -162,4 +167,8 @@ void up_initialize(void)
 #if defined(CONFIG_FS_SMARTFS) && defined(CONFIG_SIM_SPIFLASH)
   up_init_smartfs();
 #endif
+
+#ifdef CONFIG_SIM_DMA
+  up_dma_initialize();      /* Simulated DMA controller */
+#endif
 }
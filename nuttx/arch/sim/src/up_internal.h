@@ -159,6 +159,18 @@ void up_longjmp(int *jb, int val) noreturn_function;
 void up_timer_update(void);
 #endif
 
+/* up_hosttime.c **********************************************************/
+
+#ifdef CONFIG_SIM_HIRES_TIMER
+unsigned long long up_hostusec(void);
+#endif
+
+/* up_dma.c ***************************************************************/
+
+#ifdef CONFIG_SIM_DMA
+void up_dma_initialize(void);
+#endif
+
 /* up_devconsole.c ********************************************************/
 
 void up_devconsole(void);
@@ -0,0 +1,638 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arch/irq.h>
+#include <debug.h>
+#include <nuttx/unipro/unipro.h>
+
+#ifdef CONFIG_SIM_UNIPRO_DMA
+#  include <nuttx/device.h>
+#  include <nuttx/device_dma.h>
+#  include <nuttx/dma_memcpy.h>
+#  include <nuttx/hires_tmr.h>
+#endif
+
+#include "up_internal.h"
+
+/****************************************************************************
+ * Private Definitions
+ ****************************************************************************/
+
+/* CPorts are connected in pairs: 0 <-> 1, 2 <-> 3, ... */
+
+#define CPORT_PEER(cportid)   ((cportid) ^ 1)
+
+#ifdef CONFIG_SIM_UNIPRO_DMA
+struct sim_unipro_dma_channel
+{
+  void *chan;
+  unsigned int inflight;
+  uint32_t busy_since;
+  struct unipro_tx_channel_stats stats;
+};
+
+/* A message copied by DMA into a bounce buffer, delivered on completion */
+
+struct sim_unipro_dma_xfer
+{
+  unsigned int cportid;
+  struct sim_unipro_dma_channel *channel;
+  const void *buf;
+  size_t len;
+  unipro_send_completion_t callback;
+  void *priv;
+  sem_t *done;
+  int status;
+  char data[0];
+};
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct unipro_driver *g_drvs[CONFIG_SIM_UNIPRO_CPORT_COUNT];
+
+#ifdef CONFIG_SIM_UNIPRO_DMA
+static struct device *g_dma_dev;
+static struct sim_unipro_dma_channel
+  g_dma_channels[CONFIG_SIM_UNIPRO_DMA_CHANNELS];
+static unsigned int g_dma_channel_count;
+
+/* CPorts keep their channel while messages are in flight, to stay ordered */
+
+static struct sim_unipro_dma_channel
+  *g_cport_channel[CONFIG_SIM_UNIPRO_CPORT_COUNT];
+static unsigned int g_cport_inflight[CONFIG_SIM_UNIPRO_CPORT_COUNT];
+
+/* Set while a DMA completion delivers a message to its receiver */
+
+static bool g_dma_delivering;
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Deliver a message to the driver listening on the peer CPort */
+
+static int sim_unipro_deliver(unsigned int cportid, const void *buf,
+                              size_t len)
+{
+  struct unipro_driver *drv;
+  irqstate_t flags;
+  int ret;
+
+  flags = irqsave();
+
+  drv = g_drvs[CPORT_PEER(cportid)];
+  if (!drv)
+    {
+      irqrestore(flags);
+      return -ENOTCONN;
+    }
+
+  ret = drv->rx_handler(CPORT_PEER(cportid), (void *)buf, len);
+
+  irqrestore(flags);
+  return ret < 0 ? ret : 0;
+}
+
+static int sim_unipro_check_cport(unsigned int cportid)
+{
+  if (cportid >= CONFIG_SIM_UNIPRO_CPORT_COUNT ||
+      CPORT_PEER(cportid) >= CONFIG_SIM_UNIPRO_CPORT_COUNT)
+    {
+      return -EINVAL;
+    }
+
+  return 0;
+}
+
+#ifdef CONFIG_SIM_UNIPRO_DMA
+static void sim_unipro_dma_init(void)
+{
+  struct device_dma_params params =
+    {
+      .src_dev = DEVICE_DMA_DEV_MEM,
+      .src_devid = 0,
+      .src_inc_options = DEVICE_DMA_INC_AUTO,
+      .dst_dev = DEVICE_DMA_DEV_MEM,
+      .dst_devid = 0,
+      .dst_inc_options = DEVICE_DMA_INC_AUTO,
+      .transfer_size = DEVICE_DMA_TRANSFER_SIZE_64,
+      .burst_len = DEVICE_DMA_BURST_LEN_16,
+      .swap = DEVICE_DMA_SWAP_SIZE_NONE,
+    };
+  int i;
+
+  if (g_dma_dev)
+    {
+      return;
+    }
+
+  g_dma_dev = device_open(DEVICE_TYPE_DMA_HW, 0);
+  if (!g_dma_dev)
+    {
+      lldbg("unable to open the DMA device, sending without DMA\n");
+      return;
+    }
+
+  for (i = 0; i < CONFIG_SIM_UNIPRO_DMA_CHANNELS; i++)
+    {
+      if (device_dma_chan_alloc(g_dma_dev, &params,
+                                &g_dma_channels[i].chan))
+        {
+          break;
+        }
+    }
+
+  g_dma_channel_count = i;
+  if (!g_dma_channel_count)
+    {
+      device_close(g_dma_dev);
+      g_dma_dev = NULL;
+      return;
+    }
+
+#ifdef CONFIG_DMA_MEMCPY
+  /* The DMA device can only be opened once, share it */
+
+  dma_memcpy_init(g_dma_dev);
+#endif
+}
+
+/* Must be called with interrupts disabled */
+
+static struct sim_unipro_dma_channel *
+sim_unipro_dma_pick(unsigned int cportid)
+{
+  struct sim_unipro_dma_channel *best;
+  int i;
+
+  if (g_cport_inflight[cportid])
+    {
+      return g_cport_channel[cportid];
+    }
+
+  best = &g_dma_channels[0];
+  for (i = 1; i < g_dma_channel_count; i++)
+    {
+      if (g_dma_channels[i].inflight < best->inflight)
+        {
+          best = &g_dma_channels[i];
+        }
+    }
+
+  return best;
+}
+
+static int sim_unipro_dma_callback(struct device *dev, void *chan,
+                                   struct device_dma_op *op,
+                                   unsigned int event, void *arg)
+{
+  struct sim_unipro_dma_xfer *xfer = arg;
+  struct sim_unipro_dma_channel *channel = xfer->channel;
+  irqstate_t flags;
+
+  device_dma_op_free(dev, op);
+
+  flags = irqsave();
+
+  g_dma_delivering = true;
+  xfer->status = sim_unipro_deliver(xfer->cportid, xfer->data, xfer->len);
+  g_dma_delivering = false;
+
+  channel->stats.ops++;
+  channel->stats.bytes += xfer->len;
+  if (!--channel->inflight)
+    {
+      channel->stats.busy_time += hrt_getusec() - channel->busy_since;
+    }
+
+  g_cport_inflight[xfer->cportid]--;
+
+  irqrestore(flags);
+
+  if (xfer->done)
+    {
+      sem_post(xfer->done);
+      return 0;
+    }
+
+  if (xfer->callback)
+    {
+      xfer->callback(xfer->status, xfer->buf, xfer->priv);
+    }
+
+  free(xfer);
+  return 0;
+}
+
+/****************************************************************************
+ * Name: sim_unipro_dma_send
+ *
+ * Description:
+ *   Copy the segments into a bounce buffer on a DMA channel, one scatter-
+ *   gather entry per segment, and deliver the message when the copy is
+ *   complete.  When done is given, the caller waits on it and frees the
+ *   transfer, otherwise the completion callback is called.
+ *
+ ****************************************************************************/
+
+static int sim_unipro_dma_send(unsigned int cportid,
+                               const struct unipro_iovec *iov, size_t iovcnt,
+                               unipro_send_completion_t callback, void *priv,
+                               sem_t *done, struct sim_unipro_dma_xfer **xferp)
+{
+  struct sim_unipro_dma_channel *channel;
+  struct sim_unipro_dma_xfer *xfer;
+  struct device_dma_op *op;
+  irqstate_t flags;
+  size_t len = 0;
+  int ret;
+  int i;
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      len += iov[i].len;
+    }
+
+  xfer = zalloc(sizeof(*xfer) + len);
+  if (!xfer)
+    {
+      return -ENOMEM;
+    }
+
+  ret = device_dma_op_alloc(g_dma_dev, iovcnt, 0, &op);
+  if (ret)
+    {
+      free(xfer);
+      return ret;
+    }
+
+  xfer->cportid = cportid;
+  xfer->buf = iov[0].base;
+  xfer->len = len;
+  xfer->callback = callback;
+  xfer->priv = priv;
+  xfer->done = done;
+
+  for (len = 0, i = 0; i < iovcnt; i++)
+    {
+      op->sg[i].src_addr = (off_t)(uintptr_t)iov[i].base;
+      op->sg[i].dst_addr = (off_t)(uintptr_t)(xfer->data + len);
+      op->sg[i].len = iov[i].len;
+      len += iov[i].len;
+    }
+
+  op->callback = sim_unipro_dma_callback;
+  op->callback_arg = xfer;
+  op->callback_events = DEVICE_DMA_CALLBACK_EVENT_COMPLETE;
+
+  flags = irqsave();
+
+  channel = sim_unipro_dma_pick(cportid);
+  xfer->channel = channel;
+
+  ret = device_dma_enqueue(g_dma_dev, channel->chan, op);
+  if (ret)
+    {
+      irqrestore(flags);
+      device_dma_op_free(g_dma_dev, op);
+      free(xfer);
+      return ret;
+    }
+
+  if (!channel->inflight++)
+    {
+      channel->busy_since = hrt_getusec();
+    }
+
+  g_cport_channel[cportid] = channel;
+  g_cport_inflight[cportid]++;
+
+  if (xferp)
+    {
+      *xferp = xfer;
+    }
+
+  irqrestore(flags);
+  return 0;
+}
+
+/* Send through DMA and wait for the message to be delivered */
+
+static int sim_unipro_dma_send_sync(unsigned int cportid,
+                                    const struct unipro_iovec *iov,
+                                    size_t iovcnt)
+{
+  struct sim_unipro_dma_xfer *xfer;
+  sem_t done;
+  int ret;
+
+  sem_init(&done, 0, 0);
+  sem_setprotocol(&done, SEM_PRIO_NONE);
+
+  ret = sim_unipro_dma_send(cportid, iov, iovcnt, NULL, NULL, &done, &xfer);
+  if (!ret)
+    {
+      while (sem_wait(&done) < 0);
+      ret = xfer->status;
+      free(xfer);
+    }
+
+  sem_destroy(&done);
+  return ret;
+}
+
+/* Without DMA, or from a receive handler run by a DMA completion (which
+ * could otherwise wait on its own channel), messages are sent directly.
+ */
+
+static bool sim_unipro_use_dma(void)
+{
+  return g_dma_dev && !g_dma_delivering;
+}
+#endif /* CONFIG_SIM_UNIPRO_DMA */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+unsigned int unipro_cport_count(void)
+{
+  return CONFIG_SIM_UNIPRO_CPORT_COUNT;
+}
+
+void unipro_init(void)
+{
+#ifdef CONFIG_SIM_UNIPRO_DMA
+  sim_unipro_dma_init();
+#endif
+}
+
+void unipro_deinit(void)
+{
+  int i;
+
+  for (i = 0; i < CONFIG_SIM_UNIPRO_CPORT_COUNT; i++)
+    {
+      unipro_driver_unregister(i);
+    }
+}
+
+void unipro_info(void)
+{
+}
+
+/****************************************************************************
+ * Name: unipro_send
+ *
+ * Description:
+ *   Deliver a message to the driver listening on the peer CPort.  The
+ *   receive handler runs synchronously, from the caller context, like it
+ *   would from the RX interrupt.  With SIM_UNIPRO_DMA, it runs from the
+ *   DMA channel thread once the message is copied and the caller waits.
+ *   The buffer is only lent to the handler (there is no UNIPRO_ZERO_COPY on
+ *   the simulation), so unipro_rxbuf_free() has nothing to do.
+ *
+ ****************************************************************************/
+
+int unipro_send(unsigned int cportid, const void *buf, size_t len)
+{
+  int ret;
+
+  ret = sim_unipro_check_cport(cportid);
+  if (ret)
+    {
+      return ret;
+    }
+
+#ifdef CONFIG_SIM_UNIPRO_DMA
+  if (sim_unipro_use_dma())
+    {
+      struct unipro_iovec iov =
+        {
+          .base = buf,
+          .len = len,
+        };
+
+      return sim_unipro_dma_send_sync(cportid, &iov, 1);
+    }
+#endif
+
+  return sim_unipro_deliver(cportid, buf, len);
+}
+
+int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
+                      unipro_send_completion_t callback, void *priv)
+{
+  int ret;
+
+#ifdef CONFIG_SIM_UNIPRO_DMA
+  if (sim_unipro_check_cport(cportid) == 0 && sim_unipro_use_dma())
+    {
+      struct unipro_iovec iov =
+        {
+          .base = buf,
+          .len = len,
+        };
+
+      return sim_unipro_dma_send(cportid, &iov, 1, callback, priv, NULL,
+                                 NULL);
+    }
+#endif
+
+  ret = unipro_send(cportid, buf, len);
+  if (ret == 0 && callback)
+    {
+      callback(0, buf, priv);
+    }
+
+  return ret;
+}
+
+int unipro_send_batch(unsigned int cportid, const void **bufs,
+                      const size_t *lens, size_t count)
+{
+  int ret;
+  int i;
+
+  for (i = 0; i < count; i++)
+    {
+      ret = unipro_send(cportid, bufs[i], lens[i]);
+      if (ret < 0)
+        {
+          return ret;
+        }
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: unipro_send_iov
+ *
+ * Description:
+ *   The receive handlers want a contiguous message, so gather the segments
+ *   the way the hardware TX buffer would.
+ *
+ ****************************************************************************/
+
+int unipro_send_iov(unsigned int cportid, const struct unipro_iovec *iov,
+                    size_t iovcnt)
+{
+  size_t len = 0;
+  char *buf;
+  int ret;
+  int i;
+
+  if (iovcnt == 0 || iovcnt > UNIPRO_IOV_MAX)
+    {
+      return -EINVAL;
+    }
+
+#ifdef CONFIG_SIM_UNIPRO_DMA
+  if (sim_unipro_check_cport(cportid) == 0 && sim_unipro_use_dma())
+    {
+      return sim_unipro_dma_send_sync(cportid, iov, iovcnt);
+    }
+#endif
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      len += iov[i].len;
+    }
+
+  buf = malloc(len);
+  if (!buf)
+    {
+      return -ENOMEM;
+    }
+
+  for (len = 0, i = 0; i < iovcnt; i++)
+    {
+      memcpy(buf + len, iov[i].base, iov[i].len);
+      len += iov[i].len;
+    }
+
+  ret = unipro_send(cportid, buf, len);
+
+  free(buf);
+  return ret;
+}
+
+int unipro_driver_register(struct unipro_driver *drv, unsigned int cportid)
+{
+  if (cportid >= CONFIG_SIM_UNIPRO_CPORT_COUNT)
+    {
+      return -EINVAL;
+    }
+
+  if (g_drvs[cportid])
+    {
+      return -EADDRINUSE;
+    }
+
+  g_drvs[cportid] = drv;
+  return 0;
+}
+
+int unipro_driver_unregister(unsigned int cportid)
+{
+  if (cportid >= CONFIG_SIM_UNIPRO_CPORT_COUNT || !g_drvs[cportid])
+    {
+      return -EINVAL;
+    }
+
+  g_drvs[cportid] = NULL;
+  return 0;
+}
+
+void unipro_rxbuf_free(unsigned int cportid, void *ptr)
+{
+}
+
+int unipro_rxbuf_set_pool_depth(unsigned int cportid, unsigned int depth)
+{
+  return -ENOSYS;
+}
+
+int unipro_rx_get_stats(unsigned int cportid, struct unipro_rx_stats *stats)
+{
+  return -ENOSYS;
+}
+
+int unipro_tx_set_priority(unsigned int cportid, unsigned int priority,
+                           unsigned int weight)
+{
+  return -ENOSYS;
+}
+
+int unipro_tx_get_stats(unsigned int cportid, struct unipro_tx_stats *stats)
+{
+  return -ENOSYS;
+}
+
+int unipro_tx_get_channel_stats(unsigned int channel,
+                                struct unipro_tx_channel_stats *stats)
+{
+#ifdef CONFIG_SIM_UNIPRO_DMA
+  irqstate_t flags;
+
+  if (channel >= g_dma_channel_count || !stats)
+    {
+      return -EINVAL;
+    }
+
+  flags = irqsave();
+  memcpy(stats, &g_dma_channels[channel].stats, sizeof(*stats));
+  if (g_dma_channels[channel].inflight)
+    {
+      stats->busy_time += hrt_getusec() - g_dma_channels[channel].busy_since;
+    }
+  irqrestore(flags);
+
+  return 0;
+#else
+  return -ENOSYS;
+#endif
+}
@@ -30,6 +30,7 @@
 #define _APBRIDGEA_GADGET_H_
 
 #include <sys/types.h>
+#include <stdint.h>
 
 struct apbridge_dev_s;
 
@@ -38,6 +39,16 @@ enum ep_mapping {
     DIRECT_EP,
 };
 
+/** Utilization of a pair of bulk endpoints */
+struct apbridge_ep_stats {
+    uint32_t in_messages;   /**< messages sent to the AP */
+    uint32_t in_bytes;      /**< bytes sent to the AP */
+    uint32_t in_pending;    /**< bytes queued or being sent to the AP */
+    uint32_t out_messages;  /**< messages received from the AP */
+    uint32_t out_bytes;     /**< bytes received from the AP */
+    unsigned int cports;    /**< CPorts currently sent on the IN endpoint */
+};
+
 struct apbridge_usb_driver
 {
     int (*usb_to_unipro)(struct apbridge_dev_s *dev, unsigned int cportid,
@@ -56,4 +67,8 @@ int usbdev_apbinitialize(struct device *dev,
 
 int usb_release_buffer(struct apbridge_dev_s *priv, const void *buf);
 
+unsigned int apbridge_ep_count(void);
+int apbridge_get_ep_stats(struct apbridge_dev_s *priv, unsigned int n,
+                          struct apbridge_ep_stats *stats);
+
 #endif /* _APBRIDGEA_GADGET_H_ */
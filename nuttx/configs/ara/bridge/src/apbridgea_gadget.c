@@ -53,6 +53,7 @@
 #include <fcntl.h>
 
 #include <nuttx/list.h>
+#include <nuttx/clock.h>
 #include <nuttx/kmalloc.h>
 #include <nuttx/arch.h>
 #include <nuttx/serial/serial.h>
@@ -119,10 +120,53 @@
 
 #define BULKEP_TO_N(ep) \
   ((USB_EPNO(ep->eplog) - CONFIG_APBRIDGE_EPBULKOUT) >> 1)
+#define BULKINEP_TO_N(ep) \
+  ((USB_EPNO(ep->eplog) - CONFIG_APBRIDGE_EPBULKIN) >> 1)
 
-#define APBRIDGE_NREQS               (1)
 #define APBRIDGE_REQ_SIZE            (2048)
 
+/*
+ * IN requests have no buffer of their own, they point at the UniPro RX
+ * buffer. This also keeps them in a different pool than the OUT requests.
+ */
+#define APBRIDGE_EPIN_REQ_SIZE       (0)
+
+/* Requests kept in flight on each bulk endpoint */
+
+#ifdef CONFIG_APBRIDGE_EPOUT_NREQS
+#define APBRIDGE_EPOUT_NREQS         CONFIG_APBRIDGE_EPOUT_NREQS
+#else
+#define APBRIDGE_EPOUT_NREQS         (2)
+#endif
+
+/* The requests of an endpoint must fit in the UniPro TX queue of a CPort */
+
+#if defined(CONFIG_ARCH_UNIPROTX_USE_DMA) && \
+    APBRIDGE_EPOUT_NREQS > CONFIG_ARCH_UNIPROTX_DESCS_PER_CPORT
+#error "APBRIDGE_EPOUT_NREQS can't exceed ARCH_UNIPROTX_DESCS_PER_CPORT"
+#endif
+
+#ifdef CONFIG_APBRIDGE_EPIN_NREQS
+#define APBRIDGE_EPIN_NREQS          CONFIG_APBRIDGE_EPIN_NREQS
+#else
+#define APBRIDGE_EPIN_NREQS          (2)
+#endif
+
+#define EPIN_N_TO_EPNO(n)            (CONFIG_APBRIDGE_EPBULKIN + ((n) << 1))
+
+#ifdef CONFIG_APBRIDGE_EP_BALANCE
+/* The traffic seen on an IN endpoint is halved every APBRIDGE_LOAD_PERIOD */
+#define APBRIDGE_LOAD_PERIOD         max(MSEC2TICK(20), 1)
+#endif
+
+/* Messages waiting for a free IN request */
+
+#ifdef CONFIG_APBRIDGE_MSG_POOL_SIZE
+#define APBRIDGE_MSG_POOL_SIZE       CONFIG_APBRIDGE_MSG_POOL_SIZE
+#else
+#define APBRIDGE_MSG_POOL_SIZE       (32)
+#endif
+
 #define APBRIDGE_CONFIG_ATTR \
   USB_CONFIG_ATTR_ONE | \
   USB_CONFIG_ATTR_SELFPOWER | \
@@ -189,6 +233,11 @@
  * Private Types
  ****************************************************************************/
 
+/*
+ * Tracks a UniPro RX buffer waiting for an IN request. The buffer itself is
+ * handed to the USB controller as is, so only this small descriptor is needed
+ * and it comes from a pool owned by the device.
+ */
 struct apbridge_msg_s {
     struct list_head list;
     struct usbdev_ep_s *ep;
@@ -208,9 +257,20 @@ struct apbridge_dev_s {
 
     struct usbdev_ep_s *ep[APBRIDGE_MAX_ENDPOINTS];
 
-    struct list_head msg_queue;
+    struct apbridge_msg_s msg_pool[APBRIDGE_MSG_POOL_SIZE];
+    struct list_head msg_free;
+    struct list_head msg_queue[APBRIDGE_NBULKS];
+    unsigned int epin_inflight[APBRIDGE_NBULKS];
+    struct apbridge_ep_stats ep_stats[APBRIDGE_NBULKS];
 
     int *cport_to_epin_n;
+    uint16_t *cport_pending;    /* messages queued or being sent to the AP */
+#ifdef CONFIG_APBRIDGE_EP_BALANCE
+    uint8_t *cport_epin_host;   /* IN endpoint requested by the AP */
+    unsigned int epin_direct[APBRIDGE_NBULKS];
+    uint32_t epin_load[APBRIDGE_NBULKS];
+    uint32_t epin_load_time[APBRIDGE_NBULKS];
+#endif
     struct gb_timestamp *ts;
     int epout_to_cport_n[APBRIDGE_NBULKS];
 
@@ -399,46 +459,155 @@ static unsigned int get_cportid(const struct gb_operation_hdr *hdr)
     return hdr->pad[0];
 }
 
+#ifdef CONFIG_APBRIDGE_EP_BALANCE
+static uint32_t apbridge_epin_load(struct apbridge_dev_s *priv, unsigned int n)
+{
+    uint32_t periods;
+
+    periods = (clock_systimer() - priv->epin_load_time[n]) /
+              APBRIDGE_LOAD_PERIOD;
+    if (periods) {
+        priv->epin_load[n] = periods < 32 ? priv->epin_load[n] >> periods : 0;
+        priv->epin_load_time[n] += periods * APBRIDGE_LOAD_PERIOD;
+    }
+
+    return priv->epin_load[n];
+}
+
+/**
+ * @brief Move an idle multiplexed CPort to the least loaded IN endpoint
+ * CPorts the AP mapped to the multiplexed endpoint may be sent on any IN
+ * endpoint not dedicated to another CPort, since the AP gets the CPort id
+ * from the header pad bytes. A CPort only moves when nothing is pending for
+ * it, so that its messages never get reordered across endpoints.
+ * Must be called with interrupts disabled.
+ * @param priv usb device.
+ * @param cportid CPort about to send a message.
+ */
+static void apbridge_balance_cport(struct apbridge_dev_s *priv,
+                                   unsigned int cportid)
+{
+    unsigned int best;
+    unsigned int n;
+    uint32_t load;
+    uint32_t best_load;
+
+    if (priv->cport_epin_host[cportid] != CONFIG_APBRIDGE_EPBULKIN ||
+        priv->cport_pending[cportid]) {
+        return;
+    }
+
+    best = ((priv->cport_to_epin_n[cportid] & USB_EPNO_MASK) -
+            CONFIG_APBRIDGE_EPBULKIN) >> 1;
+    if (best >= APBRIDGE_NBULKS || priv->epin_direct[best]) {
+        best = 0;
+    }
+    best_load = apbridge_epin_load(priv, best) +
+                priv->ep_stats[best].in_pending;
+
+    for (n = 0; n < APBRIDGE_NBULKS; n++) {
+        if (priv->epin_direct[n]) {
+            continue;
+        }
+
+        load = apbridge_epin_load(priv, n) + priv->ep_stats[n].in_pending;
+        if (load < best_load) {
+            best = n;
+            best_load = load;
+        }
+    }
+
+    priv->cport_to_epin_n[cportid] = EPIN_N_TO_EPNO(best);
+}
+#endif
+
+/*
+ * Account a message from UniPro, from the time it is accepted until its
+ * IN transfer completes or it is dropped. Must be called with interrupts
+ * disabled.
+ */
+static void apbridge_epin_get(struct apbridge_dev_s *priv, unsigned int n,
+                              unsigned int cportid, size_t len)
+{
+    priv->ep_stats[n].in_pending += len;
+    priv->cport_pending[cportid]++;
+#ifdef CONFIG_APBRIDGE_EP_BALANCE
+    apbridge_epin_load(priv, n);
+    priv->epin_load[n] += len;
+#endif
+}
+
+static void apbridge_epin_put(struct apbridge_dev_s *priv, unsigned int n,
+                              unsigned int cportid, size_t len)
+{
+    priv->ep_stats[n].in_pending -= len;
+    priv->cport_pending[cportid]--;
+}
+
 static int apbridge_queue(struct apbridge_dev_s *priv, struct usbdev_ep_s *ep,
                           const void *payload, size_t len, void *data)
 {
     irqstate_t flags;
     struct apbridge_msg_s *info;
 
-    info = malloc(sizeof(*info));
-    if (!info) {
+    flags = irqsave();
+    if (list_is_empty(&priv->msg_free)) {
+        irqrestore(flags);
         return -ENOMEM;
     }
 
+    info = list_entry(priv->msg_free.next, struct apbridge_msg_s, list);
+    list_del(&info->list);
+
     info->ep = ep;
     info->buf = payload;
     info->len = len;
     info->priv = data;
 
-    flags = irqsave();
-    list_add(&priv->msg_queue, &info->list);
+    list_add(&priv->msg_queue[BULKINEP_TO_N(ep)], &info->list);
     irqrestore(flags);
 
     return OK;
 }
 
-static struct apbridge_msg_s *apbridge_dequeue(struct apbridge_dev_s *priv)
+/**
+ * @brief Get the next message waiting on an IN endpoint
+ * The message is accounted as in flight on ep, since the caller is going to
+ * submit it with the request that has just completed.
+ * @param priv usb device.
+ * @param ep endpoint whose request has just completed.
+ * @return the oldest pending message or NULL if the queue is empty.
+ */
+static struct apbridge_msg_s *apbridge_dequeue(struct apbridge_dev_s *priv,
+                                               struct usbdev_ep_s *ep)
 {
     irqstate_t flags;
     struct list_head *list;
+    unsigned int n = BULKINEP_TO_N(ep);
 
     flags = irqsave();
-    if (list_is_empty(&priv->msg_queue)) {
+    if (list_is_empty(&priv->msg_queue[n])) {
         irqrestore(flags);
         return NULL;
     }
 
-    list = priv->msg_queue.next;
+    list = priv->msg_queue[n].next;
     list_del(list);
+    priv->epin_inflight[n]++;
     irqrestore(flags);
     return list_entry(list, struct apbridge_msg_s, list);
 }
 
+static void apbridge_msg_free(struct apbridge_dev_s *priv,
+                              struct apbridge_msg_s *info)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    list_add(&priv->msg_free, &info->list);
+    irqrestore(flags);
+}
+
 static int _to_usb_submit(struct usbdev_ep_s *ep, struct usbdev_req_s *req,
                           const void *payload, size_t len)
 {
@@ -483,22 +652,69 @@ int unipro_to_usb(struct apbridge_dev_s *priv, unsigned int cportid,
     struct usbdev_ep_s *ep;
     struct usbdev_req_s *req;
     struct gb_operation_hdr *hdr = (void *)payload;
+    irqstate_t flags;
+    unsigned int n;
+    int ret;
 
-    if (len > APBRIDGE_REQ_SIZE)
+    /*
+     * The payload is the UniPro RX buffer itself and is only given back once
+     * the IN transfer completes: if it can't be sent, release it here.
+     */
+    if (len > APBRIDGE_REQ_SIZE) {
+        unipro_rxbuf_free(cportid, (void *)payload);
         return -EINVAL;
+    }
 
     /* Store the cport id in the header pad bytes. */
     hdr->pad[0] = cportid & 0xff;
 
+    flags = irqsave();
+#ifdef CONFIG_APBRIDGE_EP_BALANCE
+    apbridge_balance_cport(priv, cportid);
+#endif
     epno = priv->cport_to_epin_n[cportid];
     ep = priv->ep[epno & USB_EPNO_MASK];
-    req = get_request(ep, usbclass_wrcomplete, APBRIDGE_REQ_SIZE,
+    n = BULKINEP_TO_N(ep);
+    apbridge_epin_get(priv, n, cportid, len);
+
+    /*
+     * Keep at most APBRIDGE_EPIN_NREQS requests in flight on the endpoint,
+     * and don't overtake messages already waiting for it.
+     */
+    if (priv->epin_inflight[n] >= APBRIDGE_EPIN_NREQS ||
+        !list_is_empty(&priv->msg_queue[n])) {
+        ret = apbridge_queue(priv, ep, payload, len, (void*) cportid);
+        if (ret)
+            apbridge_epin_put(priv, n, cportid, len);
+        irqrestore(flags);
+        if (ret)
+            unipro_rxbuf_free(cportid, (void *)payload);
+        return ret;
+    }
+    priv->epin_inflight[n]++;
+    irqrestore(flags);
+
+    req = get_request(ep, usbclass_wrcomplete, APBRIDGE_EPIN_REQ_SIZE,
                       (void*) cportid);
     if (!req) {
-        return apbridge_queue(priv, ep, payload, len, (void*) cportid);
+        ret = -ENOMEM;
+        goto err_inflight;
     }
 
-    return _to_usb_submit(ep, req, payload, len);
+    ret = _to_usb_submit(ep, req, payload, len);
+    if (ret) {
+        put_request(req);
+        goto err_inflight;
+    }
+    return 0;
+
+err_inflight:
+    flags = irqsave();
+    priv->epin_inflight[n]--;
+    apbridge_epin_put(priv, n, cportid, len);
+    irqrestore(flags);
+    unipro_rxbuf_free(cportid, (void *)payload);
+    return ret;
 }
 
 int usb_release_buffer(struct apbridge_dev_s *priv, const void *buf)
@@ -518,6 +734,7 @@ int usb_release_buffer(struct apbridge_dev_s *priv, const void *buf)
     if (ret != OK) {
         usbtrace(TRACE_CLSERROR(USBSER_TRACEERR_RDSUBMIT),
                  (uint16_t) -ret);
+        put_request(req);
     }
     return ret;
 }
@@ -528,8 +745,28 @@ void map_cport_to_ep(struct apbridge_dev_s *priv,
     unsigned int cportid = le16_to_cpu(cport_to_ep->cport_id);
     uint8_t ep_out = cport_to_ep->endpoint_out - CONFIG_APBRIDGE_EPBULKOUT;
     bool is_multiplexed = cport_to_ep->endpoint_in == CONFIG_APBRIDGE_EPBULKIN;
+#ifdef CONFIG_APBRIDGE_EP_BALANCE
+    irqstate_t flags;
+    unsigned int n;
+
+    /* Endpoints dedicated to a CPort are not used for balancing */
 
+    flags = irqsave();
+    n = (priv->cport_epin_host[cportid] - CONFIG_APBRIDGE_EPBULKIN) >> 1;
+    if (priv->cport_epin_host[cportid] != CONFIG_APBRIDGE_EPBULKIN &&
+        n < APBRIDGE_NBULKS) {
+        priv->epin_direct[n]--;
+    }
+    n = (cport_to_ep->endpoint_in - CONFIG_APBRIDGE_EPBULKIN) >> 1;
+    if (!is_multiplexed && n < APBRIDGE_NBULKS) {
+        priv->epin_direct[n]++;
+    }
+    priv->cport_epin_host[cportid] = cport_to_ep->endpoint_in;
+    priv->cport_to_epin_n[cportid] = cport_to_ep->endpoint_in;
+    irqrestore(flags);
+#else
     priv->cport_to_epin_n[cportid] = cport_to_ep->endpoint_in;
+#endif
     priv->epout_to_cport_n[ep_out >> 1] = cportid;
 
     if (priv->driver->unipro_cport_mapping) {
@@ -539,6 +776,46 @@ void map_cport_to_ep(struct apbridge_dev_s *priv,
     }
 }
 
+/**
+ * @brief Get the utilization counters of a bulk endpoint pair
+ * @param priv usb device.
+ * @param n index of the bulk endpoint pair, from 0 to apbridge_ep_count() - 1
+ * @param stats where to copy the counters.
+ * @return 0 on success, -EINVAL if n is not a valid endpoint pair.
+ */
+int apbridge_get_ep_stats(struct apbridge_dev_s *priv, unsigned int n,
+                          struct apbridge_ep_stats *stats)
+{
+    irqstate_t flags;
+    unsigned int i;
+    unsigned int cport_count = unipro_cport_count();
+
+    if (n >= APBRIDGE_NBULKS) {
+        return -EINVAL;
+    }
+
+    flags = irqsave();
+    *stats = priv->ep_stats[n];
+    irqrestore(flags);
+
+    stats->cports = 0;
+    for (i = 0; i < cport_count; i++) {
+        if ((priv->cport_to_epin_n[i] & USB_EPNO_MASK) == EPIN_N_TO_EPNO(n)) {
+            stats->cports++;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get the number of bulk endpoint pairs
+ */
+unsigned int apbridge_ep_count(void)
+{
+    return APBRIDGE_NBULKS;
+}
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
@@ -780,14 +1057,22 @@ static int usbclass_setconfig(struct apbridge_dev_s *priv, uint8_t config)
         }
     }
 
+    for (i = 0; i < APBRIDGE_NBULKS; i++) {
+        priv->epin_inflight[i] = 0;
+    }
+
     /* Queue read requests in the bulk OUT endpoint */
     for (i = 0; i < APBRIDGE_NBULKS; i++) {
-        for (j = 0; j < APBRIDGE_NREQS; j++) {
+        for (j = 0; j < APBRIDGE_EPOUT_NREQS; j++) {
             struct usbdev_ep_s *ep;
 
             ep = priv->ep[CONFIG_APBRIDGE_EPBULKOUT + i * 2];
             req = get_request(ep, usbclass_rdcomplete,
                               APBRIDGE_REQ_SIZE, NULL);
+            if (!req) {
+                ret = -ENOMEM;
+                goto errout;
+            }
             request_set_priv(req, req->buf);
             ret = EP_SUBMIT(ep, req);
 
@@ -861,6 +1146,7 @@ static void usbclass_rdcomplete(struct usbdev_ep_s *ep,
     struct apbridge_usb_driver *drv;
     struct gb_operation_hdr *hdr;
     int ep_n;
+    int ret;
     unsigned int cportid;
 
     /* Sanity check */
@@ -883,6 +1169,8 @@ static void usbclass_rdcomplete(struct usbdev_ep_s *ep,
     case OK:                    /* Normal completion */
         usbtrace(TRACE_CLASSRDCOMPLETE, 0);
         ep_n = BULKEP_TO_N(ep);
+        priv->ep_stats[ep_n].out_messages++;
+        priv->ep_stats[ep_n].out_bytes += req->xfrd;
         hdr = (struct gb_operation_hdr *)req->buf;
         /* Legacy ep: copy from payload cportid */
 
@@ -898,11 +1186,20 @@ static void usbclass_rdcomplete(struct usbdev_ep_s *ep,
         hdr->pad[0] = 0;
 
         usbdclass_log_rx_time(priv, cportid);
-        drv->usb_to_unipro(priv, cportid, req->buf , req->xfrd);
+
+        /*
+         * On success the buffer now belongs to UniPro and the request is
+         * re-armed by usb_release_buffer(). Meanwhile, the other requests
+         * of the endpoint keep receiving.
+         */
+        ret = drv->usb_to_unipro(priv, cportid, req->buf , req->xfrd);
+        if (!ret)
+            return;
         break;
 
     case -ESHUTDOWN:           /* Disconnection */
         usbtrace(TRACE_CLSERROR(USBSER_TRACEERR_RDSHUTDOWN), 0);
+        put_request(req);
         return;
 
     default:                   /* Some other error occurred */
@@ -910,6 +1207,14 @@ static void usbclass_rdcomplete(struct usbdev_ep_s *ep,
                  (uint16_t) - req->result);
         break;
     };
+
+    /* The buffer has not been consumed: re-arm the request right away */
+
+    ret = EP_SUBMIT(ep, req);
+    if (ret != OK) {
+        usbtrace(TRACE_CLSERROR(USBSER_TRACEERR_RDSUBMIT), (uint16_t) -ret);
+        put_request(req);
+    }
 }
 
 static void usbclass_wrcomplete(struct usbdev_ep_s *ep,
@@ -917,6 +1222,9 @@ static void usbclass_wrcomplete(struct usbdev_ep_s *ep,
 {
     struct apbridge_msg_s *info;
     struct apbridge_dev_s *priv;
+    irqstate_t flags;
+    unsigned int cportid;
+    unsigned int n;
 
     /* Sanity check */
 #ifdef CONFIG_DEBUG
@@ -926,18 +1234,6 @@ static void usbclass_wrcomplete(struct usbdev_ep_s *ep,
     }
 #endif
 
-    unipro_rxbuf_free((unsigned int) request_get_priv(req), req->buf);
-
-    priv = ep_to_apbridge(ep);
-    info = apbridge_dequeue(priv);
-    if (info) {
-        request_set_priv(req, info->priv);
-        _to_usb_submit(info->ep, req, info->buf, info->len);
-        free(info);
-    } else {
-        put_request(req);
-    }
-
     switch (req->result) {
     case OK:                   /* Normal completion */
         usbtrace(TRACE_CLASSWRCOMPLETE, 0);
@@ -952,6 +1248,43 @@ static void usbclass_wrcomplete(struct usbdev_ep_s *ep,
                  (uint16_t) - req->result);
         break;
     }
+
+    priv = ep_to_apbridge(ep);
+    n = BULKINEP_TO_N(ep);
+    cportid = (unsigned int) request_get_priv(req);
+
+    flags = irqsave();
+    priv->epin_inflight[n]--;
+    apbridge_epin_put(priv, n, cportid, req->len);
+    if (req->result == OK) {
+        priv->ep_stats[n].in_messages++;
+        priv->ep_stats[n].in_bytes += req->xfrd;
+    }
+    irqrestore(flags);
+
+    unipro_rxbuf_free(cportid, req->buf);
+
+    /*
+     * Hand the request over to the next message pending on this endpoint.
+     * A message that can't be submitted is dropped so that neither its
+     * buffer nor the request are leaked.
+     */
+    while ((info = apbridge_dequeue(priv, ep))) {
+        request_set_priv(req, info->priv);
+        if (!_to_usb_submit(ep, req, info->buf, info->len)) {
+            apbridge_msg_free(priv, info);
+            return;
+        }
+
+        cportid = (unsigned int) info->priv;
+        flags = irqsave();
+        priv->epin_inflight[n]--;
+        apbridge_epin_put(priv, n, cportid, info->len);
+        irqrestore(flags);
+        unipro_rxbuf_free(cportid, (void *)info->buf);
+        apbridge_msg_free(priv, info);
+    }
+    put_request(req);
 }
 
 /****************************************************************************
@@ -1052,13 +1385,19 @@ static int usbclass_bind(struct usbdevclass_driver_s *driver,
      * logic where kmm_malloc calls will fail.
      */
 
-    request_pool_prealloc(priv->ep[0], APBRIDGE_MXDESCLEN, 1);
-    request_pool_prealloc(priv->ep[CONFIG_APBRIDGE_EPBULKOUT],
-                          APBRIDGE_REQ_SIZE, APBRIDGE_NREQS * APBRIDGE_NBULKS);
-    request_pool_prealloc(priv->ep[CONFIG_APBRIDGE_EPBULKIN],
-                          APBRIDGE_REQ_SIZE, APBRIDGE_NREQS * APBRIDGE_NBULKS);
-
-    /* TODO test result of prealloc */
+    ret = request_pool_prealloc(priv->ep[0], APBRIDGE_MXDESCLEN, 1);
+    if (ret < 0)
+        goto error;
+    ret = request_pool_prealloc(priv->ep[CONFIG_APBRIDGE_EPBULKOUT],
+                                APBRIDGE_REQ_SIZE,
+                                APBRIDGE_EPOUT_NREQS * APBRIDGE_NBULKS);
+    if (ret < 0)
+        goto error;
+    ret = request_pool_prealloc(priv->ep[CONFIG_APBRIDGE_EPBULKIN],
+                                APBRIDGE_EPIN_REQ_SIZE,
+                                APBRIDGE_EPIN_NREQS * APBRIDGE_NBULKS);
+    if (ret < 0)
+        goto error;
 
     /* Report if we are selfpowered */
 
@@ -1634,13 +1973,34 @@ int usbdev_apbinitialize(struct device *dev,
         ret = -ENOMEM;
         goto errout_with_alloc_ts;
     }
+    priv->cport_pending = kmm_zalloc(sizeof(uint16_t) * cport_count);
+    if (!priv->cport_pending) {
+        ret = -ENOMEM;
+        goto errout_with_alloc_pending;
+    }
+#ifdef CONFIG_APBRIDGE_EP_BALANCE
+    priv->cport_epin_host = kmm_malloc(sizeof(uint8_t) * cport_count);
+    if (!priv->cport_epin_host) {
+        ret = -ENOMEM;
+        goto errout_with_alloc_epin_host;
+    }
+#endif
 
     for (i = 0; i < cport_count; i++) {
         priv->cport_to_epin_n[i] = CONFIG_APBRIDGE_EPBULKIN;
+#ifdef CONFIG_APBRIDGE_EP_BALANCE
+        priv->cport_epin_host[i] = CONFIG_APBRIDGE_EPBULKIN;
+#endif
         priv->ts[i].tag = false;
     }
     sem_init(&priv->config_sem, 0, 0);
-    list_init(&priv->msg_queue);
+    list_init(&priv->msg_free);
+    for (i = 0; i < APBRIDGE_MSG_POOL_SIZE; i++) {
+        list_add(&priv->msg_free, &priv->msg_pool[i].list);
+    }
+    for (i = 0; i < APBRIDGE_NBULKS; i++) {
+        list_init(&priv->msg_queue[i]);
+    }
     gb_timestamp_init();
 
     /* Initialize the USB class driver structure */
@@ -1666,6 +2026,12 @@ int usbdev_apbinitialize(struct device *dev,
  errout_with_init:
     device_usbdev_unregister_gadget(dev, drvr);
 errout_cport_table:
+#ifdef CONFIG_APBRIDGE_EP_BALANCE
+    kmm_free(priv->cport_epin_host);
+errout_with_alloc_epin_host:
+#endif
+    kmm_free(priv->cport_pending);
+errout_with_alloc_pending:
     kmm_free(priv->ts);
 errout_with_alloc_ts:
     kmm_free(priv->cport_to_epin_n);
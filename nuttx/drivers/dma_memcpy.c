@@ -0,0 +1,461 @@
+/**
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * @brief Memory copies offloaded to a DMA controller
+ *
+ * Copies of at least dma_memcpy_get_threshold() bytes are handed to a DMA
+ * channel, smaller ones are done by the CPU since setting up the transfer
+ * and taking its completion would cost more than the copy itself. The DMA
+ * device may be shared with another client, which then passes it to
+ * dma_memcpy_init() since a device can only be opened once.
+ *
+ * The ops are chained: copies started back to back run one after the other
+ * without the DMA driver waking its completion context in between, and their
+ * callbacks are called together once the last one is done.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <semaphore.h>
+
+#include <arch/irq.h>
+
+#include <nuttx/arch.h>
+#include <nuttx/list.h>
+#include <nuttx/device.h>
+#include <nuttx/device_dma.h>
+#include <nuttx/dma_memcpy.h>
+
+struct dma_memcpy_req {
+    struct list_head list;
+    struct device_dma_op *op;
+    size_t len;
+    uint8_t pattern;            /* source of memset transfers */
+    dma_memcpy_callback callback;
+    void *arg;
+};
+
+struct dma_memcpy_sync {
+    sem_t sem;
+    int status;
+};
+
+static struct {
+    struct device *dev;
+    bool opened;                /* dev was opened by dma_memcpy_init() */
+    void *copy_chan;
+    void *set_chan;             /* NULL if memset is done by the CPU */
+    struct list_head free_reqs;
+    size_t threshold;
+    struct dma_memcpy_stats stats;
+} g_dma_memcpy = {
+    .threshold = CONFIG_DMA_MEMCPY_THRESHOLD,
+};
+
+static struct dma_memcpy_req *dma_memcpy_req_get(void)
+{
+    struct dma_memcpy_req *req;
+    irqstate_t flags;
+
+    flags = irqsave();
+    if (list_is_empty(&g_dma_memcpy.free_reqs)) {
+        g_dma_memcpy.stats.busy++;
+        irqrestore(flags);
+        return NULL;
+    }
+
+    req = list_entry(g_dma_memcpy.free_reqs.next, struct dma_memcpy_req,
+                     list);
+    list_del(&req->list);
+    irqrestore(flags);
+
+    return req;
+}
+
+static void dma_memcpy_req_put(struct dma_memcpy_req *req)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    list_add(&g_dma_memcpy.free_reqs, &req->list);
+    irqrestore(flags);
+}
+
+static void dma_memcpy_cpu_done(size_t len, dma_memcpy_callback callback,
+                                void *arg)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    g_dma_memcpy.stats.cpu_copies++;
+    g_dma_memcpy.stats.cpu_bytes += len;
+    irqrestore(flags);
+
+    if (callback)
+        callback(0, arg);
+}
+
+static int dma_memcpy_op_callback(struct device *dev, void *chan,
+                                  struct device_dma_op *op,
+                                  unsigned int event, void *arg)
+{
+    struct dma_memcpy_req *req = arg;
+    dma_memcpy_callback callback = req->callback;
+    void *callback_arg = req->arg;
+    irqstate_t flags;
+    int status = 0;
+
+    flags = irqsave();
+    if (event & DEVICE_DMA_CALLBACK_EVENT_COMPLETE) {
+        g_dma_memcpy.stats.dma_copies++;
+        g_dma_memcpy.stats.dma_bytes += req->len;
+    } else {
+        g_dma_memcpy.stats.errors++;
+        status = -EIO;
+    }
+    irqrestore(flags);
+
+    /* Give the op back first, so that the callback can start another copy */
+
+    dma_memcpy_req_put(req);
+
+    if (callback)
+        callback(status, callback_arg);
+
+    return 0;
+}
+
+/*
+ * Start a DMA transfer on chan. Returns false, leaving the copy to the
+ * caller, if it is below the threshold, no DMA op is available, or it is
+ * called from an interrupt handler, where the DMA drivers can't be used.
+ */
+static bool dma_memcpy_start(void *chan, void *dst, const void *src,
+                             int c, size_t len,
+                             dma_memcpy_callback callback, void *arg)
+{
+    struct dma_memcpy_req *req;
+    struct device_dma_op *op;
+
+    if (!chan || !len || len < g_dma_memcpy.threshold ||
+        up_interrupt_context())
+        return false;
+
+    req = dma_memcpy_req_get();
+    if (!req)
+        return false;
+
+    req->len = len;
+    req->pattern = c;
+    req->callback = callback;
+    req->arg = arg;
+
+    op = req->op;
+    op->sg[0].src_addr = (off_t) (src ? src : &req->pattern);
+    op->sg[0].dst_addr = (off_t) dst;
+    op->sg[0].len = len;
+
+    if (device_dma_enqueue(g_dma_memcpy.dev, chan, op)) {
+        dma_memcpy_req_put(req);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Copy memory, with DMA if the copy is large enough
+ * In interrupt context, the copy is done by the CPU and callback is called
+ * before returning.
+ * @param dst destination buffer.
+ * @param src source buffer, which must not overlap dst.
+ * @param len number of bytes to copy.
+ * @param callback called once the copy is done, may be NULL.
+ * @param arg argument passed to callback.
+ * @return 0 on success.
+ */
+int dma_memcpy_async(void *dst, const void *src, size_t len,
+                     dma_memcpy_callback callback, void *arg)
+{
+    if (!dma_memcpy_start(g_dma_memcpy.copy_chan, dst, src, 0, len,
+                          callback, arg)) {
+        memcpy(dst, src, len);
+        dma_memcpy_cpu_done(len, callback, arg);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Fill memory, with DMA if the buffer is large enough
+ * In interrupt context, the buffer is filled by the CPU and callback is
+ * called before returning.
+ * @param dst buffer to fill.
+ * @param c value of the bytes.
+ * @param len number of bytes to fill.
+ * @param callback called once the buffer is filled, may be NULL.
+ * @param arg argument passed to callback.
+ * @return 0 on success.
+ */
+int dma_memset_async(void *dst, int c, size_t len,
+                     dma_memcpy_callback callback, void *arg)
+{
+    if (!dma_memcpy_start(g_dma_memcpy.set_chan, dst, NULL, c, len,
+                          callback, arg)) {
+        memset(dst, c, len);
+        dma_memcpy_cpu_done(len, callback, arg);
+    }
+
+    return 0;
+}
+
+static void dma_memcpy_wakeup(int status, void *arg)
+{
+    struct dma_memcpy_sync *sync = arg;
+
+    sync->status = status;
+    sem_post(&sync->sem);
+}
+
+static int dma_memcpy_wait(struct dma_memcpy_sync *sync)
+{
+    while (sem_wait(&sync->sem) < 0) {
+        if (errno != EINTR)
+            return -errno;
+    }
+
+    return sync->status;
+}
+
+/**
+ * @brief Copy memory and wait for the copy to be done
+ * The calling thread sleeps while the DMA controller does the copy. In
+ * interrupt context, the copy is always done by the CPU.
+ * @param dst destination buffer.
+ * @param src source buffer, which must not overlap dst.
+ * @param len number of bytes to copy.
+ * @return 0 on success, -EIO if the DMA transfer failed.
+ */
+int dma_memcpy(void *dst, const void *src, size_t len)
+{
+    struct dma_memcpy_sync sync;
+    int ret;
+
+    if (up_interrupt_context()) {
+        memcpy(dst, src, len);
+        dma_memcpy_cpu_done(len, NULL, NULL);
+        return 0;
+    }
+
+    sem_init(&sync.sem, 0, 0);
+    sem_setprotocol(&sync.sem, SEM_PRIO_NONE);
+    ret = dma_memcpy_async(dst, src, len, dma_memcpy_wakeup, &sync);
+    if (!ret)
+        ret = dma_memcpy_wait(&sync);
+    sem_destroy(&sync.sem);
+
+    return ret;
+}
+
+/**
+ * @brief Fill memory and wait for it to be done
+ * @see dma_memcpy()
+ */
+int dma_memset(void *dst, int c, size_t len)
+{
+    struct dma_memcpy_sync sync;
+    int ret;
+
+    if (up_interrupt_context()) {
+        memset(dst, c, len);
+        dma_memcpy_cpu_done(len, NULL, NULL);
+        return 0;
+    }
+
+    sem_init(&sync.sem, 0, 0);
+    sem_setprotocol(&sync.sem, SEM_PRIO_NONE);
+    ret = dma_memset_async(dst, c, len, dma_memcpy_wakeup, &sync);
+    if (!ret)
+        ret = dma_memcpy_wait(&sync);
+    sem_destroy(&sync.sem);
+
+    return ret;
+}
+
+size_t dma_memcpy_get_threshold(void)
+{
+    return g_dma_memcpy.threshold;
+}
+
+/**
+ * @brief Set the size below which copies are done by the CPU
+ * @param threshold size in bytes, 0 to always use DMA when available.
+ */
+void dma_memcpy_set_threshold(size_t threshold)
+{
+    g_dma_memcpy.threshold = threshold;
+}
+
+void dma_memcpy_get_stats(struct dma_memcpy_stats *stats)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    memcpy(stats, &g_dma_memcpy.stats, sizeof(*stats));
+    irqrestore(flags);
+}
+
+/**
+ * @brief Get the completion statistics of the DMA channel used for copies
+ * @param stats filled with the statistics of the channel
+ * @return 0 on success, -ENODEV if the service isn't initialized, or the
+ *         error returned by the DMA driver.
+ */
+int dma_memcpy_get_chan_stats(struct device_dma_chan_stats *stats)
+{
+    if (!g_dma_memcpy.dev || !g_dma_memcpy.copy_chan)
+        return -ENODEV;
+
+    return device_dma_chan_get_stats(g_dma_memcpy.dev, g_dma_memcpy.copy_chan,
+                                     stats);
+}
+
+static void dma_memcpy_free(void)
+{
+    struct dma_memcpy_req *req;
+    struct list_head *iter, *next;
+
+    list_foreach_safe(&g_dma_memcpy.free_reqs, iter, next) {
+        req = list_entry(iter, struct dma_memcpy_req, list);
+        list_del(iter);
+        device_dma_op_free(g_dma_memcpy.dev, req->op);
+    }
+
+    if (g_dma_memcpy.set_chan) {
+        device_dma_chan_free(g_dma_memcpy.dev, g_dma_memcpy.set_chan);
+        g_dma_memcpy.set_chan = NULL;
+    }
+
+    if (g_dma_memcpy.copy_chan) {
+        device_dma_chan_free(g_dma_memcpy.dev, g_dma_memcpy.copy_chan);
+        g_dma_memcpy.copy_chan = NULL;
+    }
+
+    if (g_dma_memcpy.opened)
+        device_close(g_dma_memcpy.dev);
+
+    g_dma_memcpy.opened = false;
+    g_dma_memcpy.dev = NULL;
+}
+
+/**
+ * @brief Start offloading copies to DMA
+ * Until this is called, every copy is done by the CPU.
+ * @param dev DMA device already opened by another client, or NULL to open
+ *            the first DMA device.
+ * @return 0 on success or if already started, -errno otherwise.
+ */
+int dma_memcpy_init(struct device *dev)
+{
+    struct device_dma_caps caps;
+    struct device_dma_params params = {
+        .src_dev = DEVICE_DMA_DEV_MEM,
+        .src_devid = 0,
+        .src_inc_options = DEVICE_DMA_INC_AUTO,
+        .dst_dev = DEVICE_DMA_DEV_MEM,
+        .dst_devid = 0,
+        .dst_inc_options = DEVICE_DMA_INC_AUTO,
+        .transfer_size = DEVICE_DMA_TRANSFER_SIZE_64,
+        .burst_len = DEVICE_DMA_BURST_LEN_16,
+        .swap = DEVICE_DMA_SWAP_SIZE_NONE,
+    };
+    struct device_dma_op *op;
+    struct dma_memcpy_req *req;
+    int ret;
+    int i;
+
+    if (g_dma_memcpy.dev)
+        return 0;
+
+    list_init(&g_dma_memcpy.free_reqs);
+
+    if (!dev) {
+        dev = device_open(DEVICE_TYPE_DMA_HW, 0);
+        if (!dev)
+            return -ENODEV;
+        g_dma_memcpy.opened = true;
+    }
+    g_dma_memcpy.dev = dev;
+
+    ret = device_dma_chan_alloc(dev, &params, &g_dma_memcpy.copy_chan);
+    if (ret) {
+        g_dma_memcpy.copy_chan = NULL;
+        goto error;
+    }
+
+    /* Fill with the same source byte if the controller can */
+
+    if (!device_dma_get_caps(dev, &caps) &&
+        (caps.inc_options & DEVICE_DMA_INC_NOAUTO)) {
+        params.src_inc_options = DEVICE_DMA_INC_NOAUTO;
+        params.transfer_size = DEVICE_DMA_TRANSFER_SIZE_8;
+        if (device_dma_chan_alloc(dev, &params, &g_dma_memcpy.set_chan))
+            g_dma_memcpy.set_chan = NULL;
+    }
+
+    for (i = 0; i < CONFIG_DMA_MEMCPY_NOPS; i++) {
+        ret = device_dma_op_alloc(dev, 1, sizeof(*req), &op);
+        if (ret)
+            goto error;
+
+        req = (struct dma_memcpy_req *) &op->sg[1];
+        req->op = op;
+        op->callback = dma_memcpy_op_callback;
+        op->callback_arg = req;
+        op->callback_events = DEVICE_DMA_CALLBACK_EVENT_COMPLETE |
+                              DEVICE_DMA_CALLBACK_EVENT_ERROR;
+        op->flags = DEVICE_DMA_OP_FLAG_CHAINED;
+        op->sg_count = 1;
+        list_add(&g_dma_memcpy.free_reqs, &req->list);
+    }
+
+    return 0;
+
+error:
+    dma_memcpy_free();
+    return ret;
+}
+
+/**
+ * @brief Stop offloading copies to DMA
+ * Must only be called once all the copies started with DMA are done.
+ */
+void dma_memcpy_deinit(void)
+{
+    if (g_dma_memcpy.dev)
+        dma_memcpy_free();
+}
@@ -106,7 +106,6 @@ static uint8_t gb_camera_protocol_version(struct gb_operation *operation)
 static uint8_t gb_camera_capabilities(struct gb_operation *operation)
 {
     struct gb_camera_capabilities_response *response;
-    uint8_t *capabilities;
     uint16_t size;
     int ret;
 
@@ -127,14 +126,14 @@ static uint8_t gb_camera_capabilities(struct gb_operation *operation)
         return GB_OP_NO_MEMORY;
     }
 
-    /* camera module capabilities */
-    ret = device_camera_capabilities(info->dev, &size, capabilities);
+    /* camera module capabilities, filled in straight by the driver */
+    ret = device_camera_capabilities(info->dev, &size,
+                                     response->capabilities);
     if (ret) {
         return gb_errno_to_op_result(ret);
     }
 
     response->size = cpu_to_le16(size);
-    memcpy(response->capabilities, &capabilities, size);
 
     lldbg("gb_camera_capabilities() - \n");
 
@@ -524,6 +523,7 @@ static struct gb_driver gb_camera_driver = {
     .exit = gb_camera_exit,
     .op_handlers = gb_camera_handlers,
     .op_handlers_count = ARRAY_SIZE(gb_camera_handlers),
+    .dispatch_priority = GB_DISPATCH_PRIORITY_LOW,
 };
 
 /**
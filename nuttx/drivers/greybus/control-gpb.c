@@ -71,21 +71,21 @@ static uint8_t gb_control_get_manifest_size(struct gb_operation *operation)
 
 static uint8_t gb_control_get_manifest(struct gb_operation *operation)
 {
-    struct gb_control_get_manifest_response *response;
     struct greybus_manifest_header *mh;
     int size = get_manifest_size();
 
-    response = gb_operation_alloc_response(operation, size);
-    if (!response)
-        return GB_OP_NO_MEMORY;
-
     mh = get_manifest_blob();
     if (!mh) {
         gb_error("Failed to get a valid manifest\n");
         return GB_OP_INVALID;
     }
 
-    memcpy(response->data, mh, size);
+    if (!gb_operation_alloc_response(operation, 0))
+        return GB_OP_NO_MEMORY;
+
+    /* the blob is static, send it from where it is */
+    if (gb_operation_append_response_data(operation, mh, size))
+        return GB_OP_INVALID;
 
     return GB_OP_SUCCESS;
 }
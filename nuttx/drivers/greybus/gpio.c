@@ -28,6 +28,8 @@
  * Author: Fabien Parent <fparent@baylibre.com>
  */
 
+#include <errno.h>
+
 #include <nuttx/greybus/greybus.h>
 #include <nuttx/greybus/debug.h>
 #include "gpio-gb.h"
@@ -259,6 +261,7 @@ int gb_gpio_irq_event(int irq, FAR void *context)
 {
     struct gb_gpio_irq_event_request *request;
     struct gb_operation *operation;
+    int ret;
 
     operation = gb_operation_create(g_gpio_cport, GB_GPIO_TYPE_IRQ_EVENT,
                                     sizeof(*request));
@@ -271,8 +274,14 @@ int gb_gpio_irq_event(int irq, FAR void *context)
     /* Host is responsible for unmasking. */
     gpio_mask_irq(irq);
 
-    /* Send unidirectional operation. */
-    gb_operation_send_request(operation, NULL, false);
+    /* Send unidirectional operation, coalesced with other pending events. */
+    ret = gb_operation_queue_request(operation, NULL, false);
+    if (ret == -EBUSY) {
+        /* The batch is full and waiting to be flushed, don't wait for it */
+        ret = gb_operation_send_request(operation, NULL, false);
+    }
+    if (ret)
+        gb_error("failed to send IRQ event of line %d: %d\n", irq, ret);
 
     gb_operation_destroy(operation);
 
@@ -324,7 +333,8 @@ static uint8_t gb_gpio_irq_type(struct gb_operation *operation)
 
 
 static struct gb_operation_handler gb_gpio_handlers[] = {
-    GB_HANDLER(GB_GPIO_TYPE_PROTOCOL_VERSION, gb_gpio_protocol_version),
+    GB_ATOMIC_HANDLER(GB_GPIO_TYPE_PROTOCOL_VERSION,
+                      gb_gpio_protocol_version),
     GB_HANDLER(GB_GPIO_TYPE_LINE_COUNT, gb_gpio_line_count),
     GB_HANDLER(GB_GPIO_TYPE_ACTIVATE, gb_gpio_activate),
     GB_HANDLER(GB_GPIO_TYPE_DEACTIVATE, gb_gpio_deactivate),
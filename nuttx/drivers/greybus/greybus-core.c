@@ -32,9 +32,14 @@
 #include <nuttx/list.h>
 #include <nuttx/unipro/unipro.h>
 #include <nuttx/greybus/greybus.h>
+#include <nuttx/greybus/trace.h>
 #include <nuttx/greybus/tape.h>
 #include <nuttx/greybus/debug.h>
+#include <nuttx/arch.h>
 #include <nuttx/wdog.h>
+#include <nuttx/wqueue.h>
+#include <nuttx/clock.h>
+#include <nuttx/hires_tmr.h>
 #include <loopback-gb.h>
 
 #include <arch/atomic.h>
@@ -49,32 +54,85 @@
 #define GB_INVALID_TYPE         0
 
 #define ONE_SEC_IN_MSEC         1000
-#define ONE_MSEC_IN_NSEC        1000000
+
+#define GB_INFLIGHT_HASH_SIZE   8 /* must be a power of 2 */
+#define GB_TX_BATCH_CHUNK       8
 
 #define TIMEOUT_WD_DELAY    (TIMEOUT_IN_MS * CLOCKS_PER_SEC) / ONE_SEC_IN_MSEC
 
+#ifndef CONFIG_GREYBUS_OPERATION_POOL_SIZE
+#define CONFIG_GREYBUS_OPERATION_POOL_SIZE 0
+#endif
+
+#ifdef CONFIG_GREYBUS_OPERATION_POOL
+/*
+ * The free lists are used from the RX interrupt as well as from threads. On
+ * a single core, disabling interrupts around an unlink is the cheapest way
+ * to protect them.
+ */
+struct gb_operation_pool {
+    struct gb_operation *ops;
+    void **bufs;
+    struct list_head free_ops;
+    struct list_head free_bufs;
+    struct gb_operation_pool_stats stats;
+};
+#endif
+
 struct gb_cport_driver {
     struct gb_driver *driver;
     struct list_head tx_fifo;
+    struct list_head inflight[GB_INFLIGHT_HASH_SIZE];
     struct list_head rx_fifo;
     sem_t rx_fifo_lock;
     pthread_t thread;
     volatile bool exit_worker;
     struct wdog_s timeout_wd;
     struct gb_operation timedout_operation;
+#ifdef CONFIG_GREYBUS_OPERATION_POOL
+    struct gb_operation_pool pool;
+#endif
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+    struct list_head dispatch_node;
+    enum gb_dispatch_priority dispatch_priority;
+    bool dispatch_queued;
+    bool dispatch_running;
+    bool dispatch_wait;
+    sem_t dispatch_idle;
+#endif
+    struct gb_dispatch_stats dispatch_stats;
+#ifdef CONFIG_GREYBUS_TX_BATCH
+    sem_t batch_lock;
+    struct work_s batch_work;
+    size_t batch_count;
+    struct gb_operation *batch[CONFIG_GREYBUS_TX_BATCH_MAX];
+#endif
+};
+
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+struct gb_dispatch_pool {
+    struct list_head ready[GB_DISPATCH_PRIORITY_COUNT];
+    sem_t ready_sem;
+    pthread_t thread[CONFIG_GREYBUS_WORKER_POOL_THREADS];
+    int thread_count;
+    volatile bool exit_worker;
 };
 
-struct gb_tape_record_header {
-    uint16_t size;
-    uint16_t cport;
+/* Order in which the ready queues are served by the dispatch workers */
+static const enum gb_dispatch_priority gb_dispatch_order[] = {
+    GB_DISPATCH_PRIORITY_HIGH,
+    GB_DISPATCH_PRIORITY_NORMAL,
+    GB_DISPATCH_PRIORITY_LOW,
 };
+#endif
 
 static unsigned int cport_count;
 static atomic_t request_id;
 static struct gb_cport_driver *g_cport;
 static struct gb_transport_backend *transport_backend;
-static struct gb_tape_mechanism *gb_tape;
-static int gb_tape_fd = -EBADFD;
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+static struct gb_dispatch_pool g_dispatch;
+#endif
 static struct gb_operation_hdr timedout_hdr = {
     .size = sizeof(timedout_hdr),
     .result = GB_OP_TIMEOUT,
@@ -87,6 +145,12 @@ static struct gb_operation_hdr oom_hdr = {
 };
 
 static void gb_operation_timeout(int argc, uint32_t cport, ...);
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+static void gb_dispatch_schedule(unsigned int cport);
+#endif
+#ifdef CONFIG_GREYBUS_TX_BATCH
+static void gb_batch_discard(unsigned int cport);
+#endif
 static struct gb_operation *_gb_operation_create(unsigned int cport);
 
 uint8_t gb_errno_to_op_result(int err)
@@ -151,6 +215,243 @@ static void op_mark_send_time(struct gb_operation *operation) { }
 static void op_mark_recv_time(struct gb_operation *operation) { }
 #endif
 
+#ifdef CONFIG_GREYBUS_OPERATION_POOL
+/**
+ * Preallocate the operations and message buffers of a CPort
+ *
+ * The pool is kept until gb_deinit() even if the driver gets unregistered,
+ * since operations owned by the driver can outlive its registration. A
+ * driver registered again on the CPort must then ask for the same size.
+ *
+ * @param cport CPort for which the pool is created
+ * @param count number of operations and buffers to preallocate
+ * @return 0 on success, -ENOMEM if the pool could not be allocated, -EBUSY
+ *         if the CPort already has a pool of another size
+ */
+static int gb_operation_pool_init(unsigned int cport, size_t count)
+{
+    struct gb_operation_pool *pool = &g_cport[cport].pool;
+    int i;
+
+    if (pool->ops) {
+        if (count == pool->stats.op_count)
+            return 0;
+
+        gb_error("CP%u already has a pool of %zu operations, not %zu\n",
+                 cport, pool->stats.op_count, count);
+        return -EBUSY;
+    }
+
+    if (!count)
+        return 0;
+
+    pool->ops = zalloc(count * sizeof(*pool->ops));
+    pool->bufs = zalloc(count * sizeof(*pool->bufs));
+    if (!pool->ops || !pool->bufs)
+        goto error;
+
+    for (i = 0; i < count; i++) {
+        pool->bufs[i] =
+            transport_backend->alloc_buf(CONFIG_GREYBUS_OPERATION_POOL_BUF_SIZE);
+        if (!pool->bufs[i])
+            goto error;
+
+        list_add(&pool->free_ops, &pool->ops[i].list);
+        list_add(&pool->free_bufs, pool->bufs[i]);
+    }
+
+    memset(&pool->stats, 0, sizeof(pool->stats));
+    pool->stats.op_count = pool->stats.op_free = pool->stats.op_min_free =
+        count;
+    pool->stats.buf_count = pool->stats.buf_free = pool->stats.buf_min_free =
+        count;
+    pool->stats.buf_size = CONFIG_GREYBUS_OPERATION_POOL_BUF_SIZE;
+
+    return 0;
+
+error:
+    if (pool->bufs) {
+        for (i = 0; i < count && pool->bufs[i]; i++)
+            transport_backend->free_buf(pool->bufs[i]);
+    }
+
+    free(pool->bufs);
+    free(pool->ops);
+    pool->bufs = NULL;
+    pool->ops = NULL;
+    list_init(&pool->free_ops);
+    list_init(&pool->free_bufs);
+
+    return -ENOMEM;
+}
+
+static void gb_operation_pool_deinit(unsigned int cport)
+{
+    struct gb_operation_pool *pool = &g_cport[cport].pool;
+    int i;
+
+    if (!pool->ops)
+        return;
+
+    if (pool->stats.op_free != pool->stats.op_count ||
+        pool->stats.buf_free != pool->stats.buf_count) {
+        gb_error("CP%u: destroying operation pool with %u operations and %u buffers in use\n",
+                 cport, pool->stats.op_count - pool->stats.op_free,
+                 pool->stats.buf_count - pool->stats.buf_free);
+    }
+
+    for (i = 0; i < pool->stats.buf_count; i++)
+        transport_backend->free_buf(pool->bufs[i]);
+
+    free(pool->bufs);
+    free(pool->ops);
+    pool->bufs = NULL;
+    pool->ops = NULL;
+    list_init(&pool->free_ops);
+    list_init(&pool->free_bufs);
+}
+
+/**
+ * Take an operation from the CPort pool
+ *
+ * @note Can be called from interrupt context
+ */
+static struct gb_operation *gb_operation_pool_get(unsigned int cport)
+{
+    struct gb_operation_pool *pool = &g_cport[cport].pool;
+    struct list_head *node;
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    if (list_is_empty(&pool->free_ops)) {
+        if (pool->ops)
+            pool->stats.op_exhausted++;
+        irqrestore(flags);
+        return NULL;
+    }
+
+    node = pool->free_ops.next;
+    list_del(node);
+
+    if (--pool->stats.op_free < pool->stats.op_min_free)
+        pool->stats.op_min_free = pool->stats.op_free;
+
+    irqrestore(flags);
+
+    return list_entry(node, struct gb_operation, list);
+}
+
+static void gb_operation_pool_put(struct gb_operation *operation)
+{
+    struct gb_operation_pool *pool = &g_cport[operation->cport].pool;
+    irqstate_t flags;
+
+    flags = irqsave();
+    list_add(&pool->free_ops, &operation->list);
+    pool->stats.op_free++;
+    irqrestore(flags);
+}
+
+static void *gb_operation_alloc_buf(unsigned int cport, size_t size,
+                                    bool *is_pool_buf)
+{
+    struct gb_operation_pool *pool = &g_cport[cport].pool;
+    struct list_head *node;
+    irqstate_t flags;
+
+    *is_pool_buf = false;
+
+    if (size > CONFIG_GREYBUS_OPERATION_POOL_BUF_SIZE)
+        return transport_backend->alloc_buf(size);
+
+    flags = irqsave();
+
+    if (list_is_empty(&pool->free_bufs)) {
+        if (pool->bufs)
+            pool->stats.buf_exhausted++;
+        irqrestore(flags);
+        return transport_backend->alloc_buf(size);
+    }
+
+    node = pool->free_bufs.next;
+    list_del(node);
+
+    if (--pool->stats.buf_free < pool->stats.buf_min_free)
+        pool->stats.buf_min_free = pool->stats.buf_free;
+
+    irqrestore(flags);
+
+    *is_pool_buf = true;
+    return node;
+}
+
+static void gb_operation_free_buf(unsigned int cport, void *buf,
+                                  bool is_pool_buf)
+{
+    struct gb_operation_pool *pool = &g_cport[cport].pool;
+    irqstate_t flags;
+
+    if (!is_pool_buf) {
+        transport_backend->free_buf(buf);
+        return;
+    }
+
+    flags = irqsave();
+    list_add(&pool->free_bufs, buf);
+    pool->stats.buf_free++;
+    irqrestore(flags);
+}
+
+int gb_operation_pool_get_stats(unsigned int cport,
+                                struct gb_operation_pool_stats *stats)
+{
+    irqstate_t flags;
+
+    if (cport >= cport_count || !stats)
+        return -EINVAL;
+
+    flags = irqsave();
+    memcpy(stats, &g_cport[cport].pool.stats, sizeof(*stats));
+    irqrestore(flags);
+
+    return 0;
+}
+#else
+static int gb_operation_pool_init(unsigned int cport, size_t count)
+{
+    return 0;
+}
+
+static void gb_operation_pool_deinit(unsigned int cport) { }
+
+static struct gb_operation *gb_operation_pool_get(unsigned int cport)
+{
+    return NULL;
+}
+
+static void gb_operation_pool_put(struct gb_operation *operation) { }
+
+static void *gb_operation_alloc_buf(unsigned int cport, size_t size,
+                                    bool *is_pool_buf)
+{
+    *is_pool_buf = false;
+    return transport_backend->alloc_buf(size);
+}
+
+static void gb_operation_free_buf(unsigned int cport, void *buf,
+                                  bool is_pool_buf)
+{
+    transport_backend->free_buf(buf);
+}
+
+int gb_operation_pool_get_stats(unsigned int cport,
+                                struct gb_operation_pool_stats *stats)
+{
+    return -ENOSYS;
+}
+#endif
+
 static int gb_compare_handlers(const void *data1, const void *data2)
 {
     const struct gb_operation_handler *handler1 = data1;
@@ -203,7 +504,9 @@ static void gb_process_request(struct gb_operation_hdr *hdr,
         return;
     }
 
+    gb_trace(GB_TRACE_HANDLER_START, operation->cport, hdr);
     result = op_handler->handler(operation);
+    gb_trace(GB_TRACE_HANDLER_END, operation->cport, hdr);
     gb_debug("%s: %u\n", gb_handler_name(op_handler), result);
 
     if (hdr->id)
@@ -211,46 +514,94 @@ static void gb_process_request(struct gb_operation_hdr *hdr,
     op_mark_send_time(operation);
 }
 
-static bool gb_operation_has_timedout(struct gb_operation *operation)
+static inline struct list_head *gb_inflight_bucket(unsigned int cport,
+                                                   __le16 id)
+{
+    return &g_cport[cport].inflight[le16_to_cpu(id) &
+                                    (GB_INFLIGHT_HASH_SIZE - 1)];
+}
+
+/**
+ * Track an outgoing request until its response arrives or it times out
+ *
+ * Requests are indexed by ID for the response lookup, and appended to the
+ * CPort tx_fifo. Since every request gets the same timeout, tx_fifo is
+ * sorted by deadline and its head is always the next request to expire.
+ *
+ * @note This function should be called from an atomic context
+ */
+static void gb_inflight_add(struct gb_operation *operation)
+{
+    struct gb_operation_hdr *hdr = operation->request_buffer;
+
+    operation->deadline = clock_systimer() + TIMEOUT_WD_DELAY;
+    list_add(&g_cport[operation->cport].tx_fifo, &operation->list);
+    list_add(gb_inflight_bucket(operation->cport, hdr->id),
+             &operation->hash_list);
+}
+
+/**
+ * @note This function should be called from an atomic context
+ */
+static void gb_inflight_del(struct gb_operation *operation)
+{
+    list_del(&operation->list);
+    list_del(&operation->hash_list);
+}
+
+/**
+ * Find and remove the outgoing request matching a response ID
+ */
+static struct gb_operation *gb_inflight_take(unsigned int cport, __le16 id)
 {
-    struct timespec current_time;
-    struct timespec timeout_time;
+    struct list_head *bucket = gb_inflight_bucket(cport, id);
+    struct list_head *iter;
+    struct gb_operation *op;
+    struct gb_operation_hdr *op_hdr;
+    irqstate_t flags;
+
+    flags = irqsave();
 
-    timeout_time.tv_sec = operation->time.tv_sec +
-                          TIMEOUT_IN_MS / ONE_SEC_IN_MSEC;
-    timeout_time.tv_nsec = operation->time.tv_nsec +
-                          (TIMEOUT_IN_MS % ONE_SEC_IN_MSEC) * ONE_MSEC_IN_NSEC;
-    clock_gettime(CLOCK_MONOTONIC, &current_time);
+    list_foreach(bucket, iter) {
+        op = list_entry(iter, struct gb_operation, hash_list);
+        op_hdr = op->request_buffer;
 
-    if (current_time.tv_sec > timeout_time.tv_sec)
-        return true;
+        if (id != op_hdr->id)
+            continue;
 
-    if (current_time.tv_sec < timeout_time.tv_sec)
-        return false;
+        gb_inflight_del(op);
+        irqrestore(flags);
+        return op;
+    }
 
-    return current_time.tv_nsec > timeout_time.tv_nsec;
+    irqrestore(flags);
+    return NULL;
 }
 
 /**
  * Update watchdog state
  *
  * Cancel cport watchdog if there is no outgoing message waiting for a response,
- * or update the watchdog if there is still outgoing messages.
- *
- * TODO use fine-grain timeout delay when doing the update
+ * or arm it to fire when the oldest outgoing message expires.
  *
- * @note This function should be called from an atomic context
+ * @note This function is called from thread context, it disables interrupts
+ *       itself while it looks at the CPort TX FIFO and rearms the watchdog.
  */
 static void gb_watchdog_update(unsigned int cport)
 {
+    struct gb_operation *op;
     irqstate_t flags;
+    int32_t delay;
 
     flags = irqsave();
 
     if (list_is_empty(&g_cport[cport].tx_fifo)) {
         wd_cancel(&g_cport[cport].timeout_wd);
     } else {
-        wd_start(&g_cport[cport].timeout_wd, TIMEOUT_WD_DELAY,
+        op = list_entry(g_cport[cport].tx_fifo.next, struct gb_operation,
+                        list);
+        delay = (int32_t) (op->deadline - clock_systimer());
+        wd_start(&g_cport[cport].timeout_wd, delay > 0 ? delay : 1,
                  gb_operation_timeout, 1, cport);
     }
 
@@ -260,18 +611,24 @@ static void gb_watchdog_update(unsigned int cport)
 static void gb_clean_timedout_operation(unsigned int cport)
 {
     irqstate_t flags;
-    struct list_head *iter, *iter_next;
     struct gb_operation *op;
 
-    list_foreach_safe(&g_cport[cport].tx_fifo, iter, iter_next) {
-        op = list_entry(iter, struct gb_operation, list);
+    while (1) {
+        flags = irqsave();
 
-        if (!gb_operation_has_timedout(op)) {
-            continue;
+        if (list_is_empty(&g_cport[cport].tx_fifo)) {
+            irqrestore(flags);
+            break;
         }
 
-        flags = irqsave();
-        list_del(iter);
+        op = list_entry(g_cport[cport].tx_fifo.next, struct gb_operation,
+                        list);
+        if ((int32_t) (op->deadline - clock_systimer()) > 0) {
+            irqrestore(flags);
+            break;
+        }
+
+        gb_inflight_del(op);
         irqrestore(flags);
 
         if (op->callback) {
@@ -286,113 +643,359 @@ static void gb_clean_timedout_operation(unsigned int cport)
 static void gb_process_response(struct gb_operation_hdr *hdr,
                                 struct gb_operation *operation)
 {
-    irqstate_t flags;
-    struct list_head *iter, *iter_next;
     struct gb_operation *op;
-    struct gb_operation_hdr *op_hdr;
 
-    list_foreach_safe(&g_cport[operation->cport].tx_fifo, iter, iter_next) {
-        op = list_entry(iter, struct gb_operation, list);
-        op_hdr = op->request_buffer;
+    op = gb_inflight_take(operation->cport, hdr->id);
+    if (!op) {
+        gb_error("CPort %u: cannot find matching request for response %hu. Dropping message.\n",
+                 operation->cport, le16_to_cpu(hdr->id));
+        return;
+    }
 
-        if (hdr->id != op_hdr->id)
-            continue;
+    gb_watchdog_update(operation->cport);
 
-        flags = irqsave();
-        list_del(iter);
-        gb_watchdog_update(operation->cport);
-        irqrestore(flags);
+    /* attach this response with the original request */
+    gb_operation_ref(operation);
+    op->response = operation;
+    op_mark_recv_time(op);
+    if (op->callback) {
+        gb_trace(GB_TRACE_HANDLER_START, operation->cport, hdr);
+        op->callback(op);
+        gb_trace(GB_TRACE_HANDLER_END, operation->cport, hdr);
+    }
+    gb_operation_unref(op);
+}
 
-        /* attach this response with the original request */
-        gb_operation_ref(operation);
-        op->response = operation;
-        op_mark_recv_time(op);
-        if (op->callback)
-            op->callback(op);
-        gb_operation_unref(op);
+static void gb_process_rx_operation(unsigned int cport,
+                                    struct gb_operation *operation)
+{
+    struct gb_operation_hdr *hdr = operation->request_buffer;
+
+    if (hdr == &timedout_hdr) {
+        gb_clean_timedout_operation(cport);
         return;
     }
 
-    gb_error("CPort %u: cannot find matching request for response %hu. Dropping message.\n",
-             operation->cport, le16_to_cpu(hdr->id));
+    if (hdr->type & GB_TYPE_RESPONSE_FLAG)
+        gb_process_response(hdr, operation);
+    else
+        gb_process_request(hdr, operation);
+    gb_operation_destroy(operation);
 }
 
-static void *gb_pending_message_worker(void *data)
+/**
+ * Remove the oldest operation from the CPort RX fifo
+ *
+ * @note This function should be called from an atomic context
+ */
+static struct gb_operation *gb_rx_fifo_pop(unsigned int cport)
 {
-    const int cportid = (int) data;
-    irqstate_t flags;
+    struct gb_dispatch_stats *stats = &g_cport[cport].dispatch_stats;
     struct gb_operation *operation;
     struct list_head *head;
-    struct gb_operation_hdr *hdr;
-    int retval;
-
-    while (1) {
-        retval = sem_wait(&g_cport[cportid].rx_fifo_lock);
-        if (retval < 0)
-            continue;
-
-        if (g_cport[cportid].exit_worker &&
-            list_is_empty(&g_cport[cportid].rx_fifo)) {
-            break;
-        }
+    uint32_t latency;
 
-        flags = irqsave();
-        head = g_cport[cportid].rx_fifo.next;
-        list_del(g_cport[cportid].rx_fifo.next);
-        irqrestore(flags);
+    head = g_cport[cport].rx_fifo.next;
+    list_del(head);
 
-        operation = list_entry(head, struct gb_operation, list);
-        hdr = operation->request_buffer;
+    operation = list_entry(head, struct gb_operation, list);
 
-        if (hdr == &timedout_hdr) {
-            gb_clean_timedout_operation(cportid);
-            continue;
-        }
+    if (operation->request_buffer != &timedout_hdr)
+        gb_trace(GB_TRACE_DEQUEUED, cport, operation->request_buffer);
 
-        if (hdr->type & GB_TYPE_RESPONSE_FLAG)
-            gb_process_response(hdr, operation);
-        else
-            gb_process_request(hdr, operation);
-        gb_operation_destroy(operation);
-    }
+    latency = hrt_getusec() - operation->dispatch_ts;
+    if (latency > stats->latency_max)
+        stats->latency_max = latency;
+    stats->latency_total += latency;
+    stats->dispatched++;
+    stats->queue_depth--;
 
-    return NULL;
+    return operation;
 }
 
-#if defined(CONFIG_UNIPRO_ZERO_COPY)
-static struct gb_operation *gb_rx_create_operation(unsigned cport, void *data,
-                                                   size_t size)
+/**
+ * Queue an operation in the CPort RX fifo and wake up its worker
+ *
+ * @note Can be called from interrupt context
+ */
+static void gb_rx_fifo_push(unsigned int cport, struct gb_operation *operation)
 {
-    struct gb_operation *op;
+    struct gb_dispatch_stats *stats = &g_cport[cport].dispatch_stats;
+    irqstate_t flags;
 
-    op = _gb_operation_create(cport);
-    if (!op)
-        return NULL;
+    flags = irqsave();
 
-    op->is_unipro_rx_buf = true;
-    op->request_buffer = data;
+    operation->dispatch_ts = hrt_getusec();
+    list_add(&g_cport[cport].rx_fifo, &operation->list);
 
-    return op;
-}
-#else
-static struct gb_operation *gb_rx_create_operation(unsigned cport, void *data,
-                                                   size_t size)
-{
-    struct gb_operation *op;
+    if (operation->request_buffer != &timedout_hdr)
+        gb_trace(GB_TRACE_RX_QUEUED, cport, operation->request_buffer);
 
-    op = gb_operation_create(cport, 0, size - sizeof(struct gb_operation_hdr));
-    if (!op)
-        return NULL;
+    if (++stats->queue_depth > stats->queue_depth_max)
+        stats->queue_depth_max = stats->queue_depth;
 
-    memcpy(op->request_buffer, data, size);
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+    gb_dispatch_schedule(cport);
+#else
+    sem_post(&g_cport[cport].rx_fifo_lock);
+#endif
 
-    return op;
+    irqrestore(flags);
 }
-#endif
 
-int greybus_rx_handler(unsigned int cport, void *data, size_t size)
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+/**
+ * Make a CPort with pending messages visible to the dispatch workers
+ *
+ * A CPort is never queued while a worker is processing one of its messages,
+ * this guarantees that the messages of a CPort are handled in order. The
+ * worker re-queues the CPort once it is done with the message.
+ *
+ * @note This function should be called from an atomic context
+ */
+static void gb_dispatch_schedule(unsigned int cport)
+{
+    struct gb_cport_driver *cport_driver = &g_cport[cport];
+
+    if (cport_driver->dispatch_queued || cport_driver->dispatch_running)
+        return;
+
+    list_add(&g_dispatch.ready[cport_driver->dispatch_priority],
+             &cport_driver->dispatch_node);
+    cport_driver->dispatch_queued = true;
+    sem_post(&g_dispatch.ready_sem);
+}
+
+/**
+ * Pick the next CPort to serve, highest priority class first
+ *
+ * @note This function should be called from an atomic context
+ */
+static struct gb_cport_driver *gb_dispatch_pick(void)
+{
+    struct gb_cport_driver *cport_driver;
+    struct list_head *ready;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(gb_dispatch_order); i++) {
+        ready = &g_dispatch.ready[gb_dispatch_order[i]];
+        if (list_is_empty(ready))
+            continue;
+
+        cport_driver = list_entry(ready->next, struct gb_cport_driver,
+                                  dispatch_node);
+        list_del(&cport_driver->dispatch_node);
+        cport_driver->dispatch_queued = false;
+        cport_driver->dispatch_running = true;
+        return cport_driver;
+    }
+
+    return NULL;
+}
+
+static void *gb_dispatch_worker(void *data)
+{
+    struct gb_cport_driver *cport_driver;
+    struct gb_operation *operation;
+    unsigned int cport;
+    irqstate_t flags;
+    int retval;
+
+    while (1) {
+        retval = sem_wait(&g_dispatch.ready_sem);
+        if (retval < 0)
+            continue;
+
+        if (g_dispatch.exit_worker)
+            break;
+
+        flags = irqsave();
+
+        cport_driver = gb_dispatch_pick();
+        if (!cport_driver) {
+            irqrestore(flags);
+            continue;
+        }
+
+        cport = cport_driver - g_cport;
+        operation = gb_rx_fifo_pop(cport);
+
+        irqrestore(flags);
+
+        gb_process_rx_operation(cport, operation);
+
+        flags = irqsave();
+
+        cport_driver->dispatch_running = false;
+        if (!list_is_empty(&cport_driver->rx_fifo)) {
+            gb_dispatch_schedule(cport);
+        } else if (cport_driver->dispatch_wait) {
+            cport_driver->dispatch_wait = false;
+            sem_post(&cport_driver->dispatch_idle);
+        }
+
+        irqrestore(flags);
+    }
+
+    return NULL;
+}
+
+static int gb_dispatch_init(void)
+{
+    pthread_attr_t thread_attr;
+    int retval;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(g_dispatch.ready); i++)
+        list_init(&g_dispatch.ready[i]);
+
+    sem_init(&g_dispatch.ready_sem, 0, 0);
+    sem_setprotocol(&g_dispatch.ready_sem, SEM_PRIO_NONE);
+    g_dispatch.exit_worker = false;
+    g_dispatch.thread_count = 0;
+
+    retval = pthread_attr_init(&thread_attr);
+    if (retval)
+        return -retval;
+
+    retval = pthread_attr_setstacksize(&thread_attr,
+                                       CONFIG_GREYBUS_WORKER_POOL_STACK_SIZE);
+    if (retval)
+        goto out;
+
+    for (i = 0; i < CONFIG_GREYBUS_WORKER_POOL_THREADS; i++) {
+        retval = pthread_create(&g_dispatch.thread[i], &thread_attr,
+                                gb_dispatch_worker, NULL);
+        if (retval) {
+            gb_error("Can not create Greybus dispatch worker %d\n", i);
+            break;
+        }
+
+        g_dispatch.thread_count++;
+    }
+
+    retval = g_dispatch.thread_count ? 0 : -retval;
+
+out:
+    pthread_attr_destroy(&thread_attr);
+    return retval;
+}
+
+static void gb_dispatch_deinit(void)
 {
+    int i;
+
+    g_dispatch.exit_worker = true;
+
+    for (i = 0; i < g_dispatch.thread_count; i++)
+        sem_post(&g_dispatch.ready_sem);
+
+    for (i = 0; i < g_dispatch.thread_count; i++)
+        pthread_join(g_dispatch.thread[i], NULL);
+
+    g_dispatch.thread_count = 0;
+    sem_destroy(&g_dispatch.ready_sem);
+}
+
+/**
+ * Wait until the dispatch workers are done with the messages of a CPort
+ */
+static void gb_dispatch_flush(unsigned int cport)
+{
+    struct gb_cport_driver *cport_driver = &g_cport[cport];
     irqstate_t flags;
+    int retval;
+
+    flags = irqsave();
+
+    if (!cport_driver->dispatch_queued && !cport_driver->dispatch_running) {
+        irqrestore(flags);
+        return;
+    }
+
+    cport_driver->dispatch_wait = true;
+    irqrestore(flags);
+
+    do {
+        retval = sem_wait(&cport_driver->dispatch_idle);
+    } while (retval < 0 && errno == EINTR);
+}
+#else
+static void *gb_pending_message_worker(void *data)
+{
+    const int cportid = (int) data;
+    irqstate_t flags;
+    struct gb_operation *operation;
+    int retval;
+
+    while (1) {
+        retval = sem_wait(&g_cport[cportid].rx_fifo_lock);
+        if (retval < 0)
+            continue;
+
+        if (g_cport[cportid].exit_worker &&
+            list_is_empty(&g_cport[cportid].rx_fifo)) {
+            break;
+        }
+
+        flags = irqsave();
+        operation = gb_rx_fifo_pop(cportid);
+        irqrestore(flags);
+
+        gb_process_rx_operation(cportid, operation);
+    }
+
+    return NULL;
+}
+#endif
+
+int gb_dispatch_get_stats(unsigned int cport, struct gb_dispatch_stats *stats)
+{
+    irqstate_t flags;
+
+    if (cport >= cport_count || !stats)
+        return -EINVAL;
+
+    flags = irqsave();
+    memcpy(stats, &g_cport[cport].dispatch_stats, sizeof(*stats));
+    irqrestore(flags);
+
+    return 0;
+}
+
+#if defined(CONFIG_UNIPRO_ZERO_COPY)
+static struct gb_operation *gb_rx_create_operation(unsigned cport, void *data,
+                                                   size_t size)
+{
+    struct gb_operation *op;
+
+    op = _gb_operation_create(cport);
+    if (!op)
+        return NULL;
+
+    op->is_unipro_rx_buf = true;
+    op->request_buffer = data;
+
+    return op;
+}
+#else
+static struct gb_operation *gb_rx_create_operation(unsigned cport, void *data,
+                                                   size_t size)
+{
+    struct gb_operation *op;
+
+    op = gb_operation_create(cport, 0, size - sizeof(struct gb_operation_hdr));
+    if (!op)
+        return NULL;
+
+    memcpy(op->request_buffer, data, size);
+
+    return op;
+}
+#endif
+
+int greybus_rx_handler(unsigned int cport, void *data, size_t size)
+{
     struct gb_operation *op;
     struct gb_operation_hdr *hdr = data;
     struct gb_operation_handler *op_handler;
@@ -422,16 +1025,9 @@ int greybus_rx_handler(unsigned int cport, void *data, size_t size)
     }
 
     gb_dump(data, size);
+    gb_trace(GB_TRACE_RX, cport, hdr);
 
-    if (gb_tape && gb_tape_fd >= 0) {
-        struct gb_tape_record_header record_hdr = {
-            .size = size,
-            .cport = cport,
-        };
-
-        gb_tape->write(gb_tape_fd, &record_hdr, sizeof(record_hdr));
-        gb_tape->write(gb_tape_fd, data, size);
-    }
+    gb_tape_record(cport, data, size);
 
     op_handler = find_operation_handler(hdr->type, cport);
     if (op_handler && op_handler->fast_handler) {
@@ -440,16 +1036,26 @@ int greybus_rx_handler(unsigned int cport, void *data, size_t size)
         return 0;
     }
 
+#ifdef CONFIG_GREYBUS_ATOMIC_HANDLERS
+    if (op_handler && op_handler->atomic && transport_backend->send_async) {
+        op = gb_rx_create_operation(cport, data, hdr_size);
+        if (!op)
+            return -ENOMEM;
+
+        op->is_atomic = true;
+        op_mark_recv_time(op);
+        gb_process_request(op->request_buffer, op);
+        gb_operation_unref(op);
+        return 0;
+    }
+#endif
+
     op = gb_rx_create_operation(cport, data, hdr_size);
     if (!op)
         return -ENOMEM;
 
     op_mark_recv_time(op);
-
-    flags = irqsave();
-    list_add(&g_cport[cport].rx_fifo, &op->list);
-    sem_post(&g_cport[cport].rx_fifo_lock);
-    irqrestore(flags);
+    gb_rx_fifo_push(cport, op);
 
     return 0;
 }
@@ -461,7 +1067,7 @@ static void gb_flush_tx_fifo(unsigned int cport)
     list_foreach_safe(&g_cport[cport].tx_fifo, iter, iter_next) {
         struct gb_operation *op = list_entry(iter, struct gb_operation, list);
 
-        list_del(iter);
+        gb_inflight_del(op);
         gb_operation_unref(op);
     }
 }
@@ -477,8 +1083,15 @@ int gb_unregister_driver(unsigned int cport)
     wd_cancel(&g_cport[cport].timeout_wd);
 
     g_cport[cport].exit_worker = true;
+#ifdef CONFIG_GREYBUS_TX_BATCH
+    gb_batch_discard(cport);
+#endif
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+    gb_dispatch_flush(cport);
+#else
     sem_post(&g_cport[cport].rx_fifo_lock);
     pthread_join(g_cport[cport].thread, NULL);
+#endif
 
     gb_flush_tx_fifo(cport);
 
@@ -491,8 +1104,10 @@ int gb_unregister_driver(unsigned int cport)
 
 int _gb_register_driver(unsigned int cport, struct gb_driver *driver)
 {
+#ifndef CONFIG_GREYBUS_WORKER_POOL
     pthread_attr_t thread_attr;
     pthread_attr_t *thread_attr_ptr = &thread_attr;
+#endif
     int retval;
 
     gb_debug("Registering Greybus driver on CP%u\n", cport);
@@ -524,151 +1139,592 @@ int _gb_register_driver(unsigned int cport, struct gb_driver *driver)
             gb_error("Can not init %s\n", gb_driver_name(driver));
             return retval;
         }
-    }
+    }
+
+    retval = gb_operation_pool_init(cport, driver->op_pool_size ?
+                                    driver->op_pool_size :
+                                    CONFIG_GREYBUS_OPERATION_POOL_SIZE);
+    if (retval) {
+        gb_error("Can not allocate operation pool for %s\n",
+                 gb_driver_name(driver));
+        goto operation_pool_init_error;
+    }
+
+    if (driver->op_handlers) {
+        qsort(driver->op_handlers, driver->op_handlers_count,
+              sizeof(*driver->op_handlers), gb_compare_handlers);
+    }
+
+    g_cport[cport].exit_worker = false;
+
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+    if (driver->dispatch_priority >= GB_DISPATCH_PRIORITY_COUNT) {
+        gb_error("Invalid dispatch priority for %s\n",
+                 gb_driver_name(driver));
+        retval = -EINVAL;
+        goto operation_pool_init_error;
+    }
+
+    g_cport[cport].dispatch_priority = driver->dispatch_priority;
+    g_cport[cport].driver = driver;
+
+    return 0;
+#else
+    if (!driver->stack_size)
+        driver->stack_size = DEFAULT_STACK_SIZE;
+
+    retval = pthread_attr_init(&thread_attr);
+    if (retval)
+        goto pthread_attr_init_error;
+
+    retval = pthread_attr_setstacksize(&thread_attr, driver->stack_size);
+    if (retval)
+        goto pthread_attr_setstacksize_error;
+
+    retval = pthread_create(&g_cport[cport].thread, &thread_attr,
+                            gb_pending_message_worker, (unsigned*) cport);
+    if (retval)
+        goto pthread_create_error;
+
+    pthread_attr_destroy(&thread_attr);
+    thread_attr_ptr = NULL;
+
+    g_cport[cport].driver = driver;
+
+    return 0;
+
+pthread_create_error:
+pthread_attr_setstacksize_error:
+    if (thread_attr_ptr != NULL)
+        pthread_attr_destroy(&thread_attr);
+pthread_attr_init_error:
+    gb_error("Can not create thread for %s\n: ", gb_driver_name(driver));
+#endif
+operation_pool_init_error:
+    if (driver->exit)
+        driver->exit(cport);
+    return retval;
+}
+
+int gb_listen(unsigned int cport)
+{
+    DEBUGASSERT(transport_backend);
+    DEBUGASSERT(transport_backend->listen);
+
+    if (cport >= cport_count) {
+        gb_error("Invalid cport number %u\n", cport);
+        return -EINVAL;
+    }
+
+    if (!g_cport[cport].driver) {
+        gb_error("No driver registered! Can not connect CP%u.\n", cport);
+        return -EINVAL;
+    }
+
+    return transport_backend->listen(cport);
+}
+
+int gb_stop_listening(unsigned int cport)
+{
+    DEBUGASSERT(transport_backend);
+    DEBUGASSERT(transport_backend->stop_listening);
+
+    if (cport >= cport_count) {
+        gb_error("Invalid cport number %u\n", cport);
+        return -EINVAL;
+    }
+
+    if (!g_cport[cport].driver) {
+        gb_error("No driver registered! Can not disconnect CP%u.\n",
+                 cport);
+        return -EINVAL;
+    }
+
+    return transport_backend->stop_listening(cport);
+}
+
+static void gb_operation_timeout(int argc, uint32_t cport, ...)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    /* timedout operation could potentially already been queued */
+    if (!list_is_empty(&g_cport[cport].timedout_operation.list)) {
+        irqrestore(flags);
+        return;
+    }
+
+    gb_rx_fifo_push(cport, &g_cport[cport].timedout_operation);
+    irqrestore(flags);
+}
+
+/**
+ * Assign an ID to an outgoing request and track it if it needs a response
+ *
+ * @note This function should be called from an atomic context
+ */
+static void gb_operation_track_request(struct gb_operation *operation,
+                                       gb_operation_callback callback,
+                                       bool need_response)
+{
+    struct gb_operation_hdr *hdr = operation->request_buffer;
+
+    hdr->id = 0;
+
+    if (!need_response)
+        return;
+
+    hdr->id = cpu_to_le16(atomic_inc(&request_id));
+    if (hdr->id == 0) /* ID 0 is for request with no response */
+        hdr->id = cpu_to_le16(atomic_inc(&request_id));
+    operation->callback = callback;
+    gb_operation_ref(operation);
+    gb_inflight_add(operation);
+    if (!WDOG_ISACTIVE(&g_cport[operation->cport].timeout_wd)) {
+        wd_start(&g_cport[operation->cport].timeout_wd, TIMEOUT_WD_DELAY,
+                 gb_operation_timeout, 1, operation->cport);
+    }
+}
+
+/**
+ * Stop tracking a request that could not be sent
+ *
+ * @note This function should be called from an atomic context
+ */
+static void gb_operation_untrack_request(struct gb_operation *operation)
+{
+    struct gb_operation_hdr *hdr = operation->request_buffer;
+
+    if (!hdr->id)
+        return;
+
+    gb_inflight_del(operation);
+    gb_watchdog_update(operation->cport);
+    gb_operation_unref(operation);
+}
+
+/**
+ * @brief Send an operation buffer followed by its external data
+ *
+ * The header size already accounts for the external data. Backends without
+ * scatter-gather support get a bounce buffer.
+ */
+static int gb_operation_send_buf(unsigned int cport, void *buf,
+                                 const struct gb_iovec *ext)
+{
+    struct gb_operation_hdr *hdr = buf;
+    struct gb_iovec iov[2];
+    size_t len = le16_to_cpu(hdr->size);
+    void *bounce;
+    int retval;
+
+    gb_dump(buf, len - ext->len);
+    gb_trace(GB_TRACE_TX, cport, hdr);
+
+    if (!ext->len) {
+        retval = transport_backend->send(cport, buf, len);
+        goto out;
+    }
+
+    iov[0].base = buf;
+    iov[0].len = len - ext->len;
+    iov[1] = *ext;
+
+    if (transport_backend->send_iov) {
+        retval = transport_backend->send_iov(cport, iov, 2);
+        goto out;
+    }
+
+    bounce = transport_backend->alloc_buf ?
+             transport_backend->alloc_buf(len) : malloc(len);
+    if (!bounce)
+        return -ENOMEM;
+
+    memcpy(bounce, iov[0].base, iov[0].len);
+    memcpy((char *) bounce + iov[0].len, iov[1].base, iov[1].len);
+
+    retval = transport_backend->send(cport, bounce, len);
+
+    if (transport_backend->free_buf)
+        transport_backend->free_buf(bounce);
+    else
+        free(bounce);
+
+out:
+    if (!retval)
+        gb_trace(GB_TRACE_TX_DONE, cport, hdr);
+    return retval;
+}
+
+#ifdef CONFIG_GREYBUS_ATOMIC_HANDLERS
+static int gb_operation_response_sent(int status, const void *buf, void *priv)
+{
+    struct gb_operation *operation = priv;
+
+    if (!status)
+        gb_trace(GB_TRACE_TX_DONE, operation->cport, buf);
+    gb_operation_unref(operation);
+
+    return 0;
+}
+
+/**
+ * Queue a response of an operation handled from the RX path
+ *
+ * The operation is kept alive until the backend is done with hdr, which
+ * must belong to the operation.
+ */
+static int gb_operation_send_hdr_async(struct gb_operation *operation,
+                                       struct gb_operation_hdr *hdr)
+{
+    int retval;
+
+    gb_dump((char *) hdr, le16_to_cpu(hdr->size));
+    gb_trace(GB_TRACE_TX, operation->cport, hdr);
+
+    gb_operation_ref(operation);
+    retval = transport_backend->send_async(operation->cport, hdr,
+                                           le16_to_cpu(hdr->size),
+                                           gb_operation_response_sent,
+                                           operation);
+    if (retval)
+        gb_operation_unref(operation);
+
+    return retval;
+}
+
+static int gb_operation_send_response_async(struct gb_operation *operation)
+{
+    /* Gathering a payload is not supported from interrupt context */
+    if (operation->response_ext.len)
+        return -EINVAL;
+
+    return gb_operation_send_hdr_async(operation,
+                                       operation->response_buffer);
+}
+
+/**
+ * Queue the no memory response of an operation handled from the RX path
+ *
+ * The shared oom_hdr can't be used since the backend only sends it later,
+ * so the response is built in the operation.
+ */
+static int gb_operation_send_oom_response_async(struct gb_operation *operation)
+{
+    struct gb_operation_hdr *req_hdr = operation->request_buffer;
+
+    operation->oom_hdr = oom_hdr;
+    operation->oom_hdr.id = req_hdr->id;
+    operation->oom_hdr.type = GB_TYPE_RESPONSE_FLAG | req_hdr->type;
+
+    return gb_operation_send_hdr_async(operation, &operation->oom_hdr);
+}
+#else
+static int gb_operation_send_response_async(struct gb_operation *operation)
+{
+    return -ENOSYS;
+}
+
+static int gb_operation_send_oom_response_async(struct gb_operation *operation)
+{
+    return -ENOSYS;
+}
+#endif
+
+/**
+ * Hand a set of requests of the same CPort to the transport backend
+ *
+ * Requests without external data are submitted at once if the backend can
+ * send a batch, the call then only waits for the last one to be sent. Other
+ * requests are sent one after the other, stopping at the first failure.
+ *
+ * @param cport CPort the requests are sent on
+ * @param operations requests to send, in order
+ * @param count number of requests
+ * @param sent number of requests successfully sent
+ * @return 0 on success, a negative errno otherwise
+ */
+static int gb_operation_transmit(unsigned int cport,
+                                 struct gb_operation **operations,
+                                 size_t count, size_t *sent)
+{
+    const void *bufs[GB_TX_BATCH_CHUNK];
+    size_t lens[GB_TX_BATCH_CHUNK];
+    struct gb_operation_hdr *hdr;
+    int retval = 0;
+    int i;
+
+    *sent = 0;
+
+    if (count > 1 && count <= GB_TX_BATCH_CHUNK &&
+        transport_backend->send_batch) {
+        for (i = 0; i < count; i++) {
+            if (operations[i]->request_ext.len)
+                goto send_one_by_one;
+        }
+
+        for (i = 0; i < count; i++) {
+            hdr = operations[i]->request_buffer;
+            gb_dump(operations[i]->request_buffer, hdr->size);
+            gb_trace(GB_TRACE_TX, cport, hdr);
+            bufs[i] = operations[i]->request_buffer;
+            lens[i] = le16_to_cpu(hdr->size);
+        }
+
+        retval = transport_backend->send_batch(cport, bufs, lens, count);
+        if (retval)
+            return retval;
+
+        for (i = 0; i < count; i++) {
+            gb_trace(GB_TRACE_TX_DONE, cport, operations[i]->request_buffer);
+            op_mark_send_time(operations[i]);
+        }
 
-    if (driver->op_handlers) {
-        qsort(driver->op_handlers, driver->op_handlers_count,
-              sizeof(*driver->op_handlers), gb_compare_handlers);
+        *sent = count;
+        return 0;
     }
 
-    g_cport[cport].exit_worker = false;
+send_one_by_one:
+    for (i = 0; i < count; i++) {
+        retval = gb_operation_send_buf(cport, operations[i]->request_buffer,
+                                       &operations[i]->request_ext);
+        if (retval)
+            return retval;
 
-    if (!driver->stack_size)
-        driver->stack_size = DEFAULT_STACK_SIZE;
+        op_mark_send_time(operations[i]);
+        (*sent)++;
+    }
 
-    retval = pthread_attr_init(&thread_attr);
-    if (retval)
-        goto pthread_attr_init_error;
+    return 0;
+}
 
-    retval = pthread_attr_setstacksize(&thread_attr, driver->stack_size);
-    if (retval)
-        goto pthread_attr_setstacksize_error;
+int gb_operation_send_request(struct gb_operation *operation,
+                              gb_operation_callback callback,
+                              bool need_response)
+{
+    int retval = 0;
+    irqstate_t flags;
+    size_t sent;
 
-    retval = pthread_create(&g_cport[cport].thread, &thread_attr,
-                            gb_pending_message_worker, (unsigned*) cport);
-    if (retval)
-        goto pthread_create_error;
+    DEBUGASSERT(operation);
+    DEBUGASSERT(transport_backend);
+    DEBUGASSERT(transport_backend->send);
 
-    pthread_attr_destroy(&thread_attr);
-    thread_attr_ptr = NULL;
+    if (g_cport[operation->cport].exit_worker)
+        return -ENETDOWN;
 
-    g_cport[cport].driver = driver;
+    flags = irqsave();
 
-    return 0;
+    gb_operation_track_request(operation, callback, need_response);
+    retval = gb_operation_transmit(operation->cport, &operation, 1, &sent);
+    if (retval)
+        gb_operation_untrack_request(operation);
+
+    irqrestore(flags);
 
-pthread_create_error:
-pthread_attr_setstacksize_error:
-    if (thread_attr_ptr != NULL)
-        pthread_attr_destroy(&thread_attr);
-pthread_attr_init_error:
-    gb_error("Can not create thread for %s\n: ", gb_driver_name(driver));
-    if (driver->exit)
-        driver->exit(cport);
     return retval;
 }
 
-int gb_listen(unsigned int cport)
+int gb_operation_send_request_batch(struct gb_operation **operations,
+                                    size_t count,
+                                    gb_operation_callback callback,
+                                    bool need_response)
 {
+    unsigned int cport;
+    irqstate_t flags;
+    size_t chunk;
+    size_t sent;
+    int retval = 0;
+    int i, j;
+
     DEBUGASSERT(transport_backend);
-    DEBUGASSERT(transport_backend->listen);
+    DEBUGASSERT(transport_backend->send);
 
-    if (cport >= cport_count) {
-        gb_error("Invalid cport number %u\n", cport);
+    if (!operations || !count)
         return -EINVAL;
+
+    cport = operations[0]->cport;
+    for (i = 1; i < count; i++) {
+        if (operations[i]->cport != cport)
+            return -EINVAL;
     }
 
-    if (!g_cport[cport].driver) {
-        gb_error("No driver registered! Can not connect CP%u.\n", cport);
-        return -EINVAL;
+    if (g_cport[cport].exit_worker)
+        return -ENETDOWN;
+
+    for (i = 0; i < count; i += chunk) {
+        chunk = MIN(count - i, GB_TX_BATCH_CHUNK);
+
+        flags = irqsave();
+
+        for (j = 0; j < chunk; j++)
+            gb_operation_track_request(operations[i + j], callback,
+                                       need_response);
+
+        retval = gb_operation_transmit(cport, &operations[i], chunk, &sent);
+        if (retval) {
+            for (j = sent; j < chunk; j++)
+                gb_operation_untrack_request(operations[i + j]);
+        }
+
+        irqrestore(flags);
+
+        if (retval)
+            break;
     }
 
-    return transport_backend->listen(cport);
+    return retval;
 }
 
-int gb_stop_listening(unsigned int cport)
+#ifdef CONFIG_GREYBUS_TX_BATCH
+/**
+ * Send the requests queued on a CPort
+ *
+ * @note Must be called from thread context
+ */
+static void gb_batch_flush(unsigned int cport)
 {
-    DEBUGASSERT(transport_backend);
-    DEBUGASSERT(transport_backend->stop_listening);
+    struct gb_cport_driver *cport_driver = &g_cport[cport];
+    struct gb_operation *batch[CONFIG_GREYBUS_TX_BATCH_MAX];
+    irqstate_t flags;
+    size_t count;
+    size_t sent;
+    int retval;
+    int i;
 
-    if (cport >= cport_count) {
-        gb_error("Invalid cport number %u\n", cport);
-        return -EINVAL;
-    }
+    /* Keep the batches of a CPort in order */
+    while (sem_wait(&cport_driver->batch_lock) < 0 && errno == EINTR);
 
-    if (!g_cport[cport].driver) {
-        gb_error("No driver registered! Can not disconnect CP%u.\n",
-                 cport);
-        return -EINVAL;
+    flags = irqsave();
+
+    work_cancel(LPWORK, &cport_driver->batch_work);
+    count = cport_driver->batch_count;
+    memcpy(batch, cport_driver->batch, count * sizeof(*batch));
+    cport_driver->batch_count = 0;
+
+    irqrestore(flags);
+
+    if (count) {
+        retval = gb_operation_transmit(cport, batch, count, &sent);
+        if (retval) {
+            gb_error("CP%u: failed to send %u batched requests: %d\n", cport,
+                     count - sent, retval);
+
+            flags = irqsave();
+            for (i = sent; i < count; i++)
+                gb_operation_untrack_request(batch[i]);
+            irqrestore(flags);
+        }
+
+        for (i = 0; i < count; i++)
+            gb_operation_unref(batch[i]);
     }
 
-    return transport_backend->stop_listening(cport);
+    sem_post(&cport_driver->batch_lock);
 }
 
-static void gb_operation_timeout(int argc, uint32_t cport, ...)
+static void gb_batch_worker(void *data)
+{
+    gb_batch_flush((unsigned int) data);
+}
+
+/**
+ * Drop the requests queued on a CPort without sending them
+ */
+static void gb_batch_discard(unsigned int cport)
 {
+    struct gb_cport_driver *cport_driver = &g_cport[cport];
+    struct gb_operation *operation;
     irqstate_t flags;
 
     flags = irqsave();
 
-    /* timedout operation could potentially already been queued */
-    if (!list_is_empty(&g_cport[cport].timedout_operation.list)) {
-        irqrestore(flags);
-        return;
+    work_cancel(LPWORK, &cport_driver->batch_work);
+
+    while (cport_driver->batch_count) {
+        operation = cport_driver->batch[--cport_driver->batch_count];
+        gb_operation_untrack_request(operation);
+        gb_operation_unref(operation);
     }
 
-    list_add(&g_cport[cport].rx_fifo, &g_cport[cport].timedout_operation.list);
-    sem_post(&g_cport[cport].rx_fifo_lock);
     irqrestore(flags);
 }
 
-int gb_operation_send_request(struct gb_operation *operation,
-                              gb_operation_callback callback,
-                              bool need_response)
+int gb_operation_queue_request(struct gb_operation *operation,
+                               gb_operation_callback callback,
+                               bool need_response)
 {
-    struct gb_operation_hdr *hdr = operation->request_buffer;
-    int retval = 0;
+    struct gb_cport_driver *cport_driver;
+    unsigned int cport;
     irqstate_t flags;
+    uint32_t delay;
 
     DEBUGASSERT(operation);
     DEBUGASSERT(transport_backend);
-    DEBUGASSERT(transport_backend->send);
 
-    if (g_cport[operation->cport].exit_worker)
-        return -ENETDOWN;
+    cport = operation->cport;
+    cport_driver = &g_cport[cport];
 
-    hdr->id = 0;
+    if (cport_driver->exit_worker)
+        return -ENETDOWN;
 
     flags = irqsave();
 
-    if (need_response) {
-        hdr->id = cpu_to_le16(atomic_inc(&request_id));
-        if (hdr->id == 0) /* ID 0 is for request with no response */
-            hdr->id = cpu_to_le16(atomic_inc(&request_id));
-        clock_gettime(CLOCK_MONOTONIC, &operation->time);
-        operation->callback = callback;
-        gb_operation_ref(operation);
-        list_add(&g_cport[operation->cport].tx_fifo, &operation->list);
-        if (!WDOG_ISACTIVE(&g_cport[operation->cport].timeout_wd)) {
-            wd_start(&g_cport[operation->cport].timeout_wd, TIMEOUT_WD_DELAY,
-                     gb_operation_timeout, 1, operation->cport);
-        }
+    if (cport_driver->batch_count == CONFIG_GREYBUS_TX_BATCH_MAX) {
+        /* The flush of the previous batch is already scheduled */
+        irqrestore(flags);
+        return -EBUSY;
     }
 
-    gb_dump(operation->request_buffer, hdr->size);
-    retval = transport_backend->send(operation->cport,
-                                     operation->request_buffer,
-                                     le16_to_cpu(hdr->size));
-    op_mark_send_time(operation);
-    if (need_response && retval) {
-        list_del(&operation->list);
-        gb_watchdog_update(operation->cport);
-        gb_operation_unref(operation);
+    gb_operation_track_request(operation, callback, need_response);
+
+    /* The request stays queued after the caller released it */
+    gb_operation_ref(operation);
+    cport_driver->batch[cport_driver->batch_count++] = operation;
+
+    if (cport_driver->batch_count == 1 ||
+        cport_driver->batch_count == CONFIG_GREYBUS_TX_BATCH_MAX) {
+        delay = cport_driver->batch_count == 1 ?
+                MSEC2TICK(CONFIG_GREYBUS_TX_BATCH_LATENCY_MS) : 0;
+
+        work_cancel(LPWORK, &cport_driver->batch_work);
+        work_queue(LPWORK, &cport_driver->batch_work, gb_batch_worker,
+                   (void *) cport, delay);
     }
 
     irqrestore(flags);
 
-    return retval;
+    if (cport_driver->batch_count == CONFIG_GREYBUS_TX_BATCH_MAX &&
+        !up_interrupt_context()) {
+        gb_batch_flush(cport);
+    }
+
+    return 0;
+}
+
+int gb_operation_flush_requests(unsigned int cport)
+{
+    if (cport >= cport_count)
+        return -EINVAL;
+
+    gb_batch_flush(cport);
+
+    return 0;
+}
+#else
+int gb_operation_queue_request(struct gb_operation *operation,
+                               gb_operation_callback callback,
+                               bool need_response)
+{
+    return gb_operation_send_request(operation, callback, need_response);
+}
+
+int gb_operation_flush_requests(unsigned int cport)
+{
+    return cport < cport_count ? 0 : -EINVAL;
 }
+#endif
 
 static void gb_operation_callback_sync(struct gb_operation *operation)
 {
@@ -680,6 +1736,7 @@ int gb_operation_send_request_sync(struct gb_operation *operation)
     int retval;
 
     sem_init(&operation->sync_sem, 0, 0);
+    sem_setprotocol(&operation->sync_sem, SEM_PRIO_NONE);
 
     retval =
         gb_operation_send_request(operation, gb_operation_callback_sync, true);
@@ -702,6 +1759,10 @@ static int gb_operation_send_oom_response(struct gb_operation *operation)
     if (g_cport[operation->cport].exit_worker)
         return -ENETDOWN;
 
+    /* The RX path must not block in the backend */
+    if (operation->is_atomic)
+        return gb_operation_send_oom_response_async(operation);
+
     flags = irqsave();
 
     oom_hdr.id = req_hdr->id;
@@ -742,17 +1803,22 @@ int gb_operation_send_response(struct gb_operation *operation, uint8_t result)
     resp_hdr = operation->response_buffer;
     resp_hdr->result = result;
 
-    gb_dump(operation->response_buffer, resp_hdr->size);
     gb_loopback_log_exit(operation->cport, operation, resp_hdr->size);
-    retval = transport_backend->send(operation->cport,
-                                     operation->response_buffer,
-                                     le16_to_cpu(resp_hdr->size));
+    if (operation->is_atomic)
+        retval = gb_operation_send_response_async(operation);
+    else
+        retval = gb_operation_send_buf(operation->cport,
+                                       operation->response_buffer,
+                                       &operation->response_ext);
     if (retval) {
         gb_error("Greybus backend failed to send: error %d\n", retval);
         if (has_allocated_response) {
             gb_debug("Free the response buffer\n");
-            transport_backend->free_buf(operation->response_buffer);
+            gb_operation_free_buf(operation->cport,
+                                  operation->response_buffer,
+                                  operation->is_pool_response_buf);
             operation->response_buffer = NULL;
+            operation->is_pool_response_buf = false;
         }
         return retval;
     }
@@ -769,7 +1835,8 @@ void *gb_operation_alloc_response(struct gb_operation *operation, size_t size)
     DEBUGASSERT(operation);
 
     operation->response_buffer =
-        transport_backend->alloc_buf(size + sizeof(*resp_hdr));
+        gb_operation_alloc_buf(operation->cport, size + sizeof(*resp_hdr),
+                               &operation->is_pool_response_buf);
     if (!operation->response_buffer) {
         gb_error("Can not allocate a response_buffer\n");
         return NULL;
@@ -786,6 +1853,62 @@ void *gb_operation_alloc_response(struct gb_operation *operation, size_t size)
     return gb_operation_get_response_payload(operation);
 }
 
+static int gb_operation_append_data(void *buffer, struct gb_iovec *ext,
+                                    const void *data, size_t size)
+{
+    struct gb_operation_hdr *hdr = buffer;
+    size_t len;
+
+    if (!hdr || ext->len || !data || !size)
+        return -EINVAL;
+
+    len = le16_to_cpu(hdr->size) + size;
+    if (len > GB_MTU)
+        return -EOVERFLOW;
+
+    ext->base = data;
+    ext->len = size;
+    hdr->size = cpu_to_le16(len);
+
+    return 0;
+}
+
+/**
+ * @brief Append data to a request without copying it
+ *
+ * The data is sent right after the request payload and must stay valid, and
+ * reachable by the transport (DMA), until the request has been sent. Only one
+ * buffer can be appended per request.
+ *
+ * @param operation operation whose request buffer is already allocated
+ * @param data data to append
+ * @param size size of the data
+ * @return 0 on success, -EOVERFLOW if the message would exceed GB_MTU,
+ *         -EINVAL otherwise
+ */
+int gb_operation_append_request_data(struct gb_operation *operation,
+                                     const void *data, size_t size)
+{
+    DEBUGASSERT(operation);
+    return gb_operation_append_data(operation->request_buffer,
+                                    &operation->request_ext, data, size);
+}
+
+/**
+ * @brief Append data to a response without copying it
+ *
+ * Same as gb_operation_append_request_data(), for the response allocated with
+ * gb_operation_alloc_response(). The data must stay valid until the response
+ * has been sent, which makes the request payload a natural candidate.
+ */
+int gb_operation_append_response_data(struct gb_operation *operation,
+                                      const void *data, size_t size)
+{
+    DEBUGASSERT(operation);
+    return gb_operation_append_data(operation->response_buffer,
+                                    &operation->response_ext, data, size);
+}
+
 void gb_operation_destroy(struct gb_operation *operation)
 {
     DEBUGASSERT(operation);
@@ -812,14 +1935,21 @@ void gb_operation_unref(struct gb_operation *operation)
     if (operation->is_unipro_rx_buf) {
         unipro_rxbuf_free(operation->cport, operation->request_buffer);
     } else {
-        transport_backend->free_buf(operation->request_buffer);
+        gb_operation_free_buf(operation->cport, operation->request_buffer,
+                              operation->is_pool_request_buf);
     }
 
-    transport_backend->free_buf(operation->response_buffer);
+    gb_operation_free_buf(operation->cport, operation->response_buffer,
+                          operation->is_pool_response_buf);
     if (operation->response) {
         gb_operation_unref(operation->response);
     }
-    free(operation);
+
+    if (operation->is_pool_op) {
+        gb_operation_pool_put(operation);
+    } else {
+        free(operation);
+    }
 }
 
 static struct gb_operation *_gb_operation_create(unsigned int cport)
@@ -829,14 +1959,22 @@ static struct gb_operation *_gb_operation_create(unsigned int cport)
     if (cport >= cport_count)
         return NULL;
 
-    operation = malloc(sizeof(*operation));
-    if (!operation)
-        return NULL;
+    operation = gb_operation_pool_get(cport);
+    if (operation) {
+        memset(operation, 0, sizeof(*operation));
+        operation->is_pool_op = true;
+    } else {
+        operation = malloc(sizeof(*operation));
+        if (!operation)
+            return NULL;
+
+        memset(operation, 0, sizeof(*operation));
+    }
 
-    memset(operation, 0, sizeof(*operation));
     operation->cport = cport;
 
     list_init(&operation->list);
+    list_init(&operation->hash_list);
     atomic_init(&operation->ref_count, 1);
 
     return operation;
@@ -857,7 +1995,8 @@ struct gb_operation *gb_operation_create(unsigned int cport, uint8_t type,
     }
 
     operation->request_buffer =
-        transport_backend->alloc_buf(req_size + sizeof(*hdr));
+        gb_operation_alloc_buf(cport, req_size + sizeof(*hdr),
+                               &operation->is_pool_request_buf);
     if (!operation->request_buffer)
         goto malloc_error;
 
@@ -868,7 +2007,7 @@ struct gb_operation *gb_operation_create(unsigned int cport, uint8_t type,
 
     return operation;
 malloc_error:
-    free(operation);
+    gb_operation_unref(operation);
     return NULL;
 }
 
@@ -910,7 +2049,10 @@ uint8_t gb_operation_get_request_result(struct gb_operation *operation)
 
 int gb_init(struct gb_transport_backend *transport)
 {
-    int i;
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+    int retval;
+#endif
+    int i, j;
 
     if (!transport)
         return -EINVAL;
@@ -918,19 +2060,48 @@ int gb_init(struct gb_transport_backend *transport)
     cport_count = unipro_cport_count();
     g_cport = zalloc(sizeof(struct gb_cport_driver) * cport_count);
     for (i = 0; i < cport_count; i++) {
+        /* Signals received messages, never held as a lock */
         sem_init(&g_cport[i].rx_fifo_lock, 0, 0);
+        sem_setprotocol(&g_cport[i].rx_fifo_lock, SEM_PRIO_NONE);
         list_init(&g_cport[i].rx_fifo);
         list_init(&g_cport[i].tx_fifo);
+        for (j = 0; j < GB_INFLIGHT_HASH_SIZE; j++)
+            list_init(&g_cport[i].inflight[j]);
         wd_static(&g_cport[i].timeout_wd);
         g_cport[i].timedout_operation.request_buffer = &timedout_hdr;
         list_init(&g_cport[i].timedout_operation.list);
+#ifdef CONFIG_GREYBUS_OPERATION_POOL
+        list_init(&g_cport[i].pool.free_ops);
+        list_init(&g_cport[i].pool.free_bufs);
+#endif
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+        list_init(&g_cport[i].dispatch_node);
+        sem_init(&g_cport[i].dispatch_idle, 0, 0);
+        sem_setprotocol(&g_cport[i].dispatch_idle, SEM_PRIO_NONE);
+#endif
+#ifdef CONFIG_GREYBUS_TX_BATCH
+        sem_init(&g_cport[i].batch_lock, 0, 1);
+#endif
     }
 
     atomic_init(&request_id, (uint32_t) 0);
 
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+    retval = gb_dispatch_init();
+    if (retval) {
+        gb_error("Can not start the Greybus dispatch workers\n");
+        free(g_cport);
+        g_cport = NULL;
+        return retval;
+    }
+#endif
+
     transport_backend = transport;
     transport_backend->init();
 
+    if (gb_trace_init())
+        gb_error("Can not register the Greybus trace device\n");
+
     return 0;
 }
 
@@ -946,8 +2117,19 @@ void gb_deinit(void)
 
         wd_delete(&g_cport[i].timeout_wd);
         sem_destroy(&g_cport[i].rx_fifo_lock);
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+        sem_destroy(&g_cport[i].dispatch_idle);
+#endif
+#ifdef CONFIG_GREYBUS_TX_BATCH
+        sem_destroy(&g_cport[i].batch_lock);
+#endif
+        gb_operation_pool_deinit(i);
     }
 
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+    gb_dispatch_deinit();
+#endif
+
     free(g_cport);
 
     if (transport_backend->exit)
@@ -955,98 +2137,6 @@ void gb_deinit(void)
     transport_backend = NULL;
 }
 
-int gb_tape_register_mechanism(struct gb_tape_mechanism *mechanism)
-{
-    if (!mechanism || !mechanism->open || !mechanism->close ||
-        !mechanism->read || !mechanism->write)
-        return -EINVAL;
-
-    if (gb_tape)
-        return -EBUSY;
-
-    gb_tape = mechanism;
-
-    return 0;
-}
-
-int gb_tape_communication(const char *pathname)
-{
-    if (!gb_tape)
-        return -EINVAL;
-
-    if (gb_tape_fd >= 0)
-        return -EBUSY;
-
-    gb_tape_fd = gb_tape->open(pathname, GB_TAPE_WRONLY);
-    if (gb_tape_fd < 0)
-        return gb_tape_fd;
-
-    return 0;
-}
-
-int gb_tape_stop(void)
-{
-    if (!gb_tape || gb_tape_fd < 0)
-        return -EINVAL;
-
-    gb_tape->close(gb_tape_fd);
-    gb_tape_fd = -EBADFD;
-
-    return 0;
-}
-
-int gb_tape_replay(const char *pathname)
-{
-    struct gb_tape_record_header hdr;
-    char *buffer;
-    ssize_t nread;
-    int retval = 0;
-    int fd;
-
-    if (!pathname || !gb_tape)
-        return -EINVAL;
-
-    lowsyslog("greybus: replaying '%s'...\n", pathname);
-
-    fd = gb_tape->open(pathname, GB_TAPE_RDONLY);
-    if (fd < 0)
-        return fd;
-
-    buffer = malloc(CPORT_BUF_SIZE);
-    if (!buffer) {
-        retval = -ENOMEM;
-        goto error_buffer_alloc;
-    }
-
-    while (1) {
-        nread = gb_tape->read(fd, &hdr, sizeof(hdr));
-        if (!nread)
-            break;
-
-        if (nread != sizeof(hdr)) {
-            gb_error("gb-tape: invalid byte count read, aborting...\n");
-            retval = -EIO;
-            break;
-        }
-
-        nread = gb_tape->read(fd, buffer, hdr.size);
-        if (hdr.size != nread) {
-            gb_error("gb-tape: invalid byte count read, aborting...\n");
-            retval = -EIO;
-            break;
-        }
-
-        greybus_rx_handler(hdr.cport, buffer, nread);
-    }
-
-    free(buffer);
-
-error_buffer_alloc:
-    gb_tape->close(fd);
-
-    return retval;
-}
-
 int gb_notify(unsigned cport, enum gb_event event)
 {
     if (cport >= cport_count)
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Greybus statistics in procfs:
+ *
+ *   /proc/greybus  dispatch and operation pool counters of the active CPorts
+ */
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/kmalloc.h>
+#include <nuttx/util.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/fs/procfs.h>
+#include <nuttx/greybus/greybus.h>
+
+#if !defined(CONFIG_DISABLE_MOUNTPOINT) && defined(CONFIG_FS_PROCFS)
+
+#define GB_PROCFS_BUFSIZE   1536
+
+struct gb_procfs_file {
+    struct procfs_file_s base;
+    size_t len;
+    char buf[GB_PROCFS_BUFSIZE];
+};
+
+static int gb_procfs_open(struct file *filep, const char *relpath,
+                          int oflags, mode_t mode);
+static int gb_procfs_close(struct file *filep);
+static ssize_t gb_procfs_read(struct file *filep, char *buffer,
+                              size_t buflen);
+static int gb_procfs_dup(const struct file *oldp, struct file *newp);
+static int gb_procfs_stat(const char *relpath, struct stat *buf);
+
+const struct procfs_operations gb_procfsoperations = {
+    gb_procfs_open,             /* open */
+    gb_procfs_close,            /* close */
+    gb_procfs_read,             /* read */
+    NULL,                       /* write */
+    gb_procfs_dup,              /* dup */
+    NULL,                       /* opendir */
+    NULL,                       /* closedir */
+    NULL,                       /* readdir */
+    NULL,                       /* rewinddir */
+    gb_procfs_stat,             /* stat */
+};
+
+static uint32_t gb_procfs_avg(uint64_t total, uint32_t count)
+{
+    return count ? total / count : 0;
+}
+
+/*
+ * One line per CPort that has dispatched a message or has an operation
+ * pool. The pool columns are left out without CONFIG_GREYBUS_OPERATION_POOL.
+ */
+static size_t gb_procfs_stats(char *buf, size_t size)
+{
+    struct gb_operation_pool_stats pool;
+    struct gb_dispatch_stats dispatch;
+    unsigned int cport;
+    bool has_pool;
+    size_t len;
+
+    len = snprintf(buf, size,
+                   "CPORT DISPATCHED QUEUED  MAX LAT(us)  MAX(us)"
+                   "   OPS FREE  MIN  EXH  BUFS FREE  MIN  EXH\n");
+
+    for (cport = 0; len < size &&
+                    !gb_dispatch_get_stats(cport, &dispatch); cport++) {
+        has_pool = !gb_operation_pool_get_stats(cport, &pool) &&
+                   pool.op_count;
+        if (!dispatch.dispatched && !has_pool)
+            continue;
+
+        len += snprintf(buf + len, size - len, "%5u %10u %6u %4u %7u %8u",
+                        cport, dispatch.dispatched, dispatch.queue_depth,
+                        dispatch.queue_depth_max,
+                        gb_procfs_avg(dispatch.latency_total,
+                                      dispatch.dispatched),
+                        dispatch.latency_max);
+        if (len >= size)
+            break;
+
+        if (has_pool) {
+            len += snprintf(buf + len, size - len,
+                            " %5zu %4zu %4zu %4u %5zu %4zu %4zu %4u\n",
+                            pool.op_count, pool.op_free, pool.op_min_free,
+                            pool.op_exhausted, pool.buf_count, pool.buf_free,
+                            pool.buf_min_free, pool.buf_exhausted);
+        } else {
+            len += snprintf(buf + len, size - len, "\n");
+        }
+    }
+
+    return MIN(len, size - 1);
+}
+
+static int gb_procfs_open(struct file *filep, const char *relpath,
+                          int oflags, mode_t mode)
+{
+    struct gb_procfs_file *priv;
+
+    if ((oflags & O_WRONLY) != 0 || (oflags & O_RDONLY) == 0) {
+        fdbg("ERROR: Only O_RDONLY supported\n");
+        return -EACCES;
+    }
+
+    if (strcmp(relpath, "greybus"))
+        return -ENOENT;
+
+    priv = kmm_zalloc(sizeof(*priv));
+    if (!priv)
+        return -ENOMEM;
+
+    filep->f_priv = priv;
+    return OK;
+}
+
+static int gb_procfs_close(struct file *filep)
+{
+    kmm_free(filep->f_priv);
+    filep->f_priv = NULL;
+    return OK;
+}
+
+static ssize_t gb_procfs_read(struct file *filep, char *buffer,
+                              size_t buflen)
+{
+    struct gb_procfs_file *priv = filep->f_priv;
+    off_t offset;
+    ssize_t ret;
+
+    DEBUGASSERT(priv);
+
+    /* Take a snapshot on the first read, so that the counters stay
+     * consistent when the file is read in several pieces */
+    if (filep->f_pos == 0)
+        priv->len = gb_procfs_stats(priv->buf, sizeof(priv->buf));
+
+    offset = filep->f_pos;
+    ret = procfs_memcpy(priv->buf, priv->len, buffer, buflen, &offset);
+    if (ret > 0)
+        filep->f_pos += ret;
+
+    return ret;
+}
+
+static int gb_procfs_dup(const struct file *oldp, struct file *newp)
+{
+    struct gb_procfs_file *priv;
+
+    priv = kmm_malloc(sizeof(*priv));
+    if (!priv)
+        return -ENOMEM;
+
+    memcpy(priv, oldp->f_priv, sizeof(*priv));
+    newp->f_priv = priv;
+    return OK;
+}
+
+static int gb_procfs_stat(const char *relpath, struct stat *buf)
+{
+    if (strcmp(relpath, "greybus"))
+        return -ENOENT;
+
+    memset(buf, 0, sizeof(*buf));
+    buf->st_mode = S_IFREG | S_IROTH | S_IRGRP | S_IRUSR;
+
+    return OK;
+}
+
+#endif /* !CONFIG_DISABLE_MOUNTPOINT && CONFIG_FS_PROCFS */
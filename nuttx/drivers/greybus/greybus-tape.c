@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Greybus Tape: record incoming Greybus messages and replay them later.
+ *
+ * Recording must not slow down the RX path, which runs in interrupt
+ * context on the bridges: messages are only copied into one of two
+ * buffers, and a writer thread hands each full buffer to the tape mechanism
+ * while the other one is being filled. When both buffers are busy the
+ * message is dropped and accounted for in the next chunk.
+ *
+ * Tape layout:
+ *
+ *   struct gb_tape_file_header
+ *   chunk 0: struct gb_tape_chunk_header, records...
+ *   chunk 1: struct gb_tape_chunk_header, records...
+ *   ...
+ *
+ * Each chunk is one writer buffer. Its header (the index) gives the number
+ * of records and bytes it holds, so a reader can load a whole chunk in one
+ * read. Each record carries the time elapsed since the previous one and is
+ * padded to 4 bytes.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nuttx/clock.h>
+#include <nuttx/hires_tmr.h>
+#include <nuttx/unipro/unipro.h>
+#include <nuttx/greybus/greybus.h>
+#include <nuttx/greybus/debug.h>
+#include <nuttx/greybus/tape.h>
+#include <arch/irq.h>
+
+#define GB_TAPE_MAGIC           0x50544247 /* "GBTP" */
+#define GB_TAPE_CHUNK_MAGIC     0x4b434247 /* "GBCK" */
+#define GB_TAPE_VERSION         2
+
+#define GB_TAPE_WRITER_STACK_SIZE   2048
+
+#ifndef CONFIG_GREYBUS_TAPE_BUFFER_SIZE
+#define CONFIG_GREYBUS_TAPE_BUFFER_SIZE 4096
+#endif
+
+#define GB_TAPE_ALIGN(x)        (((x) + 3) & ~3)
+
+struct gb_tape_file_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t chunk_size;    /* size of the writer buffers */
+};
+
+struct gb_tape_chunk_header {
+    uint32_t magic;
+    uint32_t size;          /* bytes of records following this header */
+    uint16_t count;         /* number of records */
+    uint16_t dropped;       /* records lost since the previous chunk */
+    uint32_t duration;      /* sum of the record deltas, in microseconds */
+};
+
+struct gb_tape_record_header {
+    uint32_t delta;         /* time since the previous record, in us */
+    uint16_t size;
+    uint16_t cport;
+};
+
+struct gb_tape_buffer {
+    char *data;             /* chunk header followed by records */
+    size_t len;
+    unsigned int count;
+    uint32_t duration;
+    bool full;              /* waiting to be written */
+};
+
+struct gb_tape_recorder {
+    struct gb_tape_buffer buffer[2];
+    unsigned int active;    /* buffer being filled */
+    uint32_t last_timestamp;
+    unsigned int dropped;
+    bool recording;
+    bool stop;
+    sem_t wakeup;
+    pthread_t writer;
+};
+
+static struct gb_tape_mechanism *gb_tape;
+static int gb_tape_fd = -EBADFD;
+static struct gb_tape_recorder gb_tape_rec;
+
+static uint32_t gb_tape_now(void)
+{
+#ifdef CONFIG_ARCH_HAVE_HIRES_TIMER
+    return hrt_getusec();
+#else
+    return TICK2USEC(clock_systimer());
+#endif
+}
+
+static void gb_tape_reset_buffer(struct gb_tape_buffer *buffer)
+{
+    buffer->len = sizeof(struct gb_tape_chunk_header);
+    buffer->count = 0;
+    buffer->duration = 0;
+}
+
+/**
+ * @brief Record a message received on a CPort
+ *
+ * Does nothing unless a recording is in progress.
+ *
+ * @note Can be called from interrupt context
+ *
+ * @param cport CPort the message was received on
+ * @param data message
+ * @param size size of the message
+ */
+void gb_tape_record(unsigned int cport, const void *data, size_t size)
+{
+    struct gb_tape_record_header *record;
+    struct gb_tape_buffer *buffer;
+    irqstate_t flags;
+    uint32_t now;
+    size_t len;
+
+    if (!gb_tape_rec.recording)
+        return;
+
+    len = sizeof(*record) + GB_TAPE_ALIGN(size);
+
+    flags = irqsave();
+
+    if (!gb_tape_rec.recording)
+        goto out;
+
+    buffer = &gb_tape_rec.buffer[gb_tape_rec.active];
+    if (buffer->len + len > CONFIG_GREYBUS_TAPE_BUFFER_SIZE) {
+        struct gb_tape_buffer *next =
+            &gb_tape_rec.buffer[gb_tape_rec.active ^ 1];
+
+        if (!buffer->count || next->full ||
+            next->len + len > CONFIG_GREYBUS_TAPE_BUFFER_SIZE) {
+            gb_tape_rec.dropped++;
+            goto out;
+        }
+
+        buffer->full = true;
+        gb_tape_rec.active ^= 1;
+        sem_post(&gb_tape_rec.wakeup);
+        buffer = next;
+    }
+
+    now = gb_tape_now();
+
+    record = (struct gb_tape_record_header *) (buffer->data + buffer->len);
+    record->delta = now - gb_tape_rec.last_timestamp;
+    record->size = size;
+    record->cport = cport;
+    memcpy(record + 1, data, size);
+
+    gb_tape_rec.last_timestamp = now;
+    buffer->len += len;
+    buffer->duration += record->delta;
+    buffer->count++;
+
+out:
+    irqrestore(flags);
+}
+
+static int gb_tape_write_buffer(struct gb_tape_buffer *buffer)
+{
+    struct gb_tape_chunk_header *chunk =
+        (struct gb_tape_chunk_header *) buffer->data;
+    irqstate_t flags;
+    ssize_t nwritten;
+
+    flags = irqsave();
+    chunk->dropped = gb_tape_rec.dropped;
+    gb_tape_rec.dropped = 0;
+    irqrestore(flags);
+
+    chunk->magic = GB_TAPE_CHUNK_MAGIC;
+    chunk->size = buffer->len - sizeof(*chunk);
+    chunk->count = buffer->count;
+    chunk->duration = buffer->duration;
+
+    nwritten = gb_tape->write(gb_tape_fd, buffer->data, buffer->len);
+
+    flags = irqsave();
+    gb_tape_reset_buffer(buffer);
+    buffer->full = false;
+    irqrestore(flags);
+
+    return nwritten == buffer->len ? 0 : -EIO;
+}
+
+static void *gb_tape_writer(void *data)
+{
+    int i;
+
+    while (1) {
+        sem_wait(&gb_tape_rec.wakeup);
+
+        /* Oldest buffer first, records must stay in order */
+        for (i = 1; i <= 2; i++) {
+            struct gb_tape_buffer *buffer =
+                &gb_tape_rec.buffer[(gb_tape_rec.active + i) & 1];
+
+            if (buffer->full && gb_tape_write_buffer(buffer))
+                gb_error("gb-tape: cannot write chunk\n");
+        }
+
+        if (gb_tape_rec.stop)
+            break;
+    }
+
+    return NULL;
+}
+
+int gb_tape_register_mechanism(struct gb_tape_mechanism *mechanism)
+{
+    if (!mechanism || !mechanism->open || !mechanism->close ||
+        !mechanism->read || !mechanism->write)
+        return -EINVAL;
+
+    if (gb_tape)
+        return -EBUSY;
+
+    gb_tape = mechanism;
+
+    return 0;
+}
+
+int gb_tape_communication(const char *pathname)
+{
+    struct gb_tape_file_header hdr = {
+        .magic = GB_TAPE_MAGIC,
+        .version = GB_TAPE_VERSION,
+        .chunk_size = CONFIG_GREYBUS_TAPE_BUFFER_SIZE,
+    };
+    pthread_attr_t thread_attr;
+    int retval;
+    int i;
+
+    if (!gb_tape)
+        return -EINVAL;
+
+    if (gb_tape_fd >= 0)
+        return -EBUSY;
+
+    gb_tape_fd = gb_tape->open(pathname, GB_TAPE_WRONLY);
+    if (gb_tape_fd < 0)
+        return gb_tape_fd;
+
+    if (gb_tape->write(gb_tape_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        retval = -EIO;
+        goto error_write_header;
+    }
+
+    for (i = 0; i < 2; i++) {
+        gb_tape_rec.buffer[i].data = malloc(CONFIG_GREYBUS_TAPE_BUFFER_SIZE);
+        if (!gb_tape_rec.buffer[i].data) {
+            retval = -ENOMEM;
+            goto error_buffer_alloc;
+        }
+
+        gb_tape_reset_buffer(&gb_tape_rec.buffer[i]);
+        gb_tape_rec.buffer[i].full = false;
+    }
+
+    gb_tape_rec.active = 0;
+    gb_tape_rec.dropped = 0;
+    gb_tape_rec.stop = false;
+    sem_init(&gb_tape_rec.wakeup, 0, 0);
+    sem_setprotocol(&gb_tape_rec.wakeup, SEM_PRIO_NONE);
+
+    retval = pthread_attr_init(&thread_attr);
+    if (retval) {
+        retval = -retval;
+        goto error_buffer_alloc;
+    }
+
+    pthread_attr_setstacksize(&thread_attr, GB_TAPE_WRITER_STACK_SIZE);
+
+    retval = pthread_create(&gb_tape_rec.writer, &thread_attr, gb_tape_writer,
+                            NULL);
+    pthread_attr_destroy(&thread_attr);
+    if (retval) {
+        retval = -retval;
+        goto error_buffer_alloc;
+    }
+
+    gb_tape_rec.last_timestamp = gb_tape_now();
+    gb_tape_rec.recording = true;
+
+    return 0;
+
+error_buffer_alloc:
+    sem_destroy(&gb_tape_rec.wakeup);
+    for (i = 0; i < 2; i++) {
+        free(gb_tape_rec.buffer[i].data);
+        gb_tape_rec.buffer[i].data = NULL;
+    }
+
+error_write_header:
+    gb_tape->close(gb_tape_fd);
+    gb_tape_fd = -EBADFD;
+
+    return retval;
+}
+
+int gb_tape_stop(void)
+{
+    struct gb_tape_buffer *buffer;
+    irqstate_t flags;
+    int i;
+
+    if (!gb_tape || gb_tape_fd < 0)
+        return -EINVAL;
+
+    flags = irqsave();
+    gb_tape_rec.recording = false;
+    buffer = &gb_tape_rec.buffer[gb_tape_rec.active];
+    if (buffer->count)
+        buffer->full = true;
+    gb_tape_rec.stop = true;
+    irqrestore(flags);
+
+    sem_post(&gb_tape_rec.wakeup);
+    pthread_join(gb_tape_rec.writer, NULL);
+    sem_destroy(&gb_tape_rec.wakeup);
+
+    if (gb_tape_rec.dropped)
+        gb_error("gb-tape: %u messages lost at the end of the recording\n",
+                 gb_tape_rec.dropped);
+
+    for (i = 0; i < 2; i++) {
+        free(gb_tape_rec.buffer[i].data);
+        gb_tape_rec.buffer[i].data = NULL;
+    }
+
+    gb_tape->close(gb_tape_fd);
+    gb_tape_fd = -EBADFD;
+
+    return 0;
+}
+
+#if defined(CONFIG_UNIPRO_ZERO_COPY)
+static int gb_tape_deliver(unsigned int cport, void *data, size_t size)
+{
+    void *buf;
+    int retval;
+
+    /* With zero-copy, the core keeps the buffer and gives it back to UniPro */
+    while (!(buf = unipro_rxbuf_alloc(cport)))
+        usleep(1000);
+
+    memcpy(buf, data, size);
+
+    retval = greybus_rx_handler(cport, buf, size);
+    if (retval)
+        unipro_rxbuf_free(cport, buf);
+
+    return retval;
+}
+#else
+static int gb_tape_deliver(unsigned int cport, void *data, size_t size)
+{
+    return greybus_rx_handler(cport, data, size);
+}
+#endif
+
+static int gb_tape_read_chunk(int fd, char *buffer, size_t size,
+                              struct gb_tape_chunk_header *chunk)
+{
+    ssize_t nread;
+
+    nread = gb_tape->read(fd, chunk, sizeof(*chunk));
+    if (!nread)
+        return 0;
+
+    if (nread != sizeof(*chunk) || chunk->magic != GB_TAPE_CHUNK_MAGIC ||
+        chunk->size > size) {
+        gb_error("gb-tape: invalid chunk header, aborting...\n");
+        return -EIO;
+    }
+
+    nread = gb_tape->read(fd, buffer, chunk->size);
+    if (nread != chunk->size) {
+        gb_error("gb-tape: invalid byte count read, aborting...\n");
+        return -EIO;
+    }
+
+    return 1;
+}
+
+static int gb_tape_replay_once(const char *pathname, char *buffer,
+                               enum gb_tape_replay_mode mode,
+                               struct gb_tape_replay_stats *stats)
+{
+    struct gb_tape_file_header hdr;
+    struct gb_tape_chunk_header chunk;
+    struct gb_tape_record_header *record;
+    uint32_t start;
+    uint64_t target = 0;
+    size_t offset;
+    int retval;
+    int fd;
+
+    fd = gb_tape->open(pathname, GB_TAPE_RDONLY);
+    if (fd < 0)
+        return fd;
+
+    if (gb_tape->read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        hdr.magic != GB_TAPE_MAGIC || hdr.version != GB_TAPE_VERSION) {
+        gb_error("gb-tape: unsupported tape format\n");
+        retval = -EINVAL;
+        goto out;
+    }
+
+    start = gb_tape_now();
+
+    while ((retval = gb_tape_read_chunk(fd, buffer,
+                                        CONFIG_GREYBUS_TAPE_BUFFER_SIZE,
+                                        &chunk)) > 0) {
+        stats->dropped += chunk.dropped;
+
+        for (offset = 0; offset + sizeof(*record) <= chunk.size;
+             offset += sizeof(*record) + GB_TAPE_ALIGN(record->size)) {
+            record = (struct gb_tape_record_header *) (buffer + offset);
+            if (offset + sizeof(*record) + record->size > chunk.size) {
+                gb_error("gb-tape: truncated record, aborting...\n");
+                retval = -EIO;
+                goto out;
+            }
+
+            if (mode == GB_TAPE_REPLAY_REALTIME) {
+                uint32_t elapsed;
+
+                target += record->delta;
+                elapsed = gb_tape_now() - start;
+                if (elapsed < target)
+                    usleep(target - elapsed);
+            }
+
+            if (gb_tape_deliver(record->cport, record + 1, record->size))
+                stats->errors++;
+
+            stats->messages++;
+            stats->bytes += record->size;
+        }
+    }
+
+out:
+    gb_tape->close(fd);
+
+    return retval;
+}
+
+int gb_tape_replay_ext(const char *pathname, enum gb_tape_replay_mode mode,
+                       unsigned int loops,
+                       struct gb_tape_replay_stats *stats)
+{
+    struct gb_tape_replay_stats local_stats;
+    uint32_t start;
+    char *buffer;
+    int retval = 0;
+
+    if (!pathname || !gb_tape || !loops)
+        return -EINVAL;
+
+    if (!stats)
+        stats = &local_stats;
+    memset(stats, 0, sizeof(*stats));
+
+    lowsyslog("greybus: replaying '%s'...\n", pathname);
+
+    buffer = malloc(CONFIG_GREYBUS_TAPE_BUFFER_SIZE);
+    if (!buffer)
+        return -ENOMEM;
+
+    start = gb_tape_now();
+
+    while (loops--) {
+        retval = gb_tape_replay_once(pathname, buffer, mode, stats);
+        if (retval)
+            break;
+    }
+
+    stats->elapsed = gb_tape_now() - start;
+
+    free(buffer);
+
+    return retval;
+}
+
+int gb_tape_replay(const char *pathname)
+{
+    return gb_tape_replay_ext(pathname, GB_TAPE_REPLAY_FAST, 1, NULL);
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Greybus operation trace, recorded in an event ring read from /dev/gbtrace
+ */
+
+#include <errno.h>
+
+#include <nuttx/fs/fs.h>
+#include <nuttx/event_ring.h>
+#include <nuttx/hires_tmr.h>
+#include <nuttx/greybus/greybus.h>
+#include <nuttx/greybus/trace.h>
+#include <arch/irq.h>
+#include <arch/byteorder.h>
+
+#if (CONFIG_GREYBUS_TRACE_SIZE & (CONFIG_GREYBUS_TRACE_SIZE - 1)) != 0
+#error "CONFIG_GREYBUS_TRACE_SIZE must be a power of two"
+#endif
+
+static struct gb_trace_entry gb_trace_entries[CONFIG_GREYBUS_TRACE_SIZE];
+static struct event_ring gb_trace_ring =
+    EVENT_RING_INITIALIZER(gb_trace_entries);
+
+/**
+ * @brief Record a trace event
+ *
+ * @note Can be called from interrupt context
+ *
+ * @param event what happened
+ * @param cport CPort of the message
+ * @param hdr header of the message, can be NULL
+ */
+void gb_trace(enum gb_trace_event event, unsigned int cport,
+              const struct gb_operation_hdr *hdr)
+{
+    struct gb_trace_entry *entry;
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    entry = event_ring_claim(&gb_trace_ring);
+    if (!entry) {
+        irqrestore(flags);
+        return;
+    }
+
+    entry->timestamp = hrt_getusec();
+    entry->cport = cport;
+    entry->event = event;
+    if (hdr) {
+        entry->id = le16_to_cpu(hdr->id);
+        entry->size = le16_to_cpu(hdr->size);
+        entry->type = hdr->type;
+    } else {
+        entry->id = 0;
+        entry->size = 0;
+        entry->type = 0;
+    }
+
+    irqrestore(flags);
+}
+
+static void gb_trace_dropped(void *data, uint32_t lost)
+{
+    struct gb_trace_entry *entry = data;
+
+    entry->cport = 0;
+    entry->id = lost >> 16;
+    entry->size = lost & 0xffff;
+    entry->type = 0;
+    entry->event = GB_TRACE_DROPPED;
+}
+
+static ssize_t gb_trace_read(struct file *filep, char *buffer, size_t len)
+{
+    return event_ring_read(&gb_trace_ring, buffer, len, gb_trace_dropped);
+}
+
+/* See event_ring_write() for the commands */
+static ssize_t gb_trace_write(struct file *filep, const char *buffer,
+                              size_t len)
+{
+    return event_ring_write(&gb_trace_ring, buffer, len);
+}
+
+static const struct file_operations gb_trace_ops = {
+    .read = gb_trace_read,
+    .write = gb_trace_write,
+};
+
+int gb_trace_init(void)
+{
+    int retval;
+
+    retval = register_driver("/dev/gbtrace", &gb_trace_ops, 0666, NULL);
+    return retval == -EEXIST ? 0 : retval;
+}
@@ -29,6 +29,7 @@
  */
 
 #include <errno.h>
+#include <stdlib.h>
 #include <nuttx/bufram.h>
 #include <nuttx/unipro/unipro.h>
 #include <nuttx/greybus/debug.h>
@@ -58,13 +59,38 @@ static int gb_unipro_stop_listening(unsigned int cport)
     return unipro_driver_unregister(cport);
 }
 
+static int gb_unipro_send_iov(unsigned int cport, const struct gb_iovec *iov,
+                              size_t iovcnt)
+{
+    struct unipro_iovec uiov[UNIPRO_IOV_MAX];
+    int i;
+
+    if (iovcnt > UNIPRO_IOV_MAX)
+        return -EINVAL;
+
+    for (i = 0; i < iovcnt; i++) {
+        uiov[i].base = iov[i].base;
+        uiov[i].len = iov[i].len;
+    }
+
+    return unipro_send_iov(cport, uiov, iovcnt);
+}
+
 struct gb_transport_backend gb_unipro_backend = {
     .init = unipro_init,
     .send = unipro_send,
+    .send_batch = unipro_send_batch,
+    .send_iov = gb_unipro_send_iov,
+    .send_async = unipro_send_async,
     .listen = gb_unipro_listen,
     .stop_listening = gb_unipro_stop_listening,
+#ifdef CONFIG_MM_BUFRAM_ALLOCATOR
     .alloc_buf = bufram_alloc,
     .free_buf = bufram_free,
+#else
+    .alloc_buf = malloc,
+    .free_buf = free,
+#endif
 };
 
 int gb_unipro_init(void)
@@ -700,6 +700,7 @@ static struct gb_driver gb_hid_driver = {
     .exit = gb_hid_exit,
     .op_handlers = gb_hid_handlers,
     .op_handlers_count = ARRAY_SIZE(gb_hid_handlers),
+    .dispatch_priority = GB_DISPATCH_PRIORITY_HIGH,
 };
 
 /**
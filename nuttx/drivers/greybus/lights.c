@@ -71,6 +71,7 @@ static int event_callback(uint8_t light_id, uint8_t event)
 {
     struct gb_operation *operation;
     struct gb_lights_event_request *request;
+    int ret;
 
     operation = gb_operation_create(lights_info->cport, GB_LIGHTS_TYPE_EVENT,
                                     sizeof(*request));
@@ -82,10 +83,18 @@ static int event_callback(uint8_t light_id, uint8_t event)
     request->light_id = light_id;
     request->event = event;
 
-    gb_operation_send_request(operation, NULL, false);
+    ret = gb_operation_queue_request(operation, NULL, false);
+    if (ret == -EBUSY) {
+        /* The batch is full and waiting to be flushed, don't wait for it */
+        ret = gb_operation_send_request(operation, NULL, false);
+    }
     gb_operation_destroy(operation);
 
-    return 0;
+    if (ret) {
+        gb_error("failed to send event of light %u: %d\n", light_id, ret);
+    }
+
+    return ret;
 }
 
 /**
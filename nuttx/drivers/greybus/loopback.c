@@ -33,11 +33,11 @@
 
 #include "loopback-gb.h"
 
-#include <nuttx/list.h>
 #include <nuttx/greybus/greybus.h>
 #include <nuttx/greybus/loopback.h>
 #include <nuttx/greybus/greybus_timestamp.h>
 #include <nuttx/greybus/debug.h>
+#include <nuttx/unipro/unipro.h>
 #include <nuttx/time.h>
 #include <nuttx/util.h>
 #include <arch/byteorder.h>
@@ -45,35 +45,42 @@
 #define GB_LOOPBACK_VERSION_MAJOR 0
 #define GB_LOOPBACK_VERSION_MINOR 1
 
+/*
+ * Accumulators behind the averages of struct gb_loopback_statistics, the
+ * averages are computed when taking a snapshot.
+ */
+struct gb_loopback_totals {
+    unsigned samples;
+    uint64_t latency;
+    uint64_t throughput;
+    uint64_t reqs_per_sec;
+};
+
 struct gb_loopback {
-    struct list_head list;
-    pthread_mutex_t lock;
     int cport;
     struct gb_timestamp ts;
     struct gb_loopback_statistics stats;
+    struct gb_loopback_totals totals;
 };
 
-struct list_head gb_loopback_list = LIST_INIT(gb_loopback_list);
-static pthread_mutex_t gb_loopback_list_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-static void loopback_list_lock(void)
-{
-    pthread_mutex_lock(&gb_loopback_list_mutex);
-}
-
-static void loopback_list_unlock(void)
-{
-    pthread_mutex_unlock(&gb_loopback_list_mutex);
-}
+/*
+ * Loopback instances indexed by cport. Entries are only added, at
+ * registration time, so the lookup needs no locking.
+ *
+ * The statistics of a cport are only written from the response callbacks,
+ * which greybus-core runs one at a time per cport. Updates are done with
+ * interrupts disabled so that a snapshot or a reset from another thread
+ * always sees them complete.
+ */
+static struct gb_loopback **gb_loopback_cports;
+static unsigned int gb_loopback_cport_count;
 
-static void loopback_lock(struct gb_loopback *loopback)
+static struct gb_loopback *loopback_from_cport(int cport)
 {
-    pthread_mutex_lock(&loopback->lock);
-}
+    if (cport < 0 || cport >= gb_loopback_cport_count)
+        return NULL;
 
-static void loopback_unlock(struct gb_loopback *loopback)
-{
-    pthread_mutex_unlock(&loopback->lock);
+    return gb_loopback_cports[cport];
 }
 
 /**
@@ -84,54 +91,51 @@ static void loopback_unlock(struct gb_loopback *loopback)
  */
 int gb_loopback_get_cports(gb_loopback_cport_cb cb, void *data)
 {
-    struct gb_loopback *loopback;
-    struct list_head *iter;
     int status = 0;
+    int i;
 
-    loopback_list_lock();
-    list_foreach(&gb_loopback_list, iter) {
-        loopback = list_entry(iter, struct gb_loopback, list);
-        status = cb(loopback->cport, data);
+    for (i = 0; i < gb_loopback_cport_count; i++) {
+        if (!gb_loopback_cports[i])
+            continue;
+
+        status = cb(i, data);
         if (status < 0)
             break;
     }
-    loopback_list_unlock();
 
     return status;
 }
 
-static struct gb_loopback *loopback_from_cport(int cport)
-{
-    struct gb_loopback *loopback;
-    struct list_head *iter;
-
-    list_foreach(&gb_loopback_list, iter) {
-        loopback = list_entry(iter, struct gb_loopback, list);
-        if (loopback->cport == cport) {
-            return loopback;
-        }
-    }
-    return NULL;
-}
-
 /**
- * @brief Get loopback stats for given cport
+ * @brief Get a snapshot of the loopback stats for given cport
+ *
+ * All the fields are taken at the same point in time.
+ *
  * @param cport cport number
  * @param stats pointer to the statistics container
- * @return -1 for invalid cports, 0 otherwise
+ * @return -EINVAL for invalid cports, 0 otherwise
  */
 int gb_loopback_get_stats(int cport, struct gb_loopback_statistics *stats)
 {
     struct gb_loopback *loopback;
+    struct gb_loopback_totals totals;
+    irqstate_t flags;
 
     loopback = loopback_from_cport(cport);
     if (!loopback) {
         return -EINVAL;
     }
 
-    loopback_lock(loopback);
-    memcpy(stats, &loopback->stats, sizeof(struct gb_loopback_statistics));
-    loopback_unlock(loopback);
+    flags = irqsave();
+    *stats = loopback->stats;
+    totals = loopback->totals;
+    irqrestore(flags);
+
+    if (totals.samples) {
+        stats->latency_avg = totals.latency / totals.samples;
+        stats->throughput_avg = totals.throughput / totals.samples;
+        stats->reqs_per_sec_avg = totals.reqs_per_sec / totals.samples;
+    }
 
     return 0;
 }
@@ -139,22 +143,24 @@ int gb_loopback_get_stats(int cport, struct gb_loopback_statistics *stats)
 static void loopback_error_notify(int cport)
 {
     struct gb_loopback *loopback = loopback_from_cport(cport);
+    irqstate_t flags;
 
     if (loopback != NULL) {
-        loopback_lock(loopback);
+        flags = irqsave();
         loopback->stats.recv_err++;
-        loopback_unlock(loopback);
+        irqrestore(flags);
     }
 }
 
 static void loopback_recv_inc(int cport)
 {
     struct gb_loopback *loopback = loopback_from_cport(cport);
+    irqstate_t flags;
 
     if (loopback != NULL) {
-        loopback_lock(loopback);
+        flags = irqsave();
         loopback->stats.recv++;
-        loopback_unlock(loopback);
+        irqrestore(flags);
     }
 }
 
@@ -165,11 +171,13 @@ static void loopback_recv_inc(int cport)
 void gb_loopback_reset(int cport)
 {
     struct gb_loopback *loopback = loopback_from_cport(cport);
+    irqstate_t flags;
 
     if (loopback != NULL) {
-        loopback_lock(loopback);
-        memset(&loopback->stats, 0, sizeof(struct gb_loopback_statistics));
-        loopback_unlock(loopback);
+        flags = irqsave();
+        memset(&loopback->stats, 0, sizeof(loopback->stats));
+        memset(&loopback->totals, 0, sizeof(loopback->totals));
+        irqrestore(flags);
     }
 }
 
@@ -196,55 +204,53 @@ static void update_loopback_stats(struct gb_operation *operation, int xfer)
     struct timespec ts_total;
     unsigned tps, rps;
     useconds_t total;
+    irqstate_t flags;
     size_t tpr;
 
-    timespecsub(&operation->recv_ts, &operation->send_ts, &ts_total);
-    total = timespec_to_usec(&ts_total);
-
     loopback = loopback_from_cport(operation->cport);
     if (!loopback) {
         return;
     }
 
+    timespecsub(&operation->recv_ts, &operation->send_ts, &ts_total);
+    total = timespec_to_usec(&ts_total);
+    if (!total)
+        total = 1;
+
     request = gb_operation_get_request_payload(operation);
     tpr = request->len * (xfer ? 2 : 1);
     tps = tpr * DIV_ROUND_CLOSEST(USEC_PER_SEC, total);
     rps = DIV_ROUND_CLOSEST(USEC_PER_SEC, total);
     stats = &loopback->stats;
 
-#define UPDATE_AVG(avg, new)                                            \
+#define UPDATE_MIN(min, new)                                            \
     do {                                                                \
-        if ((avg) == 0)                                                 \
-            (avg) = (new);                                              \
-        else                                                            \
-            (avg) = DIV_ROUND_CLOSEST((avg) + (new), 2);                \
+        if ((min) == 0 || (new) < (min))                                \
+            (min) = (new);                                              \
     } while (0)
 
-#define UPDATE_MIN(min, avg)                                            \
+#define UPDATE_MAX(max, new)                                            \
     do {                                                                \
-        if ((min) == 0)                                                 \
-            (min) = (avg);                                              \
-        else if ((avg) < (min))                                         \
-            (min) = (avg);                                              \
+        if ((new) > (max))                                              \
+            (max) = (new);                                              \
     } while (0)
 
-#define UPDATE_MAX(max, avg)                                            \
-    do {                                                                \
-        if ((avg) > (max))                                              \
-            (max) = (avg);                                              \
-    } while (0)
+    flags = irqsave();
+
+    loopback->totals.samples++;
+    loopback->totals.latency += total;
+    loopback->totals.throughput += tps;
+    loopback->totals.reqs_per_sec += rps;
+
+    UPDATE_MIN(stats->latency_min, total);
+    UPDATE_MIN(stats->throughput_min, tps);
+    UPDATE_MIN(stats->reqs_per_sec_min, rps);
+    UPDATE_MAX(stats->latency_max, total);
+    UPDATE_MAX(stats->throughput_max, tps);
+    UPDATE_MAX(stats->reqs_per_sec_max, rps);
+
+    irqrestore(flags);
 
-    UPDATE_AVG(stats->latency_avg, total);
-    UPDATE_AVG(stats->throughput_avg, tps);
-    UPDATE_AVG(stats->reqs_per_sec_avg, rps);
-    UPDATE_MIN(stats->latency_min, stats->latency_avg);
-    UPDATE_MIN(stats->throughput_min, stats->throughput_avg);
-    UPDATE_MIN(stats->reqs_per_sec_min, stats->reqs_per_sec_avg);
-    UPDATE_MAX(stats->latency_max, stats->latency_avg);
-    UPDATE_MAX(stats->throughput_max, stats->throughput_avg);
-    UPDATE_MAX(stats->reqs_per_sec_max, stats->reqs_per_sec_avg);
-
-#undef UPDATE_AVG
 #undef UPDATE_MIN
 #undef UPDATE_MAX
 }
@@ -384,13 +390,23 @@ static uint8_t gb_loopback_transfer_req_cb(struct gb_operation *operation)
     }
 
     request_length = le32_to_cpu(request->len);
+    if (request_length > gb_operation_get_request_payload_size(operation) -
+                         sizeof(*request)) {
+        gb_error("dropping truncated transfer\n");
+        return GB_OP_INVALID;
+    }
 
-    response = gb_operation_alloc_response(operation,
-                                           sizeof(*response) + request_length);
+    response = gb_operation_alloc_response(operation, sizeof(*response));
     if(!response)
         return GB_OP_NO_MEMORY;
     response->len = request->len;
-    memcpy(response->data, request->data, request_length);
+
+    /* echo the request data straight from the RX buffer */
+    if (request_length &&
+        gb_operation_append_response_data(operation, request->data,
+                                          request_length))
+        return GB_OP_INVALID;
+
     return GB_OP_SUCCESS;
 }
 
@@ -401,8 +417,9 @@ static uint8_t gb_loopback_ping_sink_req_cb(struct gb_operation *operation)
 }
 
 static struct gb_operation_handler gb_loopback_handlers[] = {
-    GB_HANDLER(GB_LOOPBACK_TYPE_PROTOCOL_VERSION, gb_loopback_protocol_ver_cb),
-    GB_HANDLER(GB_LOOPBACK_TYPE_PING, gb_loopback_ping_sink_req_cb),
+    GB_ATOMIC_HANDLER(GB_LOOPBACK_TYPE_PROTOCOL_VERSION,
+                      gb_loopback_protocol_ver_cb),
+    GB_ATOMIC_HANDLER(GB_LOOPBACK_TYPE_PING, gb_loopback_ping_sink_req_cb),
     GB_HANDLER(GB_LOOPBACK_TYPE_TRANSFER, gb_loopback_transfer_req_cb),
     GB_HANDLER(GB_LOOPBACK_TYPE_SINK, gb_loopback_ping_sink_req_cb),
 };
@@ -440,16 +457,25 @@ void gb_loopback_log_exit(unsigned int cport, struct gb_operation *operation, si
 
 void gb_loopback_register(int cport)
 {
-    struct gb_loopback *loopback = zalloc(sizeof(*loopback));
-    irqstate_t flags;
+    struct gb_loopback *loopback;
+
+    if (!gb_loopback_cports) {
+        gb_loopback_cports = zalloc(unipro_cport_count() *
+                                    sizeof(*gb_loopback_cports));
+        if (!gb_loopback_cports)
+            return;
+        gb_loopback_cport_count = unipro_cport_count();
+    }
 
+    if (cport < 0 || cport >= gb_loopback_cport_count ||
+        gb_loopback_cports[cport])
+        return;
+
+    loopback = zalloc(sizeof(*loopback));
     if (loopback) {
         loopback->cport = cport;
-        pthread_mutex_init(&loopback->lock, NULL);
         loopback->ts.tag = true;
-        flags = irqsave();
-        list_add(&gb_loopback_list, &loopback->list);
-        irqrestore(flags);
+        gb_loopback_cports[cport] = loopback;
     }
     gb_timestamp_init();
     gb_register_driver(cport, &loopback_driver);
@@ -445,7 +445,7 @@ void gb_pwm_exit(unsigned int cport)
  * This structure is to define each PWM protocol operation of handling function.
  */
 static struct gb_operation_handler gb_pwm_handlers[] = {
-    GB_HANDLER(GB_PWM_PROTOCOL_VERSION, gb_pwm_protocol_version),
+    GB_ATOMIC_HANDLER(GB_PWM_PROTOCOL_VERSION, gb_pwm_protocol_version),
     GB_HANDLER(GB_PWM_PROTOCOL_COUNT, gb_pwm_protocol_count),
     GB_HANDLER(GB_PWM_PROTOCOL_ACTIVATE, gb_pwm_protocol_activate),
     GB_HANDLER(GB_PWM_PROTOCOL_DEACTIVATE, gb_pwm_protocol_deactivate),
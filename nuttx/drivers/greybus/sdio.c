@@ -436,6 +436,7 @@ static struct gb_driver sdio_driver = {
     .exit              = gb_sdio_exit,
     .op_handlers       = gb_sdio_handlers,
     .op_handlers_count = ARRAY_SIZE(gb_sdio_handlers),
+    .dispatch_priority = GB_DISPATCH_PRIORITY_LOW,
 };
 
 /**
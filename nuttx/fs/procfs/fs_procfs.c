@@ -78,6 +78,7 @@
 extern const struct procfs_operations proc_operations;
 extern const struct procfs_operations cpuload_operations;
 extern const struct procfs_operations uptime_operations;
+extern const struct procfs_operations irqs_operations;
 
 /* This is not good.  These are implemented in drivers/mtd.  Having to
  * deal with them here is not a good coupling.
@@ -96,6 +97,14 @@ extern const struct procfs_operations smartfs_procfsoperations;
 extern const struct procfs_operations ccm_procfsoperations;
 #endif
 
+#if defined(CONFIG_TSB_UNIPRO_PROCFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_UNIPRO)
+extern const struct procfs_operations tsb_unipro_procfsoperations;
+#endif
+
+#if defined(CONFIG_GREYBUS_PROCFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_GREYBUS)
+extern const struct procfs_operations gb_procfsoperations;
+#endif
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
@@ -112,6 +121,10 @@ static const struct procfs_entry_s g_procfsentries[] =
   { "cpuload",          &cpuload_operations },
 #endif
 
+#if defined(CONFIG_USEC_MEASURE_PERF) && !defined(CONFIG_FS_PROCFS_EXCLUDE_IRQS)
+  { "irqs",             &irqs_operations },
+#endif
+
 #if defined(CONFIG_FS_SMARTFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_SMARTFS)
 //{ "fs/smartfs",       &smartfs_procfsoperations },
   { "fs/smartfs**",     &smartfs_procfsoperations },
@@ -132,6 +145,15 @@ static const struct procfs_entry_s g_procfsentries[] =
 #if defined(CONFIG_STM32_CCM_PROCFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_CCM)
   { "ccm",             &ccm_procfsoperations },
 #endif
+
+#if defined(CONFIG_TSB_UNIPRO_PROCFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_UNIPRO)
+  { "unipro/**",        &tsb_unipro_procfsoperations },
+  { "unipro",           &tsb_unipro_procfsoperations },
+#endif
+
+#if defined(CONFIG_GREYBUS_PROCFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_GREYBUS)
+  { "greybus",          &gb_procfsoperations },
+#endif
 };
 
 static const uint8_t g_procfsentrycount = sizeof(g_procfsentries) /
@@ -78,6 +78,10 @@
 
 #define STATUS_LINELEN 32
 
+/* Number of PC samples shown in the perf file */
+
+#define PERF_NSAMPLES  16
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
@@ -92,6 +96,9 @@ enum proc_node_e
   PROC_CMDLINE,                       /* Task command line */
 #ifdef CONFIG_SCHED_CPULOAD
   PROC_LOADAVG,                       /* Average CPU utilization */
+#endif
+#ifdef CONFIG_USEC_MEASURE_PERF
+  PROC_PERF,                          /* CPU profiling counters */
 #endif
   PROC_STACK,                         /* Task stack info */
   PROC_GROUP,                         /* Group directory */
@@ -148,6 +155,11 @@ static ssize_t proc_loadavg(FAR struct proc_file_s *procfile,
                  FAR struct tcb_s *tcb, FAR char *buffer, size_t buflen,
                  off_t offset);
 #endif
+#ifdef CONFIG_USEC_MEASURE_PERF
+static ssize_t proc_perf(FAR struct proc_file_s *procfile,
+                 FAR struct tcb_s *tcb, FAR char *buffer, size_t buflen,
+                 off_t offset);
+#endif
 static ssize_t proc_stack(FAR struct proc_file_s *procfile,
                  FAR struct tcb_s *tcb, FAR char *buffer, size_t buflen,
                  off_t offset);
@@ -230,6 +242,13 @@ static const struct proc_node_s g_loadavg =
 };
 #endif
 
+#ifdef CONFIG_USEC_MEASURE_PERF
+static const struct proc_node_s g_perf =
+{
+  "perf",         "perf",    (uint8_t)PROC_PERF,         DTYPE_FILE        /* CPU profiling counters */
+};
+#endif
+
 static const struct proc_node_s g_stack =
 {
   "stack",        "stack",   (uint8_t)PROC_STACK,        DTYPE_FILE        /* Task stack info */
@@ -258,6 +277,9 @@ static FAR const struct proc_node_s * const g_nodeinfo[] =
   &g_cmdline,      /* Task command line */
 #ifdef CONFIG_SCHED_CPULOAD
   &g_loadavg,      /* Average CPU utilization */
+#endif
+#ifdef CONFIG_USEC_MEASURE_PERF
+  &g_perf,         /* CPU profiling counters */
 #endif
   &g_stack,        /* Task stack info */
   &g_group,        /* Group directory */
@@ -274,6 +296,9 @@ static const struct proc_node_s * const g_level0info[] =
   &g_cmdline,      /* Task command line */
 #ifdef CONFIG_SCHED_CPULOAD
   &g_loadavg,      /* Average CPU utilization */
+#endif
+#ifdef CONFIG_USEC_MEASURE_PERF
+  &g_perf,         /* CPU profiling counters */
 #endif
   &g_stack,        /* Task stack info */
   &g_group,        /* Group directory */
@@ -590,6 +615,104 @@ static ssize_t proc_loadavg(FAR struct proc_file_s *procfile,
 }
 #endif
 
+/****************************************************************************
+ * Name: proc_perf
+ ****************************************************************************/
+
+#ifdef CONFIG_USEC_MEASURE_PERF
+static ssize_t proc_perf(FAR struct proc_file_s *procfile,
+                         FAR struct tcb_s *tcb, FAR char *buffer,
+                         size_t buflen, off_t offset)
+{
+  struct sched_perf_s perf;
+#if CONFIG_USEC_MEASURE_PERF_SAMPLES > 0
+  uintptr_t pcs[PERF_NSAMPLES];
+  int nsamples;
+  int i;
+#endif
+  size_t remaining;
+  size_t linesize;
+  size_t copysize;
+  size_t totalsize;
+
+  /* sched_perf_get should only fail if the thread exited sometime after
+   * the procfs entry was opened.
+   */
+
+  if (sched_perf_get(procfile->pid, &perf) < 0)
+    {
+      return 0;
+    }
+
+  remaining = buflen;
+  totalsize = 0;
+
+  /* Show the run time in seconds */
+
+  linesize   = snprintf(procfile->line, STATUS_LINELEN, "%-12s%lu.%06lu\n",
+                        "RunTime:", (unsigned long)(perf.run_time / 1000000),
+                        (unsigned long)(perf.run_time % 1000000));
+  copysize   = procfs_memcpy(procfile->line, linesize, buffer, remaining, &offset);
+
+  totalsize += copysize;
+  buffer    += copysize;
+  remaining -= copysize;
+
+  if (totalsize >= buflen)
+    {
+      return totalsize;
+    }
+
+  /* Show the number of context switches to the thread */
+
+  linesize   = snprintf(procfile->line, STATUS_LINELEN, "%-12s%lu\n",
+                        "Switches:", (unsigned long)perf.switches);
+  copysize   = procfs_memcpy(procfile->line, linesize, buffer, remaining, &offset);
+
+  totalsize += copysize;
+  buffer    += copysize;
+  remaining -= copysize;
+
+  if (totalsize >= buflen)
+    {
+      return totalsize;
+    }
+
+  /* Show the number of times the thread was preempted */
+
+  linesize   = snprintf(procfile->line, STATUS_LINELEN, "%-12s%lu\n",
+                        "Preempted:", (unsigned long)perf.preemptions);
+  copysize   = procfs_memcpy(procfile->line, linesize, buffer, remaining, &offset);
+
+  totalsize += copysize;
+
+#if CONFIG_USEC_MEASURE_PERF_SAMPLES > 0
+  /* Show the PCs most recently sampled in the thread */
+
+  nsamples = sched_perf_samples(procfile->pid, pcs, PERF_NSAMPLES);
+  for (i = 0; i < nsamples; i++)
+    {
+      if (totalsize >= buflen)
+        {
+          return totalsize;
+        }
+
+      buffer    += copysize;
+      remaining -= copysize;
+
+      linesize   = snprintf(procfile->line, STATUS_LINELEN, "%-12s0x%08lx\n",
+                            i ? "" : "Samples:", (unsigned long)pcs[i]);
+      copysize   = procfs_memcpy(procfile->line, linesize, buffer, remaining,
+                                 &offset);
+
+      totalsize += copysize;
+    }
+#endif
+
+  return totalsize;
+}
+#endif
+
 /****************************************************************************
  * Name: proc_stack
  ****************************************************************************/
@@ -1063,6 +1186,11 @@ static ssize_t proc_read(FAR struct file *filep, FAR char *buffer,
     case PROC_LOADAVG: /* Average CPU utilization */
       ret = proc_loadavg(procfile, tcb, buffer, buflen, filep->f_pos);
       break;
+#endif
+#ifdef CONFIG_USEC_MEASURE_PERF
+    case PROC_PERF: /* CPU profiling counters */
+      ret = proc_perf(procfile, tcb, buffer, buflen, filep->f_pos);
+      break;
 #endif
     case PROC_STACK: /* Task stack info */
       ret = proc_stack(procfile, tcb, buffer, buflen, filep->f_pos);
@@ -1837,6 +1837,91 @@ void irq_perf_foreach(irq_perf_foreach_t handler, FAR void *arg);
 typedef void (*sched_perf_foreach_t)(pid_t pid, FAR const char *name, uint32_t time, FAR void *arg);
 
 void sched_perf_foreach(sched_perf_foreach_t handler, FAR void *arg);
+
+/************************************************************************
+ * Name: sched_perf_get
+ *
+ * Description:
+ *   Get the run time, context switch and preemption counts of a task
+ *   since it started. Unlike the start/stop window above, these are
+ *   always tracked.
+ *
+ * Inputs:
+ *   pid - task to look at
+ *   perf - returned counters
+ *
+ * Return Value:
+ *   OK (0) on success
+ *   -ESRCH if there is no such task
+ *
+ ************************************************************************/
+
+struct sched_perf_s
+{
+  uint64_t run_time;            /* uSec spent running the task */
+  uint32_t switches;            /* Number of times switched to */
+  uint32_t preemptions;         /* Number of times switched from while ready */
+};
+
+int sched_perf_get(pid_t pid, FAR struct sched_perf_s *perf);
+
+/************************************************************************
+ * Name: irq_perf_get
+ *
+ * Description:
+ *   Get the time spent in an interrupt handler, the number of times it
+ *   ran and its longest run since boot. The longest run bounds the
+ *   latency the interrupt adds to other interrupts and to tasks.
+ *
+ * Inputs:
+ *   irq - interrupt to look at
+ *   perf - returned counters
+ *
+ * Return Value:
+ *   OK (0) on success
+ *   -EINVAL if irq is not valid
+ *
+ ************************************************************************/
+
+struct irq_perf_s
+{
+  FAR const char *name;         /* Name of the interrupt */
+  uint64_t time;                /* uSec spent in the handler */
+  uint32_t count;               /* Number of times handled */
+  uint32_t max_time;            /* Longest run of the handler in uSec */
+};
+
+int irq_perf_get(int irq, FAR struct irq_perf_s *perf);
+
+#if CONFIG_USEC_MEASURE_PERF_SAMPLES > 0
+/************************************************************************
+ * Name: sched_perf_sample
+ *
+ * Description:
+ *   Record the PC interrupted by the system tick. Called by the timer
+ *   interrupt handler of the architecture.
+ *
+ ************************************************************************/
+
+struct sched_perf_sample_s
+{
+  pid_t pid;                    /* Task that was running */
+  uintptr_t pc;                 /* Interrupted program counter */
+};
+
+void sched_perf_sample(uintptr_t pc);
+
+/************************************************************************
+ * Name: sched_perf_samples
+ *
+ * Description:
+ *   Copy at most 'max' of the PCs most recently sampled in a task,
+ *   newest first, and return how many were copied.
+ *
+ ************************************************************************/
+
+int sched_perf_samples(pid_t pid, FAR uintptr_t *pcs, int max);
+#endif
 #endif
 
 /****************************************************************************
@@ -32,6 +32,8 @@
 #define __INCLUDE_NUTTX_DEVICE_DMA_H
 
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #include <nuttx/util.h>
 #include <nuttx/device.h>
@@ -81,6 +83,17 @@
 #define DEVICE_DMA_CALLBACK_EVENT_DEQUEUED  BIT(2)
 #define DEVICE_DMA_CALLBACK_EVENT_ERROR     BIT(3)
 
+/*
+ * Op flags. A chained op doesn't signal its completion on its own: when the
+ * next op on the channel is already queued, it is started right away and the
+ * callbacks of the whole chain are delivered together once an op without the
+ * flag, or the last queued op, completes.
+ */
+#define DEVICE_DMA_OP_FLAG_CHAINED          BIT(0)
+
+/* Completion latency histogram: bucket n counts latencies below 2^n us */
+#define DEVICE_DMA_LATENCY_BUCKETS          16
+
 /* Alignments for the source and destination address */
 #define DEVICE_DMA_ALIGNMENT_8              BIT(0)
 #define DEVICE_DMA_ALIGNMENT_16             BIT(1)
@@ -129,10 +142,20 @@ struct device_dma_op {
     device_dma_op_callback callback;
     void *callback_arg;
     unsigned int callback_events;
+    unsigned int flags; /* DEVICE_DMA_OP_FLAG_* */
     unsigned int sg_count;
     struct device_dma_sg sg[0];
 };
 
+struct device_dma_chan_stats {
+    uint32_t completions;   /* ops whose callbacks have been delivered */
+    uint32_t errors;
+    uint32_t wakeups;       /* times the completion context was woken */
+    uint32_t max_batch;     /* most ops delivered for a single wakeup */
+    uint32_t max_latency;   /* in us, from end of transfer to callback */
+    uint32_t latency[DEVICE_DMA_LATENCY_BUCKETS];
+};
+
 struct device_dma_params {
     enum device_dma_dev src_dev;
     unsigned int src_devid;
@@ -159,6 +182,8 @@ struct device_dma_type_ops {
             enum device_dma_error *error);
     int (*enqueue)(struct device *dev, void *chan, struct device_dma_op *op);
     int (*dequeue)(struct device *dev, void *chan, struct device_dma_op *op);
+    int (*chan_get_stats)(struct device *dev, void *chan,
+            struct device_dma_chan_stats *stats);
 };
 
 /**
@@ -384,4 +409,48 @@ static inline int device_dma_dequeue(struct device *dev, void *chan,
     return -ENOSYS;
 }
 
+/**
+ * @brief Get the completion statistics of a DMA channel
+ * @param dev DMA device the channel belongs to
+ * @param chan DMA channel cookie
+ * @param stats filled with the statistics of the channel
+ * @return 0: Success
+ *         -errno: Cause of failure
+ */
+static inline int device_dma_chan_get_stats(struct device *dev, void *chan,
+        struct device_dma_chan_stats *stats)
+{
+    DEVICE_DRIVER_ASSERT_OPS(dev);
+
+    if (!device_is_open(dev))
+        return -ENODEV;
+
+    if (DEVICE_DRIVER_GET_OPS(dev, dma)->chan_get_stats)
+        return DEVICE_DRIVER_GET_OPS(dev, dma)->chan_get_stats(dev, chan,
+                                                               stats);
+
+    return -ENOSYS;
+}
+
+/**
+ * @brief Tell a DMA driver whether to hold back the completion of an op
+ *
+ * Used by the drivers when an op completes, so that they all implement
+ * DEVICE_DMA_OP_FLAG_CHAINED the same way: a chained op that completed
+ * successfully isn't reported on its own if the next op of its channel is
+ * waiting, the driver starts that op and reports both together later.
+ *
+ * @param op op that just completed
+ * @param events DEVICE_DMA_CALLBACK_EVENT_* the op completed with
+ * @param next_queued whether another op is queued on the same channel
+ * @return true: Start the next op without waking the completion context
+ *         false: Report the completed ops now
+ */
+static inline bool device_dma_op_chains(const struct device_dma_op *op,
+        unsigned int events, bool next_queued)
+{
+    return (op->flags & DEVICE_DMA_OP_FLAG_CHAINED) &&
+           events == DEVICE_DMA_CALLBACK_EVENT_COMPLETE && next_queued;
+}
+
 #endif /* __INCLUDE_NUTTX_DEVICE_DMA_H */
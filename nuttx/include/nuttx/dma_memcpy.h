@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * @brief Memory copies offloaded to a DMA controller
+ */
+
+#ifndef __INCLUDE_NUTTX_DMA_MEMCPY_H
+#define __INCLUDE_NUTTX_DMA_MEMCPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nuttx/device.h>
+#include <nuttx/device_dma.h>
+
+/**
+ * Called once a copy is done.
+ * For copies done with DMA, it runs from the DMA completion context and must
+ * not block. For copies done by the CPU, it is called before
+ * dma_memcpy_async() or dma_memset_async() returns.
+ * @param status 0 if the copy succeeded, -EIO if the DMA failed.
+ * @param arg argument given to dma_memcpy_async() or dma_memset_async().
+ */
+typedef void (*dma_memcpy_callback)(int status, void *arg);
+
+struct dma_memcpy_stats {
+    uint32_t dma_copies;    /**< copies done by the DMA controller */
+    uint32_t dma_bytes;
+    uint32_t cpu_copies;    /**< copies done by the CPU */
+    uint32_t cpu_bytes;
+    uint32_t busy;          /**< copies done by the CPU for lack of a DMA op */
+    uint32_t errors;        /**< DMA transfers that failed */
+};
+
+#ifdef CONFIG_DMA_MEMCPY
+
+int dma_memcpy_init(struct device *dev);
+void dma_memcpy_deinit(void);
+
+int dma_memcpy_async(void *dst, const void *src, size_t len,
+                     dma_memcpy_callback callback, void *arg);
+int dma_memset_async(void *dst, int c, size_t len,
+                     dma_memcpy_callback callback, void *arg);
+int dma_memcpy(void *dst, const void *src, size_t len);
+int dma_memset(void *dst, int c, size_t len);
+
+size_t dma_memcpy_get_threshold(void);
+void dma_memcpy_set_threshold(size_t threshold);
+void dma_memcpy_get_stats(struct dma_memcpy_stats *stats);
+int dma_memcpy_get_chan_stats(struct device_dma_chan_stats *stats);
+
+#endif /* CONFIG_DMA_MEMCPY */
+
+#endif /* __INCLUDE_NUTTX_DMA_MEMCPY_H */
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EVENT_RING_H_
+#define _EVENT_RING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Ring of fixed size event records, read through a character driver.
+ * Writers claim a slot with interrupts disabled and never wait: when the
+ * reader falls behind, the oldest records are overwritten and the reader
+ * gets a record telling how many were lost instead.
+ */
+struct event_ring {
+    void *entries;
+    size_t entry_size;
+    uint32_t mask;          /* number of entries - 1, a power of two - 1 */
+    uint32_t head;          /* number of entries ever written */
+    uint32_t tail;          /* next entry to read */
+    bool enabled;
+};
+
+/* Initializer for a ring backed by a static array */
+#define EVENT_RING_INITIALIZER(array) \
+    { (array), sizeof((array)[0]), \
+      sizeof(array) / sizeof((array)[0]) - 1, 0, 0, true }
+
+/*
+ * Turn the copy of the oldest entry kept into a record of lost entries,
+ * leaving its timestamp untouched.
+ */
+typedef void (*event_ring_dropped_t)(void *entry, uint32_t lost);
+
+void *event_ring_claim(struct event_ring *ring);
+ssize_t event_ring_read(struct event_ring *ring, char *buffer, size_t len,
+                        event_ring_dropped_t dropped);
+ssize_t event_ring_write(struct event_ring *ring, const char *buffer,
+                         size_t len);
+
+#endif
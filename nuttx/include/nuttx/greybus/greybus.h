@@ -47,11 +47,26 @@ enum gb_event {
     GB_EVT_DISCONNECTED,
 };
 
+/*
+ * Dispatch priority of a driver when CONFIG_GREYBUS_WORKER_POOL is enabled.
+ * CPorts with pending messages are served by the worker pool from the
+ * highest to the lowest priority class.
+ */
+enum gb_dispatch_priority {
+    GB_DISPATCH_PRIORITY_NORMAL,
+    GB_DISPATCH_PRIORITY_HIGH,
+    GB_DISPATCH_PRIORITY_LOW,
+
+    GB_DISPATCH_PRIORITY_COUNT,
+};
+
 struct gb_operation;
 
 typedef void (*gb_operation_callback)(struct gb_operation *operation);
 typedef uint8_t (*gb_operation_handler_t)(struct gb_operation *operation);
 typedef void (*gb_operation_fast_handler_t)(unsigned int cport, void *data);
+typedef int (*gb_transport_send_done_t)(int status, const void *buf,
+                                        void *priv);
 
 #if !defined(CONFIG_GREYBUS_DEBUG)
 #define GB_HANDLER(t, h) \
@@ -65,6 +80,13 @@ typedef void (*gb_operation_fast_handler_t)(unsigned int cport, void *data);
         .type = t, \
         .fast_handler = h, \
     }
+
+#define GB_ATOMIC_HANDLER(t, h) \
+    { \
+        .type = t, \
+        .handler = h, \
+        .atomic = true, \
+    }
 #else
 #define GB_HANDLER(t, h) \
     { \
@@ -79,45 +101,92 @@ typedef void (*gb_operation_fast_handler_t)(unsigned int cport, void *data);
         .fast_handler = h, \
         .name = #h, \
     }
+
+#define GB_ATOMIC_HANDLER(t, h) \
+    { \
+        .type = t, \
+        .handler = h, \
+        .atomic = true, \
+        .name = #h, \
+    }
 #endif
 
 struct gb_operation_handler {
     uint8_t type;
     gb_operation_handler_t handler;
     gb_operation_fast_handler_t fast_handler;
+    /* handler never blocks and can run from the RX path */
+    bool atomic;
 #ifdef CONFIG_GREYBUS_DEBUG
     const char *name;
 #endif
 };
 
+/**
+ * Buffer sent without being copied into the operation buffer.
+ */
+struct gb_iovec {
+    const void *base;
+    size_t len;
+};
+
 struct gb_transport_backend {
     void (*init)(void);
     void (*exit)(void);
     int (*listen)(unsigned int cport);
     int (*stop_listening)(unsigned int cport);
     int (*send)(unsigned int cport, const void *buf, size_t len);
+    int (*send_batch)(unsigned int cport, const void **bufs,
+                      const size_t *lens, size_t count);
+    int (*send_iov)(unsigned int cport, const struct gb_iovec *iov,
+                    size_t iovcnt);
+    int (*send_async)(unsigned int cport, const void *buf, size_t len,
+                      gb_transport_send_done_t done, void *priv);
     void *(*alloc_buf)(size_t size);
     void (*free_buf)(void *ptr);
 };
 
+struct gb_operation_hdr {
+    __le16 size;
+    __le16 id;
+    __u8 type;
+    __u8 result; /* present in response only */
+    __u8 pad[2];
+};
+
 struct gb_operation {
     unsigned int cport;
     bool has_responded;
     atomic_t ref_count;
-    struct timespec time;
+    uint32_t deadline;
 
     void *request_buffer;
     void *response_buffer;
     bool is_unipro_rx_buf;
+    bool is_atomic;
+
+    bool is_pool_op;
+    bool is_pool_request_buf;
+    bool is_pool_response_buf;
+
+    struct gb_iovec request_ext;
+    struct gb_iovec response_ext;
 
     gb_operation_callback callback;
     sem_t sync_sem;
 
     void *priv_data;
     struct list_head list;
+    struct list_head hash_list;
+    uint32_t dispatch_ts;
 
     struct gb_operation *response;
 
+#ifdef CONFIG_GREYBUS_ATOMIC_HANDLERS
+    /* response sent asynchronously when none could be allocated */
+    struct gb_operation_hdr oom_hdr;
+#endif
+
 #ifdef CONFIG_GREYBUS_FEATURE_HAVE_TIMESTAMPS
     struct timespec send_ts;
     struct timespec recv_ts;
@@ -134,15 +203,30 @@ struct gb_driver {
 
     size_t stack_size;
     size_t op_handlers_count;
+    size_t op_pool_size;
+    enum gb_dispatch_priority dispatch_priority;
     const char *name;
 };
 
-struct gb_operation_hdr {
-    __le16 size;
-    __le16 id;
-    __u8 type;
-    __u8 result; /* present in response only */
-    __u8 pad[2];
+struct gb_operation_pool_stats {
+    size_t op_count;
+    size_t op_free;
+    size_t op_min_free;
+    uint32_t op_exhausted;
+
+    size_t buf_count;
+    size_t buf_size;
+    size_t buf_free;
+    size_t buf_min_free;
+    uint32_t buf_exhausted;
+};
+
+struct gb_dispatch_stats {
+    uint32_t dispatched;
+    uint32_t queue_depth;
+    uint32_t queue_depth_max;
+    uint32_t latency_max;       /* in microseconds */
+    uint64_t latency_total;     /* in microseconds */
 };
 
 enum gb_operation_type {
@@ -216,16 +300,31 @@ int gb_notify(unsigned cport, enum gb_event event);
 void gb_operation_destroy(struct gb_operation *operation);
 void *gb_operation_alloc_response(struct gb_operation *operation, size_t size);
 int gb_operation_send_response(struct gb_operation *operation, uint8_t result);
+int gb_operation_append_request_data(struct gb_operation *operation,
+                                     const void *data, size_t size);
+int gb_operation_append_response_data(struct gb_operation *operation,
+                                      const void *data, size_t size);
 int gb_operation_send_request_sync(struct gb_operation *operation);
 int gb_operation_send_request(struct gb_operation *operation,
                               gb_operation_callback callback,
                               bool need_response);
+int gb_operation_send_request_batch(struct gb_operation **operations,
+                                    size_t count,
+                                    gb_operation_callback callback,
+                                    bool need_response);
+int gb_operation_queue_request(struct gb_operation *operation,
+                               gb_operation_callback callback,
+                               bool need_response);
+int gb_operation_flush_requests(unsigned int cport);
 struct gb_operation *gb_operation_create(unsigned int cport, uint8_t type,
                                          uint32_t req_size);
 void gb_operation_ref(struct gb_operation *operation);
 void gb_operation_unref(struct gb_operation *operation);
 size_t gb_operation_get_request_payload_size(struct gb_operation *operation);
 uint8_t gb_operation_get_request_result(struct gb_operation *operation);
+int gb_operation_pool_get_stats(unsigned int cport,
+                                struct gb_operation_pool_stats *stats);
+int gb_dispatch_get_stats(unsigned int cport, struct gb_dispatch_stats *stats);
 int greybus_rx_handler(unsigned int, void*, size_t);
 
 void gb_control_register(int cport);
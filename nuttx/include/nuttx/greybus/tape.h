@@ -32,6 +32,20 @@
 #define __GREYBUS_TAPE_H__
 
 #include <sys/types.h>
+#include <stdint.h>
+
+enum gb_tape_replay_mode {
+    GB_TAPE_REPLAY_FAST,        /* as fast as the CPort drivers accept */
+    GB_TAPE_REPLAY_REALTIME,    /* reproduce the recorded timing */
+};
+
+struct gb_tape_replay_stats {
+    unsigned int messages;
+    unsigned int errors;        /* messages refused by the core */
+    unsigned int dropped;       /* messages lost during the recording */
+    uint64_t bytes;
+    uint32_t elapsed;           /* in microseconds */
+};
 
 enum {
     GB_TAPE_RDONLY,
@@ -52,6 +66,11 @@ int gb_tape_arm_semihosting_register(void);
 int gb_tape_communication(const char *pathname);
 int gb_tape_stop(void);
 int gb_tape_replay(const char *pathname);
+int gb_tape_replay_ext(const char *pathname, enum gb_tape_replay_mode mode,
+                       unsigned int loops,
+                       struct gb_tape_replay_stats *stats);
+
+void gb_tape_record(unsigned int cport, const void *data, size_t size);
 
 #endif /* __GREYBUS_TAPE_H__ */
 
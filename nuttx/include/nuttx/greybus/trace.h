@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __GREYBUS_TRACE_H__
+#define __GREYBUS_TRACE_H__
+
+#include <stdint.h>
+
+struct gb_operation_hdr;
+
+enum gb_trace_event {
+    GB_TRACE_RX = 1,            /* message received from the transport */
+    GB_TRACE_RX_QUEUED,         /* operation queued in the CPort RX fifo */
+    GB_TRACE_DEQUEUED,          /* operation taken by a worker */
+    GB_TRACE_HANDLER_START,     /* request handler or response callback */
+    GB_TRACE_HANDLER_END,
+    GB_TRACE_TX,                /* message handed to the transport */
+    GB_TRACE_TX_DONE,           /* transport done with the message */
+    GB_TRACE_DROPPED = 0xff,    /* events lost, count is (id << 16) | size */
+};
+
+/*
+ * Trace record, as read from /dev/gbtrace. Fields are in the bridge native
+ * (little) endianness, id and size are the ones of the Greybus header.
+ */
+struct gb_trace_entry {
+    uint32_t timestamp;         /* hrt_getusec() */
+    uint16_t cport;
+    uint16_t id;
+    uint16_t size;
+    uint8_t type;
+    uint8_t event;
+} __attribute__((packed));
+
+#ifdef CONFIG_GREYBUS_TRACE
+void gb_trace(enum gb_trace_event event, unsigned int cport,
+              const struct gb_operation_hdr *hdr);
+int gb_trace_init(void);
+#else
+static inline void gb_trace(enum gb_trace_event event, unsigned int cport,
+                            const struct gb_operation_hdr *hdr)
+{
+}
+
+static inline int gb_trace_init(void)
+{
+    return 0;
+}
+#endif
+
+#endif /* __GREYBUS_TRACE_H__ */
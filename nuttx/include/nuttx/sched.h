@@ -478,6 +478,7 @@ struct tcb_s
   uint8_t  pend_reprios[CONFIG_SEM_NNESTPRIO];
 #  endif
   uint8_t  base_priority;                /* "Normal" priority of the thread     */
+  uint16_t nholds;                       /* Counts held on PI sems, saturating  */
 #endif
 
   uint8_t  task_state;                   /* Current state of the thread         */
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __INCLUDE_NUTTX_SCHED_NOTE_H
+#define __INCLUDE_NUTTX_SCHED_NOTE_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+
+#include <nuttx/compiler.h>
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Type of a scheduler note, and meaning of its fields */
+
+enum sched_note_type_e
+{
+  NOTE_START = 1,    /* Task started: pid, priority */
+  NOTE_NAME,         /* Task name: pid, chunk index in priority, 4 chars in arg */
+  NOTE_STOP,         /* Task stopped: pid */
+  NOTE_SWITCH,       /* Context switch to pid/priority from the pid in arg */
+  NOTE_IRQ_ENTER,    /* Interrupt handler entered: arg is the irq number */
+  NOTE_IRQ_LEAVE,    /* Interrupt handler left: arg is the irq number */
+  NOTE_SEM_BLOCK,    /* pid blocked on the semaphore at address arg */
+  NOTE_SEM_UNBLOCK,  /* pid woken up from the semaphore at address arg */
+  NOTE_PRIORITY,     /* Priority inheritance set the priority of pid, the
+                      * previous one is in arg */
+  NOTE_DROPPED = 0xff /* arg notes were lost */
+};
+
+/* Note record, as read from /dev/schednote.  Fields are in the native
+ * (little) endianness.  pid and priority are the ones of the task the
+ * note is about, or of the running task for interrupt notes.
+ */
+
+struct sched_note_s
+{
+  uint32_t timestamp;  /* hrt_getusec() */
+  uint16_t pid;
+  uint8_t  priority;
+  uint8_t  type;       /* See enum sched_note_type_e */
+  uint32_t arg;
+} packed_struct;
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#ifdef __cplusplus
+#define EXTERN extern "C"
+extern "C"
+{
+#else
+#define EXTERN extern
+#endif
+
+#ifdef CONFIG_SCHED_NOTE_BUFFER
+/****************************************************************************
+ * Name: sched_note_register
+ *
+ * Description:
+ *   Register the /dev/schednote driver that reads the scheduler notes.
+ *
+ ****************************************************************************/
+
+int sched_note_register(void);
+#endif
+
+#undef EXTERN
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INCLUDE_NUTTX_SCHED_NOTE_H */
@@ -38,6 +38,8 @@
 
 #define INFINITE_MAX_INFLIGHT_BUFCOUNT      0
 
+#define UNIPRO_IOV_MAX              2
+
 enum unipro_event {
     UNIPRO_EVT_MAILBOX,
     UNIPRO_EVT_LUP_DONE,
@@ -48,6 +50,47 @@ typedef int (*unipro_send_completion_t)(int status, const void *buf,
 typedef void (*cport_reset_completion_cb_t)(unsigned int cportid, void *data);
 typedef void (*unipro_event_handler_t)(enum unipro_event evt);
 
+struct unipro_iovec {
+    const void *base;
+    size_t len;
+};
+
+/*
+ * TX scheduling: strict priority between levels (0 is the highest), deficit
+ * round-robin by bytes between the CPorts of a level.
+ */
+#define UNIPRO_TX_PRIORITY_COUNT    4
+#define UNIPRO_TX_DEFAULT_PRIORITY  2
+#define UNIPRO_TX_DEFAULT_WEIGHT    2048 /* bytes per round */
+
+struct unipro_tx_stats {
+    uint32_t messages;          /* messages completely sent */
+    uint64_t bytes;
+    uint32_t delay_max;         /* longest queueing delay, in us */
+    uint64_t delay_total;       /* sum of the queueing delays, in us */
+    uint32_t backpressure;      /* sends that found no free descriptor */
+    uint32_t queue_depth;       /* messages queued */
+    uint32_t queue_max;         /* high-water mark of queue_depth */
+    uint32_t latency_max;       /* longest time from queued to sent, in us */
+    uint64_t latency_total;     /* sum of the times from queued to sent */
+    uint32_t stalls;            /* times TX waited for E2E flow control */
+};
+
+struct unipro_tx_channel_stats {
+    uint32_t ops;               /* DMA operations completed */
+    uint64_t bytes;
+    uint64_t busy_time;         /* time with operations in flight, in us */
+};
+
+struct unipro_rx_stats {
+    uint32_t messages;
+    uint64_t bytes;
+    uint32_t pauses;            /* times RX stopped for lack of a buffer */
+    uint64_t pause_time;        /* total time RX was stopped, in us */
+    uint32_t pause_time_max;    /* longest stop, in us */
+    uint32_t pool_misses;       /* buffers allocated with the pool empty */
+};
+
 struct unipro_driver {
     const char name[32];
     int (*rx_handler)(unsigned int cportid,  // Called in irq context
@@ -64,13 +107,24 @@ void unipro_info(void);
 int unipro_send(unsigned int cportid, const void *buf, size_t len);
 int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
                       unipro_send_completion_t callback, void *priv);
+int unipro_send_batch(unsigned int cportid, const void **bufs,
+                      const size_t *lens, size_t count);
+int unipro_send_iov(unsigned int cportid, const struct unipro_iovec *iov,
+                    size_t iovcnt);
 int unipro_reset_cport(unsigned int cportid, cport_reset_completion_cb_t cb,
                        void *priv);
+int unipro_tx_set_priority(unsigned int cportid, unsigned int priority,
+                           unsigned int weight);
+int unipro_tx_get_stats(unsigned int cportid, struct unipro_tx_stats *stats);
+int unipro_tx_get_channel_stats(unsigned int channel,
+                                struct unipro_tx_channel_stats *stats);
 
 int unipro_set_max_inflight_rxbuf_count(unsigned int cportid,
                                         size_t max_inflight_buf);
 void *unipro_rxbuf_alloc(unsigned int cportid);
 void unipro_rxbuf_free(unsigned int cportid, void *ptr);
+int unipro_rxbuf_set_pool_depth(unsigned int cportid, unsigned int depth);
+int unipro_rx_get_stats(unsigned int cportid, struct unipro_rx_stats *stats);
 
 /*
  * UniPro attributes
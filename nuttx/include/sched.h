@@ -130,15 +130,25 @@ int    sched_lockcount(void);
 
 #ifdef CONFIG_SCHED_INSTRUMENTATION
 
+struct sem_s;
+
 void   sched_note_start(FAR struct tcb_s *tcb);
 void   sched_note_stop(FAR struct tcb_s *tcb);
 void   sched_note_switch(FAR struct tcb_s *pFromTcb,
                          FAR struct tcb_s *pToTcb);
+void   sched_note_irqhandler(int irq, bool enter);
+void   sched_note_semblock(FAR struct tcb_s *tcb, FAR struct sem_s *sem);
+void   sched_note_semunblock(FAR struct tcb_s *tcb, FAR struct sem_s *sem);
+void   sched_note_priority(FAR struct tcb_s *tcb, uint8_t priority);
 
 #else
 # define sched_note_start(t)
 # define sched_note_stop(t)
 # define sched_note_switch(t1, t2)
+# define sched_note_irqhandler(i, e)
+# define sched_note_semblock(t, s)
+# define sched_note_semunblock(t, s)
+# define sched_note_priority(t, p)
 #endif /* CONFIG_SCHED_INSTRUMENTATION */
 
 #undef EXTERN
@@ -57,6 +57,11 @@ extern "C"
  * Pre-processor Definitions
  ****************************************************************************/
 
+/* Protocols for sem_setprotocol() */
+
+#define SEM_PRIO_NONE      0     /* No priority inheritance */
+#define SEM_PRIO_INHERIT   1     /* Priority inheritance (if enabled) */
+
 /****************************************************************************
  * Public Type Declarations
  ****************************************************************************/
@@ -88,14 +93,15 @@ struct sem_s
   int16_t semcount;              /* >0 -> Num counts available */
                                  /* <0 -> Num tasks waiting for semaphore */
   /* If priority inheritance is enabled, then we have to keep track of which
-   * tasks hold references to the semaphore.
+   * tasks hold references to the semaphore.  The first holder is kept in
+   * the semaphore itself, so that a mutex never needs the list.
    */
 
 #ifdef CONFIG_PRIORITY_INHERITANCE
+  uint8_t protocol;              /* SEM_PRIO_NONE or SEM_PRIO_INHERIT */
+  struct semholder_s holder;     /* First holder */
 # if CONFIG_SEM_PREALLOCHOLDERS > 0
-  FAR struct semholder_s *hhead; /* List of holders of semaphore counts */
-# else
-  struct semholder_s holder;     /* Single holder */
+  FAR struct semholder_s *hhead; /* List of the other holders */
 # endif
 #endif
 };
@@ -105,10 +111,14 @@ typedef struct sem_s sem_t;
 /* Initializers */
 
 #ifdef CONFIG_PRIORITY_INHERITANCE
+/* semcount, protocol, holder[, hhead] */
+
 # if CONFIG_SEM_PREALLOCHOLDERS > 0
-#  define SEM_INITIALIZER(c) {(c), NULL}  /* semcount, hhead */
+#  define SEM_INITIALIZER(c) \
+     {(c), SEM_PRIO_INHERIT, SEMHOLDER_INITIALIZER, NULL}
 # else
-#  define SEM_INITIALIZER(c) {(c), SEMHOLDER_INITIALIZER} /* semcount, holder */
+#  define SEM_INITIALIZER(c) \
+     {(c), SEM_PRIO_INHERIT, SEMHOLDER_INITIALIZER}
 # endif
 #else
 #  define SEM_INITIALIZER(c) {(c)} /* semcount */
@@ -138,6 +148,10 @@ int        sem_trywait(FAR sem_t *sem);
 int        sem_post(FAR sem_t *sem);
 int        sem_getvalue(FAR sem_t *sem, FAR int *sval);
 
+/* Non-standard semaphore interfaces */
+
+int        sem_setprotocol(FAR sem_t *sem, int protocol);
+
 #undef EXTERN
 #ifdef __cplusplus
 }
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <nuttx/event_ring.h>
+#include <arch/irq.h>
+
+/**
+ @brief Claim the slot of the next entry
+ The oldest entry is overwritten when the ring is full.
+ @note Must be called with interrupts disabled, until the entry is filled
+ @param ring The ring to write to
+ @return entry to fill, or NULL if recording is stopped
+ */
+void *event_ring_claim(struct event_ring *ring)
+{
+    if (!ring->enabled)
+        return NULL;
+
+    return (char *)ring->entries +
+           (ring->head++ & ring->mask) * ring->entry_size;
+}
+
+/*
+ * Copy the oldest entry to entry and set lost to the number of entries
+ * overwritten before it. Only consume the entry when none was lost.
+ */
+static bool event_ring_pop(struct event_ring *ring, void *entry,
+                           uint32_t *lost)
+{
+    uint32_t size = ring->mask + 1;
+    irqstate_t flags;
+    uint32_t count;
+
+    flags = irqsave();
+
+    count = ring->head - ring->tail;
+    if (count == 0) {
+        irqrestore(flags);
+        return false;
+    }
+
+    if (count > size) {
+        ring->tail = ring->head - size;
+        *lost = count - size;
+    } else {
+        *lost = 0;
+    }
+
+    memcpy(entry, (char *)ring->entries +
+           (ring->tail & ring->mask) * ring->entry_size, ring->entry_size);
+    if (*lost == 0)
+        ring->tail++;
+
+    irqrestore(flags);
+
+    return true;
+}
+
+/**
+ @brief Read whole entries from the ring
+ @param ring The ring to read from
+ @param buffer buffer to receive the entries
+ @param len size of buffer
+ @param dropped called to turn an entry into a record of lost entries
+ @return number of bytes read
+ */
+ssize_t event_ring_read(struct event_ring *ring, char *buffer, size_t len,
+                        event_ring_dropped_t dropped)
+{
+    size_t count = 0;
+    uint32_t lost;
+
+    while (len - count >= ring->entry_size &&
+           event_ring_pop(ring, buffer + count, &lost)) {
+        if (lost)
+            dropped(buffer + count, lost);
+        count += ring->entry_size;
+    }
+
+    return count;
+}
+
+/**
+ @brief Control the recording
+ Writing '0' stops recording, '1' restarts it and 'c' drops all the
+ entries not read yet.
+ @param ring The ring to control
+ @param buffer commands
+ @param len number of commands
+ @return len, or -EINVAL on an unknown command
+ */
+ssize_t event_ring_write(struct event_ring *ring, const char *buffer,
+                         size_t len)
+{
+    irqstate_t flags;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        switch (buffer[i]) {
+        case '0':
+            ring->enabled = false;
+            break;
+        case '1':
+            ring->enabled = true;
+            break;
+        case 'c':
+            flags = irqsave();
+            ring->tail = ring->head;
+            irqrestore(flags);
+            break;
+        case '\n':
+            break;
+        default:
+            return -EINVAL;
+        }
+    }
+
+    return len;
+}
@@ -108,11 +108,11 @@ int sem_init(FAR sem_t *sem, int pshared, unsigned int value)
       /* Initialize to support priority inheritance */
 
 #ifdef CONFIG_PRIORITY_INHERITANCE
-#  if CONFIG_SEM_PREALLOCHOLDERS > 0
-      sem->hhead         = NULL;
-#  else
+      sem->protocol      = SEM_PRIO_INHERIT;
       sem->holder.htcb   = NULL;
       sem->holder.counts = 0;
+#  if CONFIG_SEM_PREALLOCHOLDERS > 0
+      sem->hhead         = NULL;
 #  endif
 #endif
       return OK;
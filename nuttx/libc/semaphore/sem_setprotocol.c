@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <semaphore.h>
+#include <errno.h>
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Function: sem_setprotocol
+ *
+ * Description:
+ *   Select whether priority inheritance applies to a semaphore.  This is
+ *   meant to be called right after sem_init(), before any count is taken.
+ *
+ *   Priority inheritance only makes sense for a semaphore used as a lock,
+ *   where the task taking a count is the one that will post it.  A
+ *   semaphore used to signal events, posted by another task or by an
+ *   interrupt handler, should be SEM_PRIO_NONE: its waiters would
+ *   otherwise be recorded as holders that never release their counts.
+ *   Internal kernel locks that are never contended across priorities
+ *   can also use SEM_PRIO_NONE to skip the holder bookkeeping in
+ *   sem_wait() and sem_post().
+ *
+ * Parameters:
+ *   sem - Semaphore to be configured
+ *   protocol - SEM_PRIO_NONE or SEM_PRIO_INHERIT
+ *
+ * Return Value:
+ *   0 (OK), or -1 (ERROR) if unsuccessful, with errno set to:
+ *   - EINVAL:  Invalid semaphore or protocol
+ *   - ENOSYS:  SEM_PRIO_INHERIT without CONFIG_PRIORITY_INHERITANCE
+ *
+ ****************************************************************************/
+
+int sem_setprotocol(FAR sem_t *sem, int protocol)
+{
+  if (!sem || (protocol != SEM_PRIO_NONE && protocol != SEM_PRIO_INHERIT))
+    {
+      set_errno(EINVAL);
+      return ERROR;
+    }
+
+#ifdef CONFIG_PRIORITY_INHERITANCE
+  sem->protocol = (uint8_t)protocol;
+  return OK;
+#else
+  if (protocol == SEM_PRIO_INHERIT)
+    {
+      set_errno(ENOSYS);
+      return ERROR;
+    }
+
+  return OK;
+#endif
+}
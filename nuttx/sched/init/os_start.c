@@ -355,7 +355,11 @@ void os_start(void)
 
   /* Then add the idle task's TCB to the head of the ready to run list */
 
+#ifdef CONFIG_SCHED_RTR_BITMAP
+  sched_rtr_insert(&g_idletcb.cmn);
+#else
   dq_addfirst((FAR dq_entry_t*)&g_idletcb, (FAR dq_queue_t*)&g_readytorun);
+#endif
 
   /* Initialize the processor-specific portion of the TCB */
 
@@ -70,6 +70,7 @@
 #include <debug.h>
 #include <nuttx/arch.h>
 #include <nuttx/irq.h>
+#include <sched.h>
 
 #include "irq/irq.h"
 
@@ -137,7 +138,9 @@ void irq_dispatch(int irq, FAR void *context)
 
   /* Then dispatch to the interrupt handler */
 
+  sched_note_irqhandler(irq, true);
   vector(irq, context);
+  sched_note_irqhandler(irq, false);
 
 #if defined(CONFIG_USEC_MEASURE_PERF)
   /* stop tracking current interrupt and go back to tracking current tcb */
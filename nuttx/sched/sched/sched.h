@@ -122,6 +122,9 @@ struct pidhash_s
 #endif
 #ifdef CONFIG_USEC_MEASURE_PERF
   uint32_t thread_time;         /* current uSec of thread use */
+  uint64_t run_time;            /* uSec of thread use since it started */
+  uint32_t switches;            /* Number of times switched to */
+  uint32_t preemptions;         /* Number of times switched from while ready */
 #endif
 };
 
@@ -256,6 +259,12 @@ bool sched_addreadytorun(FAR struct tcb_s *rtrtcb);
 bool sched_removereadytorun(FAR struct tcb_s *rtrtcb);
 bool sched_addprioritized(FAR struct tcb_s *newTcb, DSEG dq_queue_t *list);
 bool sched_mergepending(void);
+#ifdef CONFIG_SCHED_RTR_BITMAP
+bool sched_rtr_insert(FAR struct tcb_s *tcb);
+void sched_rtr_remove(FAR struct tcb_s *tcb);
+void sched_rtr_setpriority(FAR struct tcb_s *tcb, uint8_t priority);
+int  sched_rtr_highest(void);
+#endif
 void sched_addblocked(FAR struct tcb_s *btcb, tstate_t task_state);
 void sched_removeblocked(FAR struct tcb_s *btcb);
 int  sched_setpriority(FAR struct tcb_s *tcb, int sched_priority);
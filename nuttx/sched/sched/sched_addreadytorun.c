@@ -121,7 +121,11 @@ bool sched_addreadytorun(FAR struct tcb_s *btcb)
 
   /* Otherwise, add the new task to the ready-to-run task list */
 
+#ifdef CONFIG_SCHED_RTR_BITMAP
+  else if (sched_rtr_insert(btcb))
+#else
   else if (sched_addprioritized(btcb, (FAR dq_queue_t*)&g_readytorun))
+#endif
     {
       /* Inform the instrumentation logic that we are switching tasks */
 
@@ -92,6 +92,47 @@
  *
  ************************************************************************/
 
+#ifdef CONFIG_SCHED_RTR_BITMAP
+bool sched_mergepending(void)
+{
+  FAR struct tcb_s *pndtcb;
+  FAR struct tcb_s *pndnext;
+  FAR struct tcb_s *rtrtcb;
+  bool ret = false;
+
+  /* Process every TCB in the g_pendingtasks list.  The priority index
+   * finds the location of each one in the g_readytorun list.
+   */
+
+  for (pndtcb = (FAR struct tcb_s*)g_pendingtasks.head; pndtcb; pndtcb = pndnext)
+    {
+      pndnext = pndtcb->flink;
+      rtrtcb  = (FAR struct tcb_s*)g_readytorun.head;
+
+      if (sched_rtr_insert(pndtcb))
+        {
+          /* Inform the instrumentation layer that we are switching tasks */
+
+          sched_note_switch(rtrtcb, pndtcb);
+
+          rtrtcb->task_state = TSTATE_TASK_READYTORUN;
+          pndtcb->task_state = TSTATE_TASK_RUNNING;
+          ret                = true;
+        }
+      else
+        {
+          pndtcb->task_state = TSTATE_TASK_READYTORUN;
+        }
+    }
+
+  /* Mark the input list empty */
+
+  g_pendingtasks.head = NULL;
+  g_pendingtasks.tail = NULL;
+
+  return ret;
+}
+#else
 bool sched_mergepending(void)
 {
   FAR struct tcb_s *pndtcb;
@@ -170,3 +211,4 @@ bool sched_mergepending(void)
 
   return ret;
 }
+#endif /* CONFIG_SCHED_RTR_BITMAP */
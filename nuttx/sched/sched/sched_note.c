@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/************************************************************************
+ * Scheduler notes
+ *
+ * Implements the instrumentation hooks of include/sched.h by recording
+ * notes in an event ring read from /dev/schednote.
+ ************************************************************************/
+
+/************************************************************************
+ * Included Files
+ ************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sched.h>
+#include <errno.h>
+
+#include <nuttx/arch.h>
+#include <nuttx/event_ring.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/hires_tmr.h>
+#include <nuttx/sched_note.h>
+#include <arch/irq.h>
+
+#include "sched/sched.h"
+
+#ifdef CONFIG_SCHED_NOTE_BUFFER
+
+/************************************************************************
+ * Pre-processor Definitions
+ ************************************************************************/
+
+#if (CONFIG_SCHED_NOTE_BUFFER_SIZE & (CONFIG_SCHED_NOTE_BUFFER_SIZE - 1)) != 0
+#  error CONFIG_SCHED_NOTE_BUFFER_SIZE must be a power of two
+#endif
+
+/************************************************************************
+ * Private Function Prototypes
+ ************************************************************************/
+
+static ssize_t note_read(FAR struct file *filep, FAR char *buffer,
+                         size_t buflen);
+static ssize_t note_write(FAR struct file *filep, FAR const char *buffer,
+                          size_t buflen);
+
+/************************************************************************
+ * Private Variables
+ ************************************************************************/
+
+static struct sched_note_s g_note_entries[CONFIG_SCHED_NOTE_BUFFER_SIZE];
+static struct event_ring g_note_ring = EVENT_RING_INITIALIZER(g_note_entries);
+
+static const struct file_operations g_note_fops =
+{
+  0,             /* open */
+  0,             /* close */
+  note_read,     /* read */
+  note_write,    /* write */
+  0,             /* seek */
+  0              /* ioctl */
+#ifndef CONFIG_DISABLE_POLL
+  , 0            /* poll */
+#endif
+};
+
+/************************************************************************
+ * Private Functions
+ ************************************************************************/
+
+/************************************************************************
+ * Name: note_add
+ *
+ * Description:
+ *   Record a note about a task.
+ *
+ ************************************************************************/
+
+static void note_add(uint8_t type, FAR struct tcb_s *tcb, uint8_t priority,
+                     uint32_t arg)
+{
+  FAR struct sched_note_s *note;
+  irqstate_t flags;
+
+  flags = irqsave();
+
+  note = event_ring_claim(&g_note_ring);
+  if (!note)
+    {
+      irqrestore(flags);
+      return;
+    }
+
+  note->timestamp = hrt_getusec();
+  note->pid       = tcb ? tcb->pid : 0;
+  note->priority  = priority;
+  note->type      = type;
+  note->arg       = arg;
+
+  irqrestore(flags);
+}
+
+/************************************************************************
+ * Name: note_dropped
+ *
+ * Description:
+ *   Turn a copy of the oldest note kept into a NOTE_DROPPED record.
+ *
+ ************************************************************************/
+
+static void note_dropped(FAR void *entry, uint32_t lost)
+{
+  FAR struct sched_note_s *note = entry;
+
+  note->pid      = 0;
+  note->priority = 0;
+  note->type     = NOTE_DROPPED;
+  note->arg      = lost;
+}
+
+/************************************************************************
+ * Name: note_read
+ ************************************************************************/
+
+static ssize_t note_read(FAR struct file *filep, FAR char *buffer,
+                         size_t buflen)
+{
+  return event_ring_read(&g_note_ring, buffer, buflen, note_dropped);
+}
+
+/************************************************************************
+ * Name: note_write
+ *
+ * Description:
+ *   See event_ring_write() for the commands.
+ *
+ ************************************************************************/
+
+static ssize_t note_write(FAR struct file *filep, FAR const char *buffer,
+                          size_t buflen)
+{
+  return event_ring_write(&g_note_ring, buffer, buflen);
+}
+
+/************************************************************************
+ * Public Functions
+ ************************************************************************/
+
+/************************************************************************
+ * Name: sched_note_start
+ *
+ * Description:
+ *   Record the start of a task, followed by its name 4 characters at a
+ *   time so that the decoder doesn't need anything but the notes.
+ *
+ ************************************************************************/
+
+void sched_note_start(FAR struct tcb_s *tcb)
+{
+#if CONFIG_TASK_NAME_SIZE > 0
+  uint32_t chunk;
+  int len;
+  int i;
+#endif
+
+  note_add(NOTE_START, tcb, tcb->sched_priority, 0);
+
+#if CONFIG_TASK_NAME_SIZE > 0
+  len = strlen(tcb->name);
+  for (i = 0; i < len; i += sizeof(chunk))
+    {
+      chunk = 0;
+      strncpy((FAR char *)&chunk, &tcb->name[i], sizeof(chunk));
+      note_add(NOTE_NAME, tcb, i / sizeof(chunk), chunk);
+    }
+#endif
+}
+
+void sched_note_stop(FAR struct tcb_s *tcb)
+{
+  note_add(NOTE_STOP, tcb, tcb->sched_priority, 0);
+}
+
+void sched_note_switch(FAR struct tcb_s *pFromTcb, FAR struct tcb_s *pToTcb)
+{
+  note_add(NOTE_SWITCH, pToTcb, pToTcb->sched_priority, pFromTcb->pid);
+}
+
+void sched_note_irqhandler(int irq, bool enter)
+{
+  FAR struct tcb_s *rtcb = (FAR struct tcb_s *)g_readytorun.head;
+
+  note_add(enter ? NOTE_IRQ_ENTER : NOTE_IRQ_LEAVE, rtcb,
+           rtcb ? rtcb->sched_priority : 0, irq);
+}
+
+void sched_note_semblock(FAR struct tcb_s *tcb, FAR struct sem_s *sem)
+{
+  note_add(NOTE_SEM_BLOCK, tcb, tcb->sched_priority, (uintptr_t)sem);
+}
+
+void sched_note_semunblock(FAR struct tcb_s *tcb, FAR struct sem_s *sem)
+{
+  note_add(NOTE_SEM_UNBLOCK, tcb, tcb->sched_priority, (uintptr_t)sem);
+}
+
+void sched_note_priority(FAR struct tcb_s *tcb, uint8_t priority)
+{
+  note_add(NOTE_PRIORITY, tcb, priority, tcb->sched_priority);
+}
+
+/************************************************************************
+ * Name: sched_note_register
+ *
+ * Description:
+ *   Register the /dev/schednote driver that reads the scheduler notes.
+ *
+ ************************************************************************/
+
+int sched_note_register(void)
+{
+  return register_driver("/dev/schednote", &g_note_fops, 0666, NULL);
+}
+
+#endif /* CONFIG_SCHED_NOTE_BUFFER */
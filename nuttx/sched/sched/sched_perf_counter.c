@@ -80,11 +80,24 @@ static int curr_hash_index;
 static uint32_t irq_times[NR_IRQS];
 
 /* Keep track of the current irq in interrupt context */
-static bool curr_irq;
+static int curr_irq;
 
 /* No interrupt to track */
 #define NO_IRQ (NR_IRQS +1)
 
+/* Continuous profiling, independent of the start/stop window above:
+ * the last time run time was accounted, and the 64-bit run time, count
+ * and longest run of every interrupt since boot.
+ */
+static uint32_t prof_last_time;
+static struct irq_perf_s irq_perf[NR_IRQS];
+
+#if CONFIG_USEC_MEASURE_PERF_SAMPLES > 0
+/* Ring of the PCs sampled on each system tick */
+static struct sched_perf_sample_s perf_samples[CONFIG_USEC_MEASURE_PERF_SAMPLES];
+static unsigned int perf_sample_next;
+#endif
+
 
 /************************************************************************
  * Private Variables
@@ -94,6 +107,61 @@ static bool curr_irq;
  * Private Functions
  ************************************************************************/
 
+/************************************************************************
+ * Name: prof_elapsed
+ *
+ * Description:
+ *   Return the uSec elapsed since the last call. The 32-bit timer
+ *   difference is exact as long as calls are less than 1.19 hours
+ *   apart, which the system tick guarantees; the totals are 64-bit.
+ *
+ ************************************************************************/
+static uint32_t prof_elapsed(void)
+{
+    uint32_t now = hrt_getusec();
+    uint32_t elapsed = now - prof_last_time;
+
+    prof_last_time = now;
+    return elapsed;
+}
+
+/************************************************************************
+ * Name: prof_charge_task
+ *
+ * Description:
+ *   Add run time to the task being tracked.
+ *
+ ************************************************************************/
+static void prof_charge_task(uint32_t usec)
+{
+    g_pidhash[curr_hash_index].run_time += usec;
+
+    if (perf_active) {
+        g_pidhash[curr_hash_index].thread_time += usec;
+    }
+}
+
+/************************************************************************
+ * Name: prof_switch_to
+ *
+ * Description:
+ *   Count a context switch from the task being tracked to 'hash_index'.
+ *   The previous task was preempted if it is still ready to run, rather
+ *   than blocked or exiting.
+ *
+ ************************************************************************/
+static void prof_switch_to(int hash_index)
+{
+    struct tcb_s *prev = g_pidhash[curr_hash_index].tcb;
+
+    if (prev && prev->task_state == TSTATE_TASK_READYTORUN) {
+        g_pidhash[curr_hash_index].preemptions++;
+    }
+
+    curr_hash_index = hash_index;
+    g_pidhash[hash_index].switches++;
+}
+
 /************************************************************************
  * Public Functions
  ************************************************************************/
@@ -194,6 +262,10 @@ void init_perf_track(void)
     perf_stop = 0;
     last_perf_time = 0;
     curr_irq = NO_IRQ;
+
+    /* The idle task is running and profiling is always on */
+    curr_hash_index = 0;
+    prof_last_time = hrt_getusec();
 }
 
 
@@ -399,27 +471,18 @@ void sched_perf_foreach(sched_perf_foreach_t handler, FAR void *arg)
  ************************************************************************/
 void sched_track_switch (struct tcb_s* new_tcb)
 {
-    uint32_t usec;
-    int hash_index;
     irqstate_t flags;
 
-    if (perf_active) {
-        /* only called when in non irq context state */
-        flags = irqsave();
-
-        /* get the time diff from the last sample */
-        usec = get_perf_diff_from_last(get_perf_time());
-
-        hash_index = PIDHASH(new_tcb->pid);
+    /* only called when in non irq context state */
+    flags = irqsave();
 
-        /* add the time diff to the old sample */
-        g_pidhash[curr_hash_index].thread_time += usec;
+    /* add the time since the last sample to the old task */
+    prof_charge_task(prof_elapsed());
 
-        /* keep track of who we are tracking now */
-        curr_hash_index = hash_index;
+    /* keep track of who we are tracking now */
+    prof_switch_to(PIDHASH(new_tcb->pid));
 
-        irqrestore(flags);
-    }
+    irqrestore(flags);
 }
 
 /************************************************************************
@@ -437,20 +500,40 @@ void sched_track_switch (struct tcb_s* new_tcb)
  ************************************************************************/
 inline void sched_track_irq_stop(void)
 {
-    if (perf_active) {
-        /* guard against more more one call per irq */
-        if ( curr_irq != NO_IRQ) {
-            /* stop tracking interrupt */
-            irq_times[curr_irq] += get_perf_diff_from_last(get_perf_time());
+    struct irq_perf_s *perf;
+    uint32_t usec;
+    int hash_index;
+
+    /* guard against more more one call per irq */
+    if (curr_irq == NO_IRQ) {
+        return;
+    }
 
-            curr_irq = NO_IRQ;
+    /* stop tracking interrupt */
+    usec = prof_elapsed();
+
+    if ((unsigned int)curr_irq < NR_IRQS) {
+        perf = &irq_perf[curr_irq];
+        perf->time += usec;
+        perf->count++;
+        if (usec > perf->max_time) {
+            perf->max_time = usec;
+        }
 
-            /* update to the tcb now being tracked
-             * after possible context switch in IRQ
-             */
-            curr_hash_index = PIDHASH(((struct tcb_s*)g_readytorun.head)->pid);
+        if (perf_active) {
+            irq_times[curr_irq] += usec;
         }
     }
+
+    curr_irq = NO_IRQ;
+
+    /* update to the tcb now being tracked
+     * after possible context switch in IRQ
+     */
+    hash_index = PIDHASH(((struct tcb_s*)g_readytorun.head)->pid);
+    if (hash_index != curr_hash_index) {
+        prof_switch_to(hash_index);
+    }
 }
 
 /************************************************************************
@@ -468,14 +551,11 @@ inline void sched_track_irq_stop(void)
  ************************************************************************/
 inline void sched_track_irq_start (int irq)
 {
-    if (perf_active) {
-        /* stop tracking tcb */
-        g_pidhash[curr_hash_index].thread_time += get_perf_diff_from_last(get_perf_time());
-
-        /* track the current irq */
-        curr_irq = irq;
+    /* stop tracking tcb */
+    prof_charge_task(prof_elapsed());
 
-    }
+    /* track the current irq */
+    curr_irq = irq;
 }
 
 
@@ -494,10 +574,8 @@ inline void sched_track_irq_start (int irq)
  ************************************************************************/
 void sched_track_pre_exit(struct tcb_s* dead_tcb)
 {
-    if (perf_active) {
-        //ToDo
-        lldbg("Hit sched_track_pre_exit\n");
-    }
+    /* the exiting task is charged up to here */
+    prof_charge_task(prof_elapsed());
 }
 
 /************************************************************************
@@ -515,9 +593,155 @@ void sched_track_pre_exit(struct tcb_s* dead_tcb)
  ************************************************************************/
 void sched_track_post_exit(struct tcb_s* new_tcb)
 {
-    if (perf_active) {
-        lldbg("Hit sched_track_post_exit\n");
+    /* task_exit() itself is not charged to anyone, and the slot of the
+     * dead task has been released so it is not counted as preempted
+     */
+    (void)prof_elapsed();
+
+    curr_hash_index = PIDHASH(new_tcb->pid);
+    g_pidhash[curr_hash_index].switches++;
+}
+
+/************************************************************************
+ * Name: sched_perf_get
+ *
+ * Description:
+ *   Get the run time, context switch and preemption counts of a task
+ *   since it started.
+ *
+ * Inputs:
+ *   pid - task to look at
+ *   perf - returned counters
+ *
+ * Return Value:
+ *   OK (0) on success
+ *   -ESRCH if there is no such task
+ *
+ ************************************************************************/
+int sched_perf_get(pid_t pid, FAR struct sched_perf_s *perf)
+{
+    irqstate_t flags;
+    int hash_index = PIDHASH(pid);
+    int ret = -ESRCH;
+
+    flags = irqsave();
+
+    if (g_pidhash[hash_index].tcb && g_pidhash[hash_index].pid == pid) {
+        /* account the running task up to now */
+        if (hash_index == curr_hash_index && curr_irq == NO_IRQ) {
+            prof_charge_task(prof_elapsed());
+        }
+
+        perf->run_time = g_pidhash[hash_index].run_time;
+        perf->switches = g_pidhash[hash_index].switches;
+        perf->preemptions = g_pidhash[hash_index].preemptions;
+        ret = OK;
+    }
+
+    irqrestore(flags);
+
+    return ret;
+}
+
+/************************************************************************
+ * Name: irq_perf_get
+ *
+ * Description:
+ *   Get the time spent in an interrupt, the number of times it was
+ *   handled and its longest run since boot.
+ *
+ * Inputs:
+ *   irq - interrupt to look at
+ *   perf - returned counters
+ *
+ * Return Value:
+ *   OK (0) on success
+ *   -EINVAL if irq is not valid
+ *
+ ************************************************************************/
+int irq_perf_get(int irq, FAR struct irq_perf_s *perf)
+{
+    irqstate_t flags;
+
+    if ((unsigned int)irq >= NR_IRQS) {
+        return -EINVAL;
+    }
+
+    flags = irqsave();
+    *perf = irq_perf[irq];
+    irqrestore(flags);
+
+    perf->name = tsb_irq_name(irq);
+
+    return OK;
+}
+
+#if CONFIG_USEC_MEASURE_PERF_SAMPLES > 0
+/************************************************************************
+ * Name: sched_perf_sample
+ *
+ * Description:
+ *   Record the PC interrupted by the system tick along with the task
+ *   it belongs to.
+ *
+ * Inputs:
+ *   pc - interrupted program counter
+ *
+ * Return Value:
+ *   void
+ *
+ * Assumptions/Limitations:
+ *   Called from the system tick interrupt handler.
+ *
+ ************************************************************************/
+void sched_perf_sample(uintptr_t pc)
+{
+    struct sched_perf_sample_s *sample;
+
+    sample = &perf_samples[perf_sample_next];
+    sample->pid = g_pidhash[curr_hash_index].pid;
+    sample->pc = pc;
+
+    if (++perf_sample_next == CONFIG_USEC_MEASURE_PERF_SAMPLES) {
+        perf_sample_next = 0;
     }
 }
 
+/************************************************************************
+ * Name: sched_perf_samples
+ *
+ * Description:
+ *   Copy the PCs most recently sampled in a task, newest first.
+ *
+ * Inputs:
+ *   pid - task to look at
+ *   pcs - returned PCs
+ *   max - size of pcs
+ *
+ * Return Value:
+ *   Number of PCs copied
+ *
+ ************************************************************************/
+int sched_perf_samples(pid_t pid, FAR uintptr_t *pcs, int max)
+{
+    irqstate_t flags;
+    unsigned int i, ndx;
+    int count = 0;
+
+    flags = irqsave();
+
+    ndx = perf_sample_next;
+    for (i = 0; i < CONFIG_USEC_MEASURE_PERF_SAMPLES && count < max; i++) {
+        ndx = ndx ? ndx - 1 : CONFIG_USEC_MEASURE_PERF_SAMPLES - 1;
+        if (perf_samples[ndx].pc && perf_samples[ndx].pid == pid) {
+            pcs[count++] = perf_samples[ndx].pc;
+        }
+    }
+
+    irqrestore(flags);
+
+    return count;
+}
+#endif
+
 #endif
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/************************************************************************
+ * Priority index of the ready-to-run list
+ *
+ * g_readytorun stays a single list sorted by priority, since the
+ * architecture code relies on its head being the running task.  The
+ * tasks of one priority are contiguous in it and form a FIFO, so the
+ * list can be indexed by the last task of each priority along with a
+ * bitmap of the priorities that have ready tasks.  A task is inserted
+ * after the last task of its own priority or, if there is none, after
+ * the last task of the closest higher priority, which the bitmap gives
+ * in a few word operations.  Insertion and removal are then O(1)
+ * whatever the number of ready tasks.
+ ************************************************************************/
+
+/************************************************************************
+ * Included Files
+ ************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <queue.h>
+#include <assert.h>
+
+#include "sched/sched.h"
+
+#ifdef CONFIG_SCHED_RTR_BITMAP
+
+/************************************************************************
+ * Pre-processor Definitions
+ ************************************************************************/
+
+#define RTR_NPRIORITIES   (SCHED_PRIORITY_MAX + 1)
+#define RTR_NWORDS        ((RTR_NPRIORITIES + 31) / 32)
+
+/************************************************************************
+ * Private Variables
+ ************************************************************************/
+
+/* Bit n is set if there is a ready-to-run task of priority n */
+
+static uint32_t g_rtr_bitmap[RTR_NWORDS];
+
+/* Last ready-to-run task of each priority */
+
+static FAR struct tcb_s *g_rtr_tail[RTR_NPRIORITIES];
+
+/************************************************************************
+ * Private Functions
+ ************************************************************************/
+
+/************************************************************************
+ * Name: sched_rtr_above
+ *
+ * Description:
+ *   Return the last task of the lowest priority strictly above
+ *   'priority' that has ready tasks, or NULL if there is none.
+ *
+ ************************************************************************/
+
+static FAR struct tcb_s *sched_rtr_above(uint8_t priority)
+{
+  unsigned int word = priority / 32;
+  uint32_t bits;
+
+  /* Mask the priorities up to and including 'priority' in its word */
+
+  bits = g_rtr_bitmap[word] & ~((2u << (priority % 32)) - 1);
+
+  while (!bits)
+    {
+      if (++word >= RTR_NWORDS)
+        {
+          return NULL;
+        }
+
+      bits = g_rtr_bitmap[word];
+    }
+
+  return g_rtr_tail[word * 32 + __builtin_ctz(bits)];
+}
+
+/************************************************************************
+ * Public Functions
+ ************************************************************************/
+
+/************************************************************************
+ * Name: sched_rtr_highest
+ *
+ * Description:
+ *   Return the highest priority that has a ready-to-run task.  This is
+ *   the priority of the running task unless preemption is locked.
+ *
+ ************************************************************************/
+
+int sched_rtr_highest(void)
+{
+  int word;
+
+  for (word = RTR_NWORDS - 1; word >= 0; word--)
+    {
+      if (g_rtr_bitmap[word])
+        {
+          return word * 32 + 31 - __builtin_clz(g_rtr_bitmap[word]);
+        }
+    }
+
+  return -1;
+}
+
+/************************************************************************
+ * Name: sched_rtr_insert
+ *
+ * Description:
+ *   Insert a TCB in g_readytorun after the tasks of higher or equal
+ *   priority.  This is what sched_addprioritized() does, without
+ *   walking the list.
+ *
+ * Return Value:
+ *   true if the head of g_readytorun has changed.
+ *
+ * Assumptions:
+ *   Interrupts are disabled.  The caller updates task_state.
+ *
+ ************************************************************************/
+
+bool sched_rtr_insert(FAR struct tcb_s *tcb)
+{
+  uint8_t priority = tcb->sched_priority;
+  FAR struct tcb_s *prev;
+
+  prev = g_rtr_tail[priority];
+  if (!prev)
+    {
+      prev = sched_rtr_above(priority);
+      g_rtr_bitmap[priority / 32] |= 1u << (priority % 32);
+    }
+
+  g_rtr_tail[priority] = tcb;
+
+  if (!prev)
+    {
+      dq_addfirst((FAR dq_entry_t *)tcb, (FAR dq_queue_t *)&g_readytorun);
+      return true;
+    }
+
+  dq_addafter((FAR dq_entry_t *)prev, (FAR dq_entry_t *)tcb,
+              (FAR dq_queue_t *)&g_readytorun);
+  return false;
+}
+
+/************************************************************************
+ * Name: sched_rtr_remove
+ *
+ * Description:
+ *   Remove a TCB from g_readytorun and from the priority index.
+ *
+ * Assumptions:
+ *   Interrupts are disabled.  The caller updates task_state.
+ *
+ ************************************************************************/
+
+void sched_rtr_remove(FAR struct tcb_s *tcb)
+{
+  uint8_t priority = tcb->sched_priority;
+  FAR struct tcb_s *prev = tcb->blink;
+
+  DEBUGASSERT(g_rtr_tail[priority] != NULL);
+
+  if (g_rtr_tail[priority] == tcb)
+    {
+      if (prev && prev->sched_priority == priority)
+        {
+          g_rtr_tail[priority] = prev;
+        }
+      else
+        {
+          g_rtr_tail[priority] = NULL;
+          g_rtr_bitmap[priority / 32] &= ~(1u << (priority % 32));
+        }
+    }
+
+  dq_rem((FAR dq_entry_t *)tcb, (FAR dq_queue_t *)&g_readytorun);
+}
+
+/************************************************************************
+ * Name: sched_rtr_setpriority
+ *
+ * Description:
+ *   Change the priority of a TCB in g_readytorun whose position in the
+ *   list doesn't change, such as the running task getting a priority
+ *   still higher than the next task.
+ *
+ ************************************************************************/
+
+void sched_rtr_setpriority(FAR struct tcb_s *tcb, uint8_t priority)
+{
+  sched_rtr_remove(tcb);
+  tcb->sched_priority = priority;
+  sched_rtr_insert(tcb);
+}
+
+#endif /* CONFIG_SCHED_RTR_BITMAP */
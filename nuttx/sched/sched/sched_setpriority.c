@@ -151,7 +151,11 @@ int sched_setpriority(FAR struct tcb_s *tcb, int sched_priority)
           {
             /* Change the task priority */
 
+#ifdef CONFIG_SCHED_RTR_BITMAP
+            sched_rtr_setpriority(tcb, (uint8_t)sched_priority);
+#else
             tcb->sched_priority = (uint8_t)sched_priority;
+#endif
           }
         break;
 
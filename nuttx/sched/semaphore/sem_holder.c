@@ -60,6 +60,12 @@
 #  define CONFIG_SEM_PREALLOCHOLDERS 0
 #endif
 
+/* nholds sticks at this value once reached:  the task then always walks
+ * the holders rather than trusting a count that may have wrapped.
+ */
+
+#define SEM_NHOLDS_SATURATED UINT16_MAX
+
 /****************************************************************************
  * Private Type Declarations
  ****************************************************************************/
@@ -86,6 +92,39 @@ static FAR struct semholder_s *g_freeholders;
  * Private Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: sem_addnholds
+ ****************************************************************************/
+
+static inline void sem_addnholds(FAR struct tcb_s *htcb)
+{
+  if (htcb->nholds < SEM_NHOLDS_SATURATED)
+    {
+      htcb->nholds++;
+    }
+}
+
+/****************************************************************************
+ * Name: sem_subnholds
+ ****************************************************************************/
+
+static inline void sem_subnholds(FAR struct tcb_s *htcb, int16_t counts)
+{
+  if (htcb->nholds == SEM_NHOLDS_SATURATED || counts <= 0)
+    {
+      return;
+    }
+
+  if (htcb->nholds > (uint16_t)counts)
+    {
+      htcb->nholds -= counts;
+    }
+  else
+    {
+      htcb->nholds = 0;
+    }
+}
+
 /****************************************************************************
  * Name: sem_allocholder
  ****************************************************************************/
@@ -99,24 +138,23 @@ static inline FAR struct semholder_s *sem_allocholder(sem_t *sem)
    * used to implement mutexes.
    */
 
+  if (!sem->holder.htcb)
+    {
+      pholder          = &sem->holder;
+      pholder->counts  = 0;
+    }
 #if CONFIG_SEM_PREALLOCHOLDERS > 0
-  pholder = g_freeholders;
-  if (pholder)
+  else if (g_freeholders)
     {
       /* Remove the holder from the free list an put it into the semaphore's holder list */
 
+      pholder          = g_freeholders;
       g_freeholders    = pholder->flink;
       pholder->flink   = sem->hhead;
       sem->hhead       = pholder;
 
       /* Make sure the initial count is zero */
 
-      pholder->counts  = 0;
-    }
-#else
-  if (!sem->holder.htcb)
-    {
-      pholder          = &sem->holder;
       pholder->counts  = 0;
     }
 #endif
@@ -136,15 +174,21 @@ static inline FAR struct semholder_s *sem_allocholder(sem_t *sem)
 static FAR struct semholder_s *sem_findholder(sem_t *sem,
                                               FAR struct tcb_s *htcb)
 {
+#if CONFIG_SEM_PREALLOCHOLDERS > 0
   FAR struct semholder_s *pholder;
+#endif
+
+  /* Check the "built-in" holder first:  this is the only one of a mutex */
+
+  if (sem->holder.htcb == htcb)
+    {
+      return &sem->holder;
+    }
 
   /* Try to find the holder in the list of holders associated with this semaphore */
 
 #if CONFIG_SEM_PREALLOCHOLDERS > 0
   for (pholder = sem->hhead; pholder; pholder = pholder->flink)
-#else
-  pholder = &sem->holder;
-#endif
     {
       if (pholder->htcb == htcb)
         {
@@ -153,6 +197,7 @@ static FAR struct semholder_s *sem_findholder(sem_t *sem,
           return pholder;
         }
     }
+#endif
 
   /* The holder does not appear in the list */
 
@@ -186,12 +231,31 @@ static inline void sem_freeholder(sem_t *sem, FAR struct semholder_s *pholder)
   FAR struct semholder_s *prev;
 #endif
 
+  /* Counts still held here are left when the semaphore is destroyed or
+   * when the holder has exited.  Only the running task is known to still
+   * own its TCB, so only its nholds is given the counts back:  the TCB of
+   * an exited holder may already belong to another task, and a count too
+   * low there would drop a boost that is still needed.
+   */
+
+  if (pholder->htcb == (FAR struct tcb_s *)g_readytorun.head)
+    {
+      sem_subnholds(pholder->htcb, pholder->counts);
+    }
+
   /* Release the holder and counts */
 
   pholder->htcb   = NULL;
   pholder->counts = 0;
 
 #if CONFIG_SEM_PREALLOCHOLDERS > 0
+  /* The "built-in" holder is not in the list */
+
+  if (pholder == &sem->holder)
+    {
+      return;
+    }
+
   /* Search the list for the matching holder */
 
   for (prev = NULL, curr = sem->hhead;
@@ -231,19 +295,20 @@ static int sem_foreachholder(FAR sem_t *sem, holderhandler_t handler, FAR void *
 #endif
   int ret = 0;
 
-#if CONFIG_SEM_PREALLOCHOLDERS > 0
-  for (pholder = sem->hhead; pholder && ret == 0; pholder = next)
-#else
+  /* The "built-in" container may hold a NULL holder */
+
   pholder = &sem->holder;
-#endif
+  if (pholder->htcb)
     {
+      ret = handler(pholder, sem, arg);
+    }
+
 #if CONFIG_SEM_PREALLOCHOLDERS > 0
+  for (pholder = sem->hhead; pholder && ret == 0; pholder = next)
+    {
       /* In case this holder gets deleted */
 
       next = pholder->flink;
-#endif
-      /* The initial "built-in" container may hold a NULL holder */
-
       if (pholder->htcb)
         {
           /* Call the handler */
@@ -251,6 +316,7 @@ static int sem_foreachholder(FAR sem_t *sem, holderhandler_t handler, FAR void *
           ret = handler(pholder, sem, arg);
         }
     }
+#endif
 
   return ret;
 }
@@ -259,13 +325,11 @@ static int sem_foreachholder(FAR sem_t *sem, holderhandler_t handler, FAR void *
  * Name: sem_recoverholders
  ****************************************************************************/
 
-#if CONFIG_SEM_PREALLOCHOLDERS > 0
 static int sem_recoverholders(FAR struct semholder_s *pholder, FAR sem_t *sem, FAR void *arg)
 {
   sem_freeholder(sem, pholder);
   return 0;
 }
-#endif
 
 /****************************************************************************
  * Name: sem_boostholderprio
@@ -333,6 +397,7 @@ static int sem_boostholderprio(FAR struct semholder_s *pholder,
            * switch may occur during up_block_task() processing.
            */
 
+          sched_note_priority(htcb, rtcb->sched_priority);
           (void)sched_setpriority(htcb, rtcb->sched_priority);
         }
       else
@@ -363,6 +428,7 @@ static int sem_boostholderprio(FAR struct semholder_s *pholder,
        * will occur during up_block_task() processing.
        */
 
+      sched_note_priority(htcb, rtcb->sched_priority);
       (void)sched_setpriority(htcb, rtcb->sched_priority);
     }
 #endif
@@ -464,6 +530,7 @@ static int sem_restoreholderprio(FAR struct semholder_s *pholder, FAR sem_t *sem
 
           /* Reset the holder's priority back to the base priority. */
 
+          sched_note_priority(htcb, htcb->base_priority);
           sched_reprioritize(htcb, htcb->base_priority);
         }
 
@@ -502,6 +569,7 @@ static int sem_restoreholderprio(FAR struct semholder_s *pholder, FAR sem_t *sem
 
           /* And apply that priority to the thread (while retaining the base_priority) */
 
+          sched_note_priority(htcb, rpriority);
           sched_setpriority(htcb, rpriority);
         }
       else
@@ -541,6 +609,7 @@ static int sem_restoreholderprio(FAR struct semholder_s *pholder, FAR sem_t *sem
        * priority.
        */
 
+      sched_note_priority(htcb, htcb->base_priority);
       sched_reprioritize(htcb, htcb->base_priority);
 #endif
     }
@@ -707,9 +776,24 @@ static inline void sem_restorebaseprio_task(FAR struct tcb_s *stcb, FAR sem_t *s
 
       (void)sem_foreachholder(sem, sem_restoreholderprioA, stcb);
 
-      /* Now, find an reprioritize only the ready to run task */
+      /* Now, find an reprioritize only the ready to run task.  If it no
+       * longer holds a count on any semaphore, nothing can justify a boost
+       * anymore:  drop it straight back to its base priority along with
+       * any pending reprioritization, without walking the holders.
+       */
 
-      (void)sem_foreachholder(sem, sem_restoreholderprioB, stcb);
+      if (rtcb->nholds == 0)
+        {
+          if (rtcb->sched_priority != rtcb->base_priority)
+            {
+              sched_note_priority(rtcb, rtcb->base_priority);
+              sched_reprioritize(rtcb, rtcb->base_priority);
+            }
+        }
+      else
+        {
+          (void)sem_foreachholder(sem, sem_restoreholderprioB, stcb);
+        }
     }
 
   /* If there are no tasks waiting for available counts, then all holders
@@ -810,19 +894,14 @@ void sem_destroyholder(FAR sem_t *sem)
    */
 
 #if CONFIG_SEM_PREALLOCHOLDERS > 0
-  if (sem->hhead)
-    {
-      sdbg("Semaphore destroyed with holders\n");
-      (void)sem_foreachholder(sem, sem_recoverholders, NULL);
-    }
+  if (sem->holder.htcb || sem->hhead)
 #else
   if (sem->holder.htcb)
+#endif
     {
-      sdbg("Semaphore destroyed with holder\n");
+      sdbg("Semaphore destroyed with holders\n");
+      (void)sem_foreachholder(sem, sem_recoverholders, NULL);
     }
-
-  sem->holder.htcb = NULL;
-#endif
 }
 
 /****************************************************************************
@@ -846,6 +925,13 @@ void sem_addholder(FAR sem_t *sem)
   FAR struct tcb_s *rtcb = (FAR struct tcb_s*)g_readytorun.head;
   FAR struct semholder_s *pholder;
 
+  /* Holders are not tracked without priority inheritance */
+
+  if (sem->protocol == SEM_PRIO_NONE)
+    {
+      return;
+    }
+
   /* Find or allocate a container for this new holder */
 
   pholder = sem_findorallocateholder(sem, rtcb);
@@ -855,6 +941,7 @@ void sem_addholder(FAR sem_t *sem)
 
       pholder->htcb = rtcb;
       pholder->counts++;
+      sem_addnholds(rtcb);
     }
 }
 
@@ -883,7 +970,10 @@ void sem_boostpriority(FAR sem_t *sem)
    * count.
    */
 
-   (void)sem_foreachholder(sem, sem_boostholderprio, rtcb);
+  if (sem->protocol != SEM_PRIO_NONE)
+    {
+      (void)sem_foreachholder(sem, sem_boostholderprio, rtcb);
+    }
 }
 
 /****************************************************************************
@@ -908,6 +998,11 @@ void sem_releaseholder(FAR sem_t *sem)
   FAR struct tcb_s *rtcb = (FAR struct tcb_s*)g_readytorun.head;
   FAR struct semholder_s *pholder;
 
+  if (sem->protocol == SEM_PRIO_NONE)
+    {
+      return;
+    }
+
   /* Find the container for this holder */
 
   pholder = sem_findholder(sem, rtcb);
@@ -918,6 +1013,7 @@ void sem_releaseholder(FAR sem_t *sem)
        */
 
       pholder->counts--;
+      sem_subnholds(rtcb, 1);
     }
 }
 
@@ -961,6 +1057,11 @@ void sem_restorebaseprio(FAR struct tcb_s *stcb, FAR sem_t *sem)
   DEBUGASSERT((sem->semcount > 0  && stcb == NULL) ||
               (sem->semcount <= 0 && stcb != NULL));
 
+  if (sem->protocol == SEM_PRIO_NONE)
+    {
+      return;
+    }
+
   /* Handler semaphore counts posed from an interrupt handler differently
    * from interrupts posted from threads.  The primary difference is that
    * if the semaphore is posted from a thread, then the poster thread is
@@ -1007,7 +1108,10 @@ void sem_canceled(FAR struct tcb_s *stcb, FAR sem_t *sem)
 
   /* Adjust the priority of every holder as necessary */
 
-  (void)sem_foreachholder(sem, sem_restoreholderprio, stcb);
+  if (sem->protocol != SEM_PRIO_NONE)
+    {
+      (void)sem_foreachholder(sem, sem_restoreholderprio, stcb);
+    }
 }
 #endif
 
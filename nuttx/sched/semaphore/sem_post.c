@@ -158,6 +158,7 @@ int sem_post(FAR sem_t *sem)
 
               /* Restart the waiting task. */
 
+              sched_note_semunblock(stcb, sem);
               up_unblock_task(stcb);
             }
         }
@@ -135,6 +135,7 @@ void sem_waitirq(FAR struct tcb_s *wtcb, int errcode)
 
       /* Restart the task. */
 
+      sched_note_semunblock(wtcb, sem);
       up_unblock_task(wtcb);
     }
 
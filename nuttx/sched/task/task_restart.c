@@ -160,8 +160,18 @@ int task_restart(pid_t pid)
        */
 
       state = irqsave();
-      dq_rem((FAR dq_entry_t*)tcb,
-             (dq_queue_t*)g_tasklisttable[tcb->cmn.task_state].list);
+#ifdef CONFIG_SCHED_RTR_BITMAP
+      if (tcb->cmn.task_state == TSTATE_TASK_READYTORUN)
+        {
+          sched_rtr_remove((FAR struct tcb_s *)tcb);
+        }
+      else
+#endif
+        {
+          dq_rem((FAR dq_entry_t*)tcb,
+                 (dq_queue_t*)g_tasklisttable[tcb->cmn.task_state].list);
+        }
+
       tcb->cmn.task_state = TSTATE_TASK_INVALID;
       irqrestore(state);
 
@@ -173,10 +183,13 @@ int task_restart(pid_t pid)
 
       tcb->cmn.sched_priority = tcb->init_priority;
 
-      /* Reset the base task priority and the number of pending reprioritizations */
+      /* Reset the base task priority, the number of counts held on
+       * semaphores and the number of pending reprioritizations.
+       */
 
 #ifdef CONFIG_PRIORITY_INHERITANCE
       tcb->cmn.base_priority = tcb->init_priority;
+      tcb->cmn.nholds = 0;
 #  if CONFIG_SEM_NNESTPRIO > 0
       tcb->cmn.npend_reprio = 0;
 #  endif
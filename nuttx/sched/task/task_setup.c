@@ -139,6 +139,12 @@ static int task_assignpid(FAR struct tcb_s *tcb)
           g_pidhash[hash_ndx].pid   = next_pid;
 #ifdef CONFIG_SCHED_CPULOAD
           g_pidhash[hash_ndx].ticks = 0;
+#endif
+#ifdef CONFIG_USEC_MEASURE_PERF
+          g_pidhash[hash_ndx].thread_time = 0;
+          g_pidhash[hash_ndx].run_time    = 0;
+          g_pidhash[hash_ndx].switches    = 0;
+          g_pidhash[hash_ndx].preemptions = 0;
 #endif
           tcb->pid = next_pid;
 
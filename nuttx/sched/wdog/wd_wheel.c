@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/************************************************************************
+ * Watchdog timer wheel
+ *
+ * Active watchdogs are hashed by their absolute expiration tick into
+ * CONFIG_WDOG_WHEEL_SIZE slots, each an unsorted doubly linked list, so
+ * that starting and cancelling a watchdog are O(1) however many are
+ * active.  Each tick only looks at the watchdogs of one slot, firing
+ * those whose expiration tick has come and leaving the ones due on a
+ * later turn of the wheel.
+ *
+ * With CONFIG_SCHED_TICKLESS, the earliest expiration is cached.  It is
+ * only searched for again when that watchdog goes away, by walking the
+ * slots in time order from the current tick.
+ ************************************************************************/
+
+/************************************************************************
+ * Included Files
+ ************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <nuttx/wdog.h>
+
+#include "sched/sched.h"
+#include "wdog/wdog.h"
+
+#ifdef CONFIG_WDOG_TIMER_WHEEL
+
+/************************************************************************
+ * Pre-processor Definitions
+ ************************************************************************/
+
+#define WDOG_WHEEL_SIZE   CONFIG_WDOG_WHEEL_SIZE
+#define WDOG_WHEEL_MASK   (WDOG_WHEEL_SIZE - 1)
+#define WDOG_WHEEL_WORDS  ((WDOG_WHEEL_SIZE + 31) / 32)
+
+#if (WDOG_WHEEL_SIZE & WDOG_WHEEL_MASK) != 0
+#  error CONFIG_WDOG_WHEEL_SIZE must be a power of two
+#endif
+
+/* With the wheel, the lag field holds the absolute expiration tick */
+
+#define WDOG_EXPIRE(w)    ((uint32_t)(w)->lag)
+#define WDOG_SLOT(t)      ((t) & WDOG_WHEEL_MASK)
+
+/************************************************************************
+ * Private Variables
+ ************************************************************************/
+
+static FAR struct wdog_s *g_wdwheel[WDOG_WHEEL_SIZE];
+
+/* Bit n is set if slot n holds watchdogs */
+
+static uint32_t g_wdslots[WDOG_WHEEL_WORDS];
+
+/* Current tick of the wheel and number of active watchdogs */
+
+static uint32_t g_wdtick;
+static unsigned int g_wdcount;
+
+#ifdef CONFIG_SCHED_TICKLESS
+/* Earliest expiration tick, if g_wdnextvalid */
+
+static uint32_t g_wdnext;
+static bool g_wdnextvalid;
+#endif
+
+/************************************************************************
+ * Private Functions
+ ************************************************************************/
+
+static inline bool wd_slot_used(unsigned int slot)
+{
+  return (g_wdslots[slot / 32] & (1u << (slot % 32))) != 0;
+}
+
+static void wd_wheel_link(FAR struct wdog_s *wdog)
+{
+  unsigned int slot = WDOG_SLOT(WDOG_EXPIRE(wdog));
+  FAR struct wdog_s *head = g_wdwheel[slot];
+
+  wdog->prev = NULL;
+  wdog->next = head;
+  if (head)
+    {
+      head->prev = wdog;
+    }
+
+  g_wdwheel[slot] = wdog;
+  g_wdslots[slot / 32] |= 1u << (slot % 32);
+}
+
+static void wd_wheel_unlink(FAR struct wdog_s *wdog)
+{
+  unsigned int slot = WDOG_SLOT(WDOG_EXPIRE(wdog));
+
+  if (wdog->prev)
+    {
+      wdog->prev->next = wdog->next;
+    }
+  else
+    {
+      g_wdwheel[slot] = wdog->next;
+      if (!wdog->next)
+        {
+          g_wdslots[slot / 32] &= ~(1u << (slot % 32));
+        }
+    }
+
+  if (wdog->next)
+    {
+      wdog->next->prev = wdog->prev;
+    }
+
+  wdog->next = NULL;
+  wdog->prev = NULL;
+}
+
+/************************************************************************
+ * Name: wd_wheel_expire
+ *
+ * Description:
+ *   Run the watchdogs of a slot whose expiration tick has come.  The
+ *   slot is searched again after each one since the watchdog function
+ *   may start or cancel other watchdogs.
+ *
+ ************************************************************************/
+
+static void wd_wheel_expire(unsigned int slot)
+{
+  FAR struct wdog_s *wdog = g_wdwheel[slot];
+
+  while (wdog)
+    {
+      if ((int32_t)(WDOG_EXPIRE(wdog) - g_wdtick) > 0)
+        {
+          wdog = wdog->next;
+          continue;
+        }
+
+      (void)wd_wheel_remove(wdog);
+      WDOG_CLRACTIVE(wdog);
+      wd_dispatch(wdog);
+
+      wdog = g_wdwheel[slot];
+    }
+}
+
+/************************************************************************
+ * Name: wd_wheel_advance
+ *
+ * Description:
+ *   Move the wheel forward by 'ticks' and run the watchdogs that expire
+ *   on the way, in order.  A watchdog function sees the final tick.
+ *
+ ************************************************************************/
+
+static void wd_wheel_advance(unsigned int ticks)
+{
+  uint32_t tick = g_wdtick + 1;
+  unsigned int steps;
+
+  /* Every slot is looked at once when more than a turn has gone by */
+
+  steps = ticks < WDOG_WHEEL_SIZE ? ticks : WDOG_WHEEL_SIZE;
+  g_wdtick += ticks;
+
+  while (steps-- > 0 && g_wdcount > 0)
+    {
+      if (wd_slot_used(WDOG_SLOT(tick)))
+        {
+          wd_wheel_expire(WDOG_SLOT(tick));
+        }
+
+      tick++;
+    }
+}
+
+#ifdef CONFIG_SCHED_TICKLESS
+/************************************************************************
+ * Name: wd_wheel_earliest
+ *
+ * Description:
+ *   Find the expiration tick of the earliest active watchdog.  One that
+ *   expires within a turn of the wheel sits in the slot at that distance
+ *   from the current tick, so the slots are walked in time order until
+ *   no watchdog in a further slot can expire earlier.
+ *
+ ************************************************************************/
+
+static uint32_t wd_wheel_earliest(void)
+{
+  FAR struct wdog_s *wdog;
+  uint32_t best = 0;
+  bool found = false;
+  unsigned int slot;
+  unsigned int dist;
+
+  for (dist = 1; dist <= WDOG_WHEEL_SIZE; dist++)
+    {
+      slot = WDOG_SLOT(g_wdtick + dist);
+      if (!wd_slot_used(slot))
+        {
+          continue;
+        }
+
+      for (wdog = g_wdwheel[slot]; wdog; wdog = wdog->next)
+        {
+          if (!found || (int32_t)(WDOG_EXPIRE(wdog) - best) < 0)
+            {
+              best  = WDOG_EXPIRE(wdog);
+              found = true;
+            }
+        }
+
+      if (found && (int32_t)(best - g_wdtick) <= (int32_t)dist)
+        {
+          break;
+        }
+    }
+
+  return best;
+}
+
+/************************************************************************
+ * Name: wd_wheel_next
+ *
+ * Description:
+ *   Return the number of ticks until the earliest watchdog expires, or
+ *   zero if there is no active watchdog.
+ *
+ ************************************************************************/
+
+static unsigned int wd_wheel_next(void)
+{
+  int32_t delta;
+
+  if (g_wdcount == 0)
+    {
+      return 0;
+    }
+
+  if (!g_wdnextvalid)
+    {
+      g_wdnext      = wd_wheel_earliest();
+      g_wdnextvalid = true;
+    }
+
+  delta = (int32_t)(g_wdnext - g_wdtick);
+  return delta > 0 ? delta : 1;
+}
+#endif
+
+/************************************************************************
+ * Public Functions
+ ************************************************************************/
+
+/************************************************************************
+ * Name: wd_wheel_insert
+ *
+ * Description:
+ *   Add a watchdog expiring 'delay' ticks from now to the wheel.
+ *
+ * Assumptions:
+ *   Interrupts are disabled.
+ *
+ ************************************************************************/
+
+void wd_wheel_insert(FAR struct wdog_s *wdog, int delay)
+{
+  wdog->lag = (int)(g_wdtick + delay);
+  wd_wheel_link(wdog);
+
+#ifdef CONFIG_SCHED_TICKLESS
+  if (g_wdcount == 0)
+    {
+      g_wdnext      = WDOG_EXPIRE(wdog);
+      g_wdnextvalid = true;
+    }
+  else if (g_wdnextvalid && (int32_t)(WDOG_EXPIRE(wdog) - g_wdnext) < 0)
+    {
+      g_wdnext = WDOG_EXPIRE(wdog);
+    }
+#endif
+
+  g_wdcount++;
+}
+
+/************************************************************************
+ * Name: wd_wheel_remove
+ *
+ * Description:
+ *   Take a watchdog off the wheel.
+ *
+ * Return Value:
+ *   true if it was the earliest watchdog to expire.
+ *
+ * Assumptions:
+ *   Interrupts are disabled.
+ *
+ ************************************************************************/
+
+bool wd_wheel_remove(FAR struct wdog_s *wdog)
+{
+  bool first = false;
+
+  wd_wheel_unlink(wdog);
+  g_wdcount--;
+
+#ifdef CONFIG_SCHED_TICKLESS
+  if (!g_wdnextvalid || WDOG_EXPIRE(wdog) == g_wdnext)
+    {
+      g_wdnextvalid = false;
+      first = true;
+    }
+#endif
+
+  return first;
+}
+
+/************************************************************************
+ * Name: wd_wheel_gettime
+ *
+ * Description:
+ *   Return the number of ticks before an active watchdog expires.
+ *
+ ************************************************************************/
+
+int wd_wheel_gettime(FAR struct wdog_s *wdog)
+{
+  int32_t delta = (int32_t)(WDOG_EXPIRE(wdog) - g_wdtick);
+
+  return delta > 0 ? delta : 0;
+}
+
+/****************************************************************************
+ * Name: wd_timer
+ *
+ * Description:
+ *   This function is called from the timer interrupt handler to determine
+ *   if it is time to execute a watchdog function.  If so, the watchdog
+ *   function will be executed in the context of the timer interrupt
+ *   handler.
+ *
+ * Parameters:
+ *   ticks - If CONFIG_SCHED_TICKLESS is defined then the number of ticks
+ *     in the the interval that just expired is provided.  Otherwise,
+ *     this function is called on each timer interrupt and a value of one
+ *     is implicit.
+ *
+ * Return Value:
+ *   If CONFIG_SCHED_TICKLESS is defined then the number of ticks for the
+ *   next delay is provided (zero if no delay).  Otherwise, this function
+ *   has no returned value.
+ *
+ * Assumptions:
+ *   Called from interrupt handler logic with interrupts disabled.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SCHED_TICKLESS
+unsigned int wd_timer(int ticks)
+{
+  if (ticks > 0)
+    {
+      wd_wheel_advance(ticks);
+    }
+
+  return wd_wheel_next();
+}
+#else
+void wd_timer(void)
+{
+  wd_wheel_advance(1);
+}
+#endif /* CONFIG_SCHED_TICKLESS */
+
+#endif /* CONFIG_WDOG_TIMER_WHEEL */
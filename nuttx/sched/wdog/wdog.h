@@ -144,6 +144,32 @@ unsigned int wd_timer(int ticks);
 void wd_timer(void);
 #endif
 
+/****************************************************************************
+ * Name: wd_dispatch
+ *
+ * Description:
+ *   Call the function of an expired watchdog with its parameters.
+ *
+ ****************************************************************************/
+
+void wd_dispatch(FAR struct wdog_s *wdog);
+
+#ifdef CONFIG_WDOG_TIMER_WHEEL
+/****************************************************************************
+ * Name: wd_wheel_insert, wd_wheel_remove, wd_wheel_gettime
+ *
+ * Description:
+ *   Add a watchdog to the timer wheel, remove it (returning true if it was
+ *   the next to expire) and get the ticks left before it expires.  Called
+ *   with interrupts disabled.
+ *
+ ****************************************************************************/
+
+void wd_wheel_insert(FAR struct wdog_s *wdog, int delay);
+bool wd_wheel_remove(FAR struct wdog_s *wdog);
+int  wd_wheel_gettime(FAR struct wdog_s *wdog);
+#endif
+
 #undef EXTERN
 #ifdef __cplusplus
 }